@@ -8,8 +8,6 @@ else()
 endif()
 
 add_executable(${EXE_NAME} ${EXE_SOURCE_FILES}
-  "deps/zlib/contrib/minizip/unzip.c"
-  "deps/zlib/contrib/minizip/ioapi.c"
   ${NODEV_VERSIONINFO_RC}
 )
 
@@ -82,3 +80,9 @@ endif()
 
 add_subdirectory("deps/toyo")
 target_link_libraries(${EXE_NAME} toyo)
+
+add_subdirectory("deps/xz")
+target_link_libraries(${EXE_NAME} xz)
+
+find_package(Threads REQUIRED)
+target_link_libraries(${EXE_NAME} Threads::Threads)
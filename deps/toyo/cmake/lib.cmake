@@ -18,7 +18,12 @@ if(WIN32 AND MSVC)
     _UNICODE
   )
 else()
-  target_link_libraries(${LIB_NAME} dl)
+  target_link_libraries(${LIB_NAME} dl pthread)
+  include(CheckIncludeFile)
+  check_include_file("linux/io_uring.h" TOYO_HAVE_IO_URING)
+  if(TOYO_HAVE_IO_URING)
+    target_compile_definitions(${LIB_NAME} PRIVATE TOYO_HAVE_IO_URING)
+  endif()
 endif()
 
 target_include_directories(${LIB_NAME}
@@ -8,6 +8,10 @@ set_target_properties(${TEST_EXE_NAME} PROPERTIES CXX_STANDARD 11)
 
 target_link_libraries(${TEST_EXE_NAME} ${LIB_NAME})
 
+add_executable(${TEST_EXE_NAME}bench "test/bench.cpp")
+set_target_properties(${TEST_EXE_NAME}bench PROPERTIES CXX_STANDARD 11)
+target_link_libraries(${TEST_EXE_NAME}bench ${LIB_NAME})
+
 if(WIN32 AND MSVC)
   set_directory_properties(PROPERTIES VS_STARTUP_PROJECT ${TEST_EXE_NAME})
   # set_target_properties(${TEST_EXE_NAME} PROPERTIES MSVC_RUNTIME_LIBRARY "MultiThreaded$<$<CONFIG:Debug>:Debug>")
@@ -0,0 +1,99 @@
+#ifndef __TOYO_EXECUTOR_HPP__
+#define __TOYO_EXECUTOR_HPP__
+
+#include <cstddef>
+#include <memory>
+#include <future>
+#include <functional>
+
+namespace toyo {
+
+namespace executor {
+
+class pool_impl;
+
+/*
+ * A fixed set of worker threads, each with its own deque of tasks. A
+ * worker takes the newest task of its own deque and, when that is empty,
+ * steals the oldest one of another worker. Tasks posted from a worker go
+ * to its own deque, tasks posted from outside are spread over all of them.
+ *
+ * With `max_queued` the pool holds at most that many tasks which have not
+ * started: post() from outside blocks until there is room, post() from a
+ * worker runs the task at once instead, so that the pool can not wait on
+ * itself.
+ */
+class pool {
+private:
+  pool_impl* impl_;
+public:
+  // `threads` 0 for one per CPU, `max_queued` 0 for no limit
+  pool(unsigned int threads = 0, std::size_t max_queued = 0);
+  // runs what is queued, then joins the workers
+  ~pool();
+  pool(const pool&) = delete;
+  pool& operator=(const pool&) = delete;
+
+  // the pool shared by everything in the process, one thread per CPU
+  static pool& shared();
+
+  // exceptions thrown by `fn` are ignored
+  void post(std::function<void ()> fn);
+
+  // do not wait on the future from a task of the same pool, use a
+  // task_group there
+  template <typename Callable>
+  auto submit(Callable&& fn) -> std::future<decltype(fn())> {
+    typedef decltype(fn()) result_type;
+    std::shared_ptr<std::packaged_task<result_type ()>> task =
+      std::make_shared<std::packaged_task<result_type ()>>(std::forward<Callable>(fn));
+    std::future<result_type> result = task->get_future();
+    post([task]() { (*task)(); });
+    return result;
+  }
+
+  // runs one queued task on the calling thread, false when there was none
+  bool run_one();
+  // whether the calling thread is a worker of this pool
+  bool in_worker() const;
+  unsigned int size() const;
+};
+
+struct task_group_state;
+
+/*
+ * Tasks on a pool which are waited for together. The first exception
+ * thrown by a task cancels the group and is rethrown from wait(). Tasks
+ * of a cancelled group that have not started are skipped, running ones
+ * can look at cancelled() to stop early.
+ */
+class task_group {
+private:
+  pool* pool_;
+  std::shared_ptr<task_group_state> state_;
+public:
+  task_group(pool& p = pool::shared());
+  // waits, exceptions are ignored
+  ~task_group();
+  task_group(const task_group&) = delete;
+  task_group& operator=(const task_group&) = delete;
+
+  void run(std::function<void ()> fn);
+  // a worker that waits runs other tasks of the pool meanwhile
+  void wait();
+  // false when `ms` milliseconds passed before the tasks were done
+  bool wait_for(unsigned int ms);
+  void cancel();
+  bool cancelled() const;
+};
+
+// calls `fn(i)` for every i in [begin, end) on the pool, `grain` indices
+// per task, 0 for a few tasks per worker
+void parallel_for(std::size_t begin, std::size_t end, const std::function<void (std::size_t)>& fn,
+  std::size_t grain = 0, pool& p = pool::shared());
+
+}
+
+}
+
+#endif
@@ -3,6 +3,7 @@
 
 #include <string>
 #include <vector>
+#include <memory>
 
 #include <ctime>
 
@@ -37,6 +38,25 @@ enum symlink_type {
   symlink_type_junction
 };
 
+// how copy_file() moved the data
+enum copy_method {
+  copy_method_none,              // source and destination are the same file
+  copy_method_clone,             // reflink, the blocks are shared (btrfs, XFS)
+  copy_method_copy_file_range,   // in the kernel, may still clone
+  copy_method_sendfile,          // in the kernel
+  copy_method_buffer,            // read and write through user space
+  copy_method_system             // CopyFileW on Windows, which clones on ReFS
+};
+
+typedef struct copy_options {
+  bool fail_if_exists;
+  // hard links to the files of the source, copies where that fails
+  bool hardlink;
+  // the files are copied on executor::pool::shared()
+  bool parallel;
+  copy_options();
+} copy_options;
+
 class stats {
 private:
   bool is_link_;
@@ -168,12 +188,17 @@ void mkdirs(const std::string&, int mode = 0777);
 void unlink(const std::string&);
 void rmdir(const std::string&);
 void rename(const std::string&, const std::string&);
-void remove(const std::string&);
+// `parallel` hands subtrees to the workers of executor::pool::shared()
+void remove(const std::string&, bool parallel = false);
 void symlink(const std::string&, const std::string&);
 void symlink(const std::string&, const std::string&, symlink_type);
 std::string realpath(const std::string&);
-void copy_file(const std::string&, const std::string&, bool fail_if_exists = false);
+// the mode is copied as well
+copy_method copy_file(const std::string&, const std::string&, bool fail_if_exists = false);
 void copy(const std::string&, const std::string&, bool fail_if_exists = false);
+// the tree is read first, then the directories are made and the files
+// copied; symbolic links stay links, modes and times are kept
+void copy(const std::string&, const std::string&, const copy_options&);
 void move(const std::string&, const std::string&);
 std::vector<unsigned char> read_file(const std::string&);
 std::string read_file_to_string(const std::string&);
@@ -182,6 +207,48 @@ void write_file(const std::string&, const std::string&);
 void append_file(const std::string&, const std::vector<unsigned char>&);
 void append_file(const std::string&, const std::string&);
 
+class bulk_writer_impl;
+
+/*
+ * Writes many files without a blocking syscall per open, write and close.
+ * Every file is a queue of chunks written in order; open() and write()
+ * return at once and the work happens behind them. A few threads make the
+ * plain syscalls; on Linux the opens, writes and closes of all queued files
+ * can be submitted together through io_uring instead, which has measured
+ * slower than the threads for extracting archives, so it is opt-in.
+ *
+ * The parent directory must exist before open(). A failure is thrown from
+ * the next call, later chunks are dropped. Thread safe.
+ */
+class bulk_writer {
+private:
+  bulk_writer_impl* impl_;
+public:
+  // `threads` 0 for a default; `io_uring` true tries io_uring first and
+  // falls back to the threads when it is not available
+  bulk_writer(unsigned int threads = 0, bool io_uring = false);
+  // waits for what is queued, errors are ignored
+  ~bulk_writer();
+  bulk_writer(const bulk_writer&) = delete;
+  bulk_writer& operator=(const bulk_writer&) = delete;
+
+  // creates or truncates `path`, `mode` as open(2) takes it
+  int open(const std::string& path, int mode = 0666);
+  // appends to `file`, blocks while too much data is waiting; `data` is
+  // copied, the other two take the buffer over without a copy
+  void write(int file, const void* data, size_t len);
+  void write(int file, std::vector<unsigned char>&& data);
+  // `len` bytes of `buffer` from `offset`, which stays referenced until
+  // they are written, so it must not change before it is unique again
+  void write(int file, const std::shared_ptr<const std::vector<unsigned char> >& buffer, size_t offset, size_t len);
+  void close(int file);
+  void write_file(const std::string& path, std::vector<unsigned char>&& data, int mode = 0666);
+  // waits until everything queued so far is written and closed
+  void flush();
+  // "io_uring" or "threads"
+  const char* backend() const;
+};
+
 }
 
 }
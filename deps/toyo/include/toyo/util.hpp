@@ -4,6 +4,7 @@
 #include <string>
 #include <vector>
 #include "./util/sha256.h"
+#include "./util/sha512.h"
 #include "./util/md5.h"
 
 namespace toyo {
@@ -47,6 +48,39 @@ namespace util {
     ::sha256_hash* hash_;
   };
 
+  class sha512 {
+  public:
+    ~sha512();
+    sha512();
+    sha512(const sha512&);
+    sha512(sha512&&);
+    sha512& operator=(sha512&&);
+    sha512& operator=(const sha512&);
+
+    bool operator==(const sha512& other) const;
+    bool operator!=(const sha512& other) const;
+    bool operator<(const sha512& other) const;
+    bool operator>(const sha512& other) const;
+    bool operator<=(const sha512& other) const;
+    bool operator>=(const sha512& other) const;
+
+    void update(const uint8_t* data, int length);
+    void update(const std::string& data);
+    void update(const std::vector<uint8_t>& data);
+
+    std::string digest();
+
+    void swap(sha512& other);
+
+    const ::sha512_hash* data() const;
+
+    static std::string calc_str(const std::string& msg);
+
+    static std::string calc_file(const std::string& path);
+  private:
+    ::sha512_hash* hash_;
+  };
+
   class md5 {
    public:
     ~md5();
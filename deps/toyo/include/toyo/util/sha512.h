@@ -0,0 +1,27 @@
+#ifndef __TOYO_SHA512_H__
+#define __TOYO_SHA512_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct sha512_hash;
+typedef struct sha512_hash sha512_hash;
+
+sha512_hash* sha512_init();
+int sha512_update(sha512_hash*, const unsigned char*, int);
+int sha512_digest(sha512_hash*, char*);
+void sha512_free(sha512_hash*);
+int sha512_get_last_error();
+const char* sha512_get_error_message(int);
+void sha512_copy(sha512_hash*, sha512_hash*);
+int sha512_cmp(sha512_hash*, sha512_hash*, int*);
+
+int sha512(const char*, char*);
+int sha512_file(const char*, char*);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,745 @@
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <unordered_map>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+#include "toyo/fs.hpp"
+#include "toyo/charset.hpp"
+#include "cerror.hpp"
+
+#if defined(__linux__) && defined(TOYO_HAVE_IO_URING)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+// openat and close came with 5.6, as did this flag
+#if defined(__NR_io_uring_setup) && defined(IORING_FEAT_CUR_PERSONALITY)
+#define TOYO_BULK_WRITER_URING
+#endif
+#endif
+
+// submission queue entries, twice as many completions
+#define TOYO_BULK_WRITER_ENTRIES 128
+// queued operations that make a submission on their own
+#define TOYO_BULK_WRITER_BATCH 32
+#define TOYO_BULK_WRITER_MAX_OPEN 64
+// bytes queued but not written before write() blocks
+#define TOYO_BULK_WRITER_MAX_PENDING (64 * 1024 * 1024)
+#define TOYO_BULK_WRITER_MAX_THREADS 8
+
+namespace toyo {
+namespace fs {
+
+typedef struct bw_chunk {
+  std::shared_ptr<const std::vector<unsigned char> > buffer;   // holds data
+  const unsigned char* data;
+  std::size_t size;
+  std::size_t done;   // bytes of it already written
+  uint64_t offset;    // where data[0] goes in the file
+} bw_chunk;
+
+typedef struct bw_file {
+  std::string path;
+  int mode;
+  int fd;
+  uint64_t size;                  // bytes queued so far
+  std::deque<bw_chunk*> chunks;   // not handed to the backend yet
+  unsigned int writing;           // writes in flight
+  bool opened;                    // the open was handed to the backend
+  bool opening;                   // and has not completed
+  bool closing;                   // close() was called
+  bool close_sent;
+  bool queued;                    // in ready_
+  bool busy;                      // a thread works on it
+} bw_file;
+
+#ifdef TOYO_BULK_WRITER_URING
+enum bw_op_kind { bw_op_open, bw_op_write, bw_op_close };
+
+typedef struct bw_op {
+  bw_op_kind kind;
+  int file;
+  bw_chunk* chunk;
+} bw_op;
+#endif
+
+class bulk_writer_impl {
+ public:
+  bulk_writer_impl(unsigned int threads, bool io_uring);
+  ~bulk_writer_impl();
+
+  int open(const std::string& path, int mode);
+  void write(int file, const std::shared_ptr<const std::vector<unsigned char> >& buffer, std::size_t offset, std::size_t len);
+  void close(int file);
+  void flush(bool rethrow);
+  const char* backend() const;
+
+ private:
+  bw_file* find(int file);
+  void schedule(int id, bw_file* f);
+  void fail(int code, const std::string& message);
+  void check();
+  void drop(bw_file* f);
+  void erase(int id);
+  bool idle() const;
+
+  void run();
+  void process(std::unique_lock<std::mutex>& lock, int id, bw_file* f);
+
+#ifdef TOYO_BULK_WRITER_URING
+  bool setup();
+  void teardown();
+  io_uring_sqe* sqe(bw_op_kind kind, int id, bw_chunk* chunk);
+  void prepare();
+  bool prepare_file(int id, bw_file* f);
+  void reap();
+  void complete(bw_op* op, int res);
+  void pump(bool wait);
+#endif
+
+  std::mutex mutex_;
+  std::condition_variable ready_cv_;
+  std::condition_variable done_cv_;
+  std::unordered_map<int, bw_file*> files_;
+  std::deque<int> ready_;
+  int next_id_;
+  uint64_t pending_bytes_;
+  // opens, chunks and closes queued and not completed
+  std::size_t work_;
+  int error_code_;
+  std::string error_message_;
+  bool stopping_;
+  std::vector<std::thread> threads_;
+  bool uring_;
+
+#ifdef TOYO_BULK_WRITER_URING
+  int ring_fd_;
+  void* sq_ring_;
+  std::size_t sq_ring_size_;
+  void* cq_ring_;
+  std::size_t cq_ring_size_;
+  io_uring_sqe* sqes_;
+  std::size_t sqes_size_;
+  unsigned* sq_head_;
+  unsigned* sq_tail_;
+  unsigned* sq_mask_;
+  unsigned* sq_array_;
+  unsigned sq_entries_;
+  unsigned* cq_head_;
+  unsigned* cq_tail_;
+  unsigned* cq_mask_;
+  io_uring_cqe* cqes_;
+  unsigned cq_entries_;
+  // the next entry is filled at this tail, the kernel sees it once it is
+  // stored to sq_tail_
+  unsigned sq_local_tail_;
+  // published and not consumed by io_uring_enter() yet
+  unsigned to_submit_;
+  unsigned inflight_;
+  unsigned open_files_;
+  bool broken_;
+#endif
+};
+
+bulk_writer_impl::bulk_writer_impl(unsigned int threads, bool io_uring):
+  next_id_(0),
+  pending_bytes_(0),
+  work_(0),
+  error_code_(0),
+  error_message_(""),
+  stopping_(false),
+  uring_(false) {
+#ifdef TOYO_BULK_WRITER_URING
+  ring_fd_ = -1;
+  to_submit_ = 0;
+  inflight_ = 0;
+  open_files_ = 0;
+  broken_ = false;
+  if (io_uring && setup()) {
+    uring_ = true;
+    return;
+  }
+#else
+  (void)io_uring;
+#endif
+  if (threads == 0) {
+    threads = std::thread::hardware_concurrency();
+    if (threads < 2) threads = 2;
+    if (threads > TOYO_BULK_WRITER_MAX_THREADS) threads = TOYO_BULK_WRITER_MAX_THREADS;
+  }
+  for (unsigned int i = 0; i < threads; i++) {
+    threads_.push_back(std::thread(&bulk_writer_impl::run, this));
+  }
+}
+
+bulk_writer_impl::~bulk_writer_impl() {
+  flush(false);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  ready_cv_.notify_all();
+  for (std::size_t i = 0; i < threads_.size(); i++) {
+    threads_[i].join();
+  }
+  // files that were never closed
+  for (auto it = files_.begin(); it != files_.end(); ++it) {
+    drop(it->second);
+#ifdef _WIN32
+    if (it->second->fd >= 0) ::_close(it->second->fd);
+#else
+    if (it->second->fd >= 0) ::close(it->second->fd);
+#endif
+    delete it->second;
+  }
+#ifdef TOYO_BULK_WRITER_URING
+  if (uring_) teardown();
+#endif
+}
+
+const char* bulk_writer_impl::backend() const {
+  return uring_ ? "io_uring" : "threads";
+}
+
+bw_file* bulk_writer_impl::find(int file) {
+  auto it = files_.find(file);
+  if (it == files_.end() || it->second->closing) {
+    throw cerror(EBADF, "bulk_writer file " + std::to_string(file));
+  }
+  return it->second;
+}
+
+void bulk_writer_impl::schedule(int id, bw_file* f) {
+  if (f->queued) return;
+  f->queued = true;
+  ready_.push_back(id);
+  if (!uring_) ready_cv_.notify_one();
+}
+
+void bulk_writer_impl::fail(int code, const std::string& message) {
+  if (error_code_ != 0) return;
+  error_code_ = code != 0 ? code : EIO;
+  error_message_ = message;
+}
+
+void bulk_writer_impl::check() {
+  if (error_code_ != 0) throw cerror(error_code_, error_message_);
+}
+
+// after a failure the chunks are only counted off
+void bulk_writer_impl::drop(bw_file* f) {
+  for (std::size_t i = 0; i < f->chunks.size(); i++) {
+    pending_bytes_ -= f->chunks[i]->size - f->chunks[i]->done;
+    work_--;
+    delete f->chunks[i];
+  }
+  f->chunks.clear();
+}
+
+void bulk_writer_impl::erase(int id) {
+  auto it = files_.find(id);
+  delete it->second;
+  files_.erase(it);
+  done_cv_.notify_all();
+}
+
+bool bulk_writer_impl::idle() const {
+#ifdef TOYO_BULK_WRITER_URING
+  if (broken_) return true;
+#endif
+  return work_ == 0;
+}
+
+int bulk_writer_impl::open(const std::string& path, int mode) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  check();
+  int id = next_id_++;
+  bw_file* f = new bw_file();
+  f->path = path;
+  f->mode = mode;
+  f->fd = -1;
+  f->size = 0;
+  f->writing = 0;
+  f->opened = false;
+  f->opening = false;
+  f->closing = false;
+  f->close_sent = false;
+  f->queued = false;
+  f->busy = false;
+  files_[id] = f;
+  work_++;
+  schedule(id, f);
+#ifdef TOYO_BULK_WRITER_URING
+  if (uring_) pump(false);
+#endif
+  return id;
+}
+
+void bulk_writer_impl::write(int file, const std::shared_ptr<const std::vector<unsigned char> >& buffer, std::size_t offset, std::size_t len) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  check();
+  bw_file* f = find(file);
+  if (len == 0) return;
+  bw_chunk* c = new bw_chunk();
+  c->buffer = buffer;
+  c->data = buffer->data() + offset;
+  c->size = len;
+  c->done = 0;
+  c->offset = f->size;
+  f->size += c->size;
+  f->chunks.push_back(c);
+  pending_bytes_ += c->size;
+  work_++;
+  schedule(file, f);
+#ifdef TOYO_BULK_WRITER_URING
+  if (uring_) {
+    pump(false);
+    while (pending_bytes_ > TOYO_BULK_WRITER_MAX_PENDING && error_code_ == 0 && !broken_) pump(true);
+    check();
+    return;
+  }
+#endif
+  done_cv_.wait(lock, [this]() -> bool {
+    return pending_bytes_ <= TOYO_BULK_WRITER_MAX_PENDING || error_code_ != 0;
+  });
+  check();
+}
+
+void bulk_writer_impl::close(int file) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  bw_file* f = find(file);
+  f->closing = true;
+  work_++;
+  schedule(file, f);
+#ifdef TOYO_BULK_WRITER_URING
+  if (uring_) pump(false);
+#endif
+  check();
+}
+
+void bulk_writer_impl::flush(bool rethrow) {
+  std::unique_lock<std::mutex> lock(mutex_);
+#ifdef TOYO_BULK_WRITER_URING
+  if (uring_) {
+    while (!idle()) pump(true);
+    if (rethrow) check();
+    return;
+  }
+#endif
+  done_cv_.wait(lock, [this]() -> bool { return idle(); });
+  if (rethrow) check();
+}
+
+/*
+ * Threads: a file is worked on by one thread at a time, which takes all its
+ * chunks and writes them in order with plain syscalls.
+ */
+void bulk_writer_impl::run() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (;;) {
+    ready_cv_.wait(lock, [this]() -> bool { return stopping_ || !ready_.empty(); });
+    if (ready_.empty()) return;
+    int id = ready_.front();
+    ready_.pop_front();
+    auto it = files_.find(id);
+    if (it == files_.end()) continue;
+    bw_file* f = it->second;
+    f->queued = false;
+    // the thread that has it now queues it again when it is done
+    if (f->busy) continue;
+    process(lock, id, f);
+  }
+}
+
+void bulk_writer_impl::process(std::unique_lock<std::mutex>& lock, int id, bw_file* f) {
+  f->busy = true;
+  bool open = !f->opened;
+  bool close = f->closing;
+  f->opened = true;
+  std::deque<bw_chunk*> chunks;
+  chunks.swap(f->chunks);
+  bool ok = error_code_ == 0;
+  lock.unlock();
+
+  int code = 0;
+  std::string message;
+  uint64_t written = 0;
+  if (open && ok) {
+#ifdef _WIN32
+    f->fd = ::_wopen(toyo::charset::a2w(f->path).c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, f->mode & 0600);
+#else
+    f->fd = ::open(f->path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, f->mode);
+#endif
+    if (f->fd < 0) {
+      code = errno;
+      message = "open \"" + f->path + "\"";
+    }
+  }
+  for (std::size_t i = 0; i < chunks.size(); i++) {
+    bw_chunk* c = chunks[i];
+    while (ok && code == 0 && f->fd >= 0 && c->done < c->size) {
+#ifdef _WIN32
+      int n = ::_write(f->fd, c->data + c->done, (unsigned int)(c->size - c->done));
+#else
+      ssize_t n = ::write(f->fd, c->data + c->done, c->size - c->done);
+      if (n < 0 && errno == EINTR) continue;
+#endif
+      if (n <= 0) {
+        code = n < 0 ? errno : EIO;
+        message = "write \"" + f->path + "\"";
+        break;
+      }
+      c->done += n;
+    }
+    written += c->size;
+    delete c;
+  }
+  if (close && f->fd >= 0) {
+#ifdef _WIN32
+    int r = ::_close(f->fd);
+#else
+    int r = ::close(f->fd);
+#endif
+    if (r != 0 && code == 0) {
+      code = errno;
+      message = "close \"" + f->path + "\"";
+    }
+    f->fd = -1;
+  }
+
+  lock.lock();
+  if (code != 0) fail(code, message);
+  work_ -= (open ? 1 : 0) + chunks.size() + (close ? 1 : 0);
+  pending_bytes_ -= written;
+  f->busy = false;
+  if (close) {
+    erase(id);
+    return;
+  }
+  if (!f->chunks.empty() || f->closing) schedule(id, f);
+  done_cv_.notify_all();
+}
+
+#ifdef TOYO_BULK_WRITER_URING
+
+/*
+ * io_uring: everything runs on the threads that call in, under the mutex.
+ * Ready files get their open, or their writes followed by a linked close,
+ * put in the submission queue, which goes to the kernel in batches; the
+ * completions are read from the shared ring without a syscall.
+ */
+bool bulk_writer_impl::setup() {
+  io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  int fd = (int)syscall(__NR_io_uring_setup, TOYO_BULK_WRITER_ENTRIES, &p);
+  if (fd < 0) return false;
+
+  // kernels before 5.6 take the ring but not openat and close
+  std::size_t probe_size = sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op);
+  io_uring_probe* probe = (io_uring_probe*)calloc(1, probe_size);
+  bool supported = probe != nullptr &&
+    syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256) == 0 &&
+    probe->last_op >= IORING_OP_WRITE &&
+    (probe->ops[IORING_OP_OPENAT].flags & IO_URING_OP_SUPPORTED) &&
+    (probe->ops[IORING_OP_CLOSE].flags & IO_URING_OP_SUPPORTED) &&
+    (probe->ops[IORING_OP_WRITE].flags & IO_URING_OP_SUPPORTED);
+  free(probe);
+  if (!supported) {
+    ::close(fd);
+    return false;
+  }
+
+  sq_ring_size_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  cq_ring_size_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+  bool single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+  if (single) {
+    if (cq_ring_size_ > sq_ring_size_) sq_ring_size_ = cq_ring_size_;
+    cq_ring_size_ = sq_ring_size_;
+  }
+  sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  cq_ring_ = single ? sq_ring_ : MAP_FAILED;
+  if (!single && sq_ring_ != MAP_FAILED) {
+    cq_ring_ = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+  }
+  sqes_size_ = p.sq_entries * sizeof(io_uring_sqe);
+  sqes_ = (io_uring_sqe*)MAP_FAILED;
+  if (cq_ring_ != MAP_FAILED) {
+    sqes_ = (io_uring_sqe*)mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+  }
+  if (sqes_ == (io_uring_sqe*)MAP_FAILED) {
+    if (cq_ring_ != MAP_FAILED && !single) munmap(cq_ring_, cq_ring_size_);
+    if (sq_ring_ != MAP_FAILED) munmap(sq_ring_, sq_ring_size_);
+    ::close(fd);
+    return false;
+  }
+
+  char* sq = (char*)sq_ring_;
+  char* cq = (char*)cq_ring_;
+  sq_head_ = (unsigned*)(sq + p.sq_off.head);
+  sq_tail_ = (unsigned*)(sq + p.sq_off.tail);
+  sq_mask_ = (unsigned*)(sq + p.sq_off.ring_mask);
+  sq_array_ = (unsigned*)(sq + p.sq_off.array);
+  sq_entries_ = p.sq_entries;
+  cq_head_ = (unsigned*)(cq + p.cq_off.head);
+  cq_tail_ = (unsigned*)(cq + p.cq_off.tail);
+  cq_mask_ = (unsigned*)(cq + p.cq_off.ring_mask);
+  cqes_ = (io_uring_cqe*)(cq + p.cq_off.cqes);
+  cq_entries_ = p.cq_entries;
+  sq_local_tail_ = *sq_tail_;
+  ring_fd_ = fd;
+  return true;
+}
+
+void bulk_writer_impl::teardown() {
+  munmap(sqes_, sqes_size_);
+  if (cq_ring_ != sq_ring_) munmap(cq_ring_, cq_ring_size_);
+  munmap(sq_ring_, sq_ring_size_);
+  ::close(ring_fd_);
+  ring_fd_ = -1;
+}
+
+io_uring_sqe* bulk_writer_impl::sqe(bw_op_kind kind, int id, bw_chunk* chunk) {
+  unsigned index = sq_local_tail_++ & *sq_mask_;
+  io_uring_sqe* e = &sqes_[index];
+  memset(e, 0, sizeof(io_uring_sqe));
+  bw_op* op = new bw_op();
+  op->kind = kind;
+  op->file = id;
+  op->chunk = chunk;
+  e->user_data = (uint64_t)(uintptr_t)op;
+  sq_array_[index] = index;
+  to_submit_++;
+  inflight_++;
+  return e;
+}
+
+// room for `n` more entries, counting the completions they will post
+#define TOYO_BULK_WRITER_ROOM(n) \
+  (to_submit_ + (n) <= sq_entries_ && inflight_ + (n) <= cq_entries_)
+
+void bulk_writer_impl::prepare() {
+  std::size_t n = ready_.size();
+  // a file that has to wait goes to the back, each one is looked at once
+  for (std::size_t i = 0; i < n && TOYO_BULK_WRITER_ROOM(1); i++) {
+    int id = ready_.front();
+    ready_.pop_front();
+    // closed while it was queued
+    auto it = files_.find(id);
+    if (it == files_.end()) continue;
+    bw_file* f = it->second;
+    f->queued = false;
+    if (!prepare_file(id, f)) schedule(id, f);
+  }
+}
+
+// false when `f` has to wait for room
+bool bulk_writer_impl::prepare_file(int id, bw_file* f) {
+  if (!f->opened) {
+    if (error_code_ != 0) {
+      f->opened = true;
+      work_--;
+    } else {
+      // nothing else in flight could free a descriptor
+      if (open_files_ >= TOYO_BULK_WRITER_MAX_OPEN && inflight_ > 0) return false;
+      io_uring_sqe* e = sqe(bw_op_open, id, nullptr);
+      e->opcode = IORING_OP_OPENAT;
+      e->fd = AT_FDCWD;
+      e->addr = (uint64_t)(uintptr_t)f->path.c_str();
+      e->len = (uint32_t)f->mode;
+      e->open_flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+      f->opened = true;
+      f->opening = true;
+      open_files_++;
+      return true;
+    }
+  }
+  if (f->opening || f->close_sent) return true;
+
+  if (error_code_ != 0 || f->fd < 0) drop(f);
+  if (f->fd < 0) {
+    // the open failed, there is nothing to write or close
+    if (f->closing) {
+      work_--;
+      erase(id);
+    }
+    return true;
+  }
+  // the writes are linked to a close after them, which also has to wait
+  // for any writes submitted before
+  bool close = f->closing && f->writing == 0;
+  std::size_t n = f->chunks.size() + (close ? 1 : 0);
+  std::size_t room = sq_entries_ - to_submit_;
+  if (cq_entries_ - inflight_ < room) room = cq_entries_ - inflight_;
+  if (n > room) {
+    close = false;
+    n = room;
+  }
+  for (std::size_t i = 0; i < n && !f->chunks.empty(); i++) {
+    bw_chunk* c = f->chunks.front();
+    f->chunks.pop_front();
+    io_uring_sqe* e = sqe(bw_op_write, id, c);
+    e->opcode = IORING_OP_WRITE;
+    e->fd = f->fd;
+    e->addr = (uint64_t)(uintptr_t)(c->data + c->done);
+    e->len = (uint32_t)(c->size - c->done);
+    e->off = c->offset + c->done;
+    if (close) e->flags |= IOSQE_IO_LINK;
+    f->writing++;
+  }
+  if (close) {
+    io_uring_sqe* e = sqe(bw_op_close, id, nullptr);
+    e->opcode = IORING_OP_CLOSE;
+    e->fd = f->fd;
+    f->close_sent = true;
+  }
+  return f->chunks.empty();
+}
+
+void bulk_writer_impl::reap() {
+  unsigned head = *cq_head_;
+  unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+  while (head != tail) {
+    io_uring_cqe* cqe = &cqes_[head & *cq_mask_];
+    bw_op* op = (bw_op*)(uintptr_t)cqe->user_data;
+    int res = cqe->res;
+    head++;
+    __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    inflight_--;
+    complete(op, res);
+    delete op;
+  }
+}
+
+void bulk_writer_impl::complete(bw_op* op, int res) {
+  bw_file* f = files_[op->file];
+  switch (op->kind) {
+    case bw_op_open:
+      f->opening = false;
+      work_--;
+      if (res < 0) {
+        open_files_--;
+        fail(-res, "open \"" + f->path + "\"");
+      } else {
+        f->fd = res;
+      }
+      schedule(op->file, f);
+      break;
+    case bw_op_write: {
+      bw_chunk* c = op->chunk;
+      f->writing--;
+      if (res == -ECANCELED || res == -EINTR || res == -EAGAIN) {
+        // a link before it broke, or it has to be tried again
+        f->chunks.push_front(c);
+      } else if (res <= 0) {
+        fail(res < 0 ? -res : EIO, "write \"" + f->path + "\"");
+        pending_bytes_ -= c->size - c->done;
+        work_--;
+        delete c;
+      } else {
+        c->done += res;
+        pending_bytes_ -= res;
+        if (c->done < c->size) {
+          f->chunks.push_front(c);
+        } else {
+          work_--;
+          delete c;
+        }
+      }
+      if (!f->chunks.empty() || f->closing) schedule(op->file, f);
+      break;
+    }
+    case bw_op_close:
+      f->close_sent = false;
+      if (res == -ECANCELED) {
+        schedule(op->file, f);
+        break;
+      }
+      if (res < 0) fail(-res, "close \"" + f->path + "\"");
+      open_files_--;
+      work_--;
+      erase(op->file);
+      break;
+  }
+}
+
+void bulk_writer_impl::pump(bool wait) {
+  reap();
+  prepare();
+  if (to_submit_ == 0 && !(wait && inflight_ > 0)) return;
+  if (!wait && to_submit_ < TOYO_BULK_WRITER_BATCH) return;
+  unsigned min_complete = wait && inflight_ > 0 ? 1 : 0;
+  // publishes what sqe() filled since the last call; entries the kernel
+  // did not take last time are already there and stay in to_submit_
+  __atomic_store_n(sq_tail_, sq_local_tail_, __ATOMIC_RELEASE);
+  int r = (int)syscall(__NR_io_uring_enter, ring_fd_, to_submit_, min_complete, min_complete ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+  if (r >= 0) {
+    to_submit_ -= (unsigned)r;
+  } else if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+    fail(errno, "io_uring_enter");
+    broken_ = true;
+  }
+  reap();
+}
+
+#endif
+
+bulk_writer::bulk_writer(unsigned int threads, bool io_uring): impl_(new bulk_writer_impl(threads, io_uring)) {}
+
+bulk_writer::~bulk_writer() {
+  delete impl_;
+}
+
+int bulk_writer::open(const std::string& path, int mode) {
+  return impl_->open(path, mode);
+}
+
+void bulk_writer::write(int file, const void* data, size_t len) {
+  const unsigned char* p = (const unsigned char*)data;
+  impl_->write(file, std::make_shared<const std::vector<unsigned char> >(p, p + len), 0, len);
+}
+
+void bulk_writer::write(int file, std::vector<unsigned char>&& data) {
+  std::size_t len = data.size();
+  impl_->write(file, std::make_shared<const std::vector<unsigned char> >(std::move(data)), 0, len);
+}
+
+void bulk_writer::write(int file, const std::shared_ptr<const std::vector<unsigned char> >& buffer, size_t offset, size_t len) {
+  impl_->write(file, buffer, offset, len);
+}
+
+void bulk_writer::close(int file) {
+  impl_->close(file);
+}
+
+void bulk_writer::write_file(const std::string& path, std::vector<unsigned char>&& data, int mode) {
+  int file = impl_->open(path, mode);
+  write(file, std::move(data));
+  impl_->close(file);
+}
+
+void bulk_writer::flush() {
+  impl_->flush(true);
+}
+
+const char* bulk_writer::backend() const {
+  return impl_->backend();
+}
+
+}
+}
@@ -0,0 +1,303 @@
+#include <cstddef>
+#include <exception>
+#include <vector>
+#include <deque>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <condition_variable>
+
+#include "toyo/executor.hpp"
+
+// how long a waiting worker sleeps between looking for work to help with
+#define TOYO_EXECUTOR_HELP_WAIT_MS 1
+
+namespace toyo {
+namespace executor {
+
+typedef struct executor_worker {
+  std::mutex mutex;
+  std::deque<std::function<void ()>> tasks;
+  std::thread thread;
+} executor_worker;
+
+struct task_group_state {
+  std::atomic<std::size_t> pending;
+  std::atomic<bool> cancelled;
+  std::mutex mutex;
+  std::condition_variable done;
+  std::exception_ptr error;
+};
+
+class pool_impl;
+
+// the pool the calling thread works for and its deque there
+static thread_local pool_impl* current_pool = nullptr;
+static thread_local std::size_t current_index = 0;
+
+class pool_impl {
+private:
+  std::vector<executor_worker*> workers_;
+  std::size_t max_queued_;
+  // tasks in the deques; counted before the push and after the pop, so
+  // that it is never below the real number
+  std::atomic<std::size_t> queued_;
+  std::atomic<std::size_t> next_;
+  // sleepers on wake_ and room_, the pushing and popping side only take
+  // mutex_ when there is one
+  std::atomic<unsigned int> idle_;
+  std::atomic<unsigned int> blocked_;
+  bool stop_;
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable room_;
+
+  static void invoke(std::function<void ()>& task) {
+    try {
+      task();
+    } catch (...) {}
+  }
+
+  bool pop(std::size_t index, std::function<void ()>& task) {
+    executor_worker* w = workers_[index];
+    std::lock_guard<std::mutex> lock(w->mutex);
+    if (w->tasks.empty()) return false;
+    task = std::move(w->tasks.back());
+    w->tasks.pop_back();
+    return true;
+  }
+
+  bool steal(std::size_t index, std::function<void ()>& task) {
+    executor_worker* w = workers_[index];
+    std::lock_guard<std::mutex> lock(w->mutex);
+    if (w->tasks.empty()) return false;
+    task = std::move(w->tasks.front());
+    w->tasks.pop_front();
+    return true;
+  }
+
+  void taken() {
+    queued_--;
+    if (blocked_ > 0) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      room_.notify_one();
+    }
+  }
+
+  void run(std::size_t index) {
+    current_pool = this;
+    current_index = index;
+    std::function<void ()> task;
+    while (true) {
+      if (take(index, task)) {
+        invoke(task);
+        task = nullptr;
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(mutex_);
+      idle_++;
+      wake_.wait(lock, [this]() -> bool { return stop_ || queued_ > 0; });
+      idle_--;
+      if (stop_ && queued_ == 0) return;
+    }
+  }
+
+public:
+  pool_impl(unsigned int threads, std::size_t max_queued):
+    max_queued_(max_queued), queued_(0), next_(0), idle_(0), blocked_(0), stop_(false) {
+    if (threads == 0) threads = std::thread::hardware_concurrency();
+    if (threads == 0) threads = 1;
+    for (unsigned int i = 0; i < threads; i++) {
+      workers_.push_back(new executor_worker());
+    }
+    for (unsigned int i = 0; i < threads; i++) {
+      workers_[i]->thread = std::thread(&pool_impl::run, this, (std::size_t)i);
+    }
+  }
+
+  ~pool_impl() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    wake_.notify_all();
+    // the others may still steal from a deque until they are all gone
+    for (std::size_t i = 0; i < workers_.size(); i++) {
+      workers_[i]->thread.join();
+    }
+    for (std::size_t i = 0; i < workers_.size(); i++) {
+      delete workers_[i];
+    }
+  }
+
+  bool in_worker() const {
+    return current_pool == this;
+  }
+
+  unsigned int size() const {
+    return (unsigned int)workers_.size();
+  }
+
+  // the own deque from the back, then the others from the front
+  bool take(std::size_t index, std::function<void ()>& task) {
+    std::size_t n = workers_.size();
+    bool found = in_worker() && pop(index, task);
+    for (std::size_t i = in_worker() ? 1 : 0; !found && i < n; i++) {
+      found = steal((index + i) % n, task);
+    }
+    if (found) taken();
+    return found;
+  }
+
+  bool run_one() {
+    std::function<void ()> task;
+    std::size_t index = in_worker() ? current_index : next_.load() % workers_.size();
+    if (!take(index, task)) return false;
+    invoke(task);
+    return true;
+  }
+
+  void post(std::function<void ()>&& fn) {
+    if (max_queued_ > 0 && queued_ >= max_queued_) {
+      if (in_worker()) {
+        invoke(fn);
+        return;
+      }
+      std::unique_lock<std::mutex> lock(mutex_);
+      blocked_++;
+      room_.wait(lock, [this]() -> bool { return queued_ < max_queued_; });
+      blocked_--;
+    }
+
+    std::size_t index = in_worker() ? current_index : next_++ % workers_.size();
+    executor_worker* w = workers_[index];
+    {
+      std::lock_guard<std::mutex> lock(w->mutex);
+      queued_++;
+      w->tasks.push_back(std::move(fn));
+    }
+    if (idle_ > 0) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      wake_.notify_one();
+    }
+  }
+};
+
+pool::pool(unsigned int threads, std::size_t max_queued): impl_(new pool_impl(threads, max_queued)) {}
+
+pool::~pool() {
+  delete impl_;
+}
+
+pool& pool::shared() {
+  static pool p;
+  return p;
+}
+
+void pool::post(std::function<void ()> fn) {
+  impl_->post(std::move(fn));
+}
+
+bool pool::run_one() {
+  return impl_->run_one();
+}
+
+bool pool::in_worker() const {
+  return impl_->in_worker();
+}
+
+unsigned int pool::size() const {
+  return impl_->size();
+}
+
+task_group::task_group(pool& p): pool_(&p), state_(std::make_shared<task_group_state>()) {
+  state_->pending = 0;
+  state_->cancelled = false;
+}
+
+task_group::~task_group() {
+  try {
+    wait();
+  } catch (...) {}
+}
+
+void task_group::run(std::function<void ()> fn) {
+  std::shared_ptr<task_group_state> state = state_;
+  state->pending++;
+  pool_->post([state, fn]() {
+    if (!state->cancelled) {
+      try {
+        fn();
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        if (!state->error) state->error = std::current_exception();
+        state->cancelled = true;
+      }
+    }
+    if (--state->pending == 0) {
+      std::lock_guard<std::mutex> lock(state->mutex);
+      state->done.notify_all();
+    }
+  });
+}
+
+void task_group::wait() {
+  while (!wait_for(1000)) {}
+}
+
+bool task_group::wait_for(unsigned int ms) {
+  task_group_state* state = state_.get();
+  auto done = [state]() -> bool { return state->pending == 0; };
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(ms);
+  if (pool_->in_worker()) {
+    // the tasks waited for may sit in this worker's own deque
+    while (!done() && std::chrono::steady_clock::now() < deadline) {
+      if (pool_->run_one()) continue;
+      std::unique_lock<std::mutex> lock(state->mutex);
+      state->done.wait_for(lock, std::chrono::milliseconds(TOYO_EXECUTOR_HELP_WAIT_MS), done);
+    }
+  } else {
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->done.wait_until(lock, deadline, done);
+  }
+  if (!done()) return false;
+
+  std::exception_ptr error;
+  {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    error = state->error;
+    state->error = nullptr;
+  }
+  if (error) std::rethrow_exception(error);
+  return true;
+}
+
+void task_group::cancel() {
+  state_->cancelled = true;
+}
+
+bool task_group::cancelled() const {
+  return state_->cancelled;
+}
+
+void parallel_for(std::size_t begin, std::size_t end, const std::function<void (std::size_t)>& fn,
+  std::size_t grain, pool& p) {
+  if (end <= begin) return;
+  std::size_t n = end - begin;
+  if (grain == 0) grain = n / (p.size() * 4);
+  if (grain == 0) grain = 1;
+  task_group group(p);
+  for (std::size_t first = begin; first < end; first += grain) {
+    std::size_t last = (end - first > grain) ? first + grain : end;
+    group.run([&fn, &group, first, last]() {
+      for (std::size_t i = first; i < last && !group.cancelled(); i++) {
+        fn(i);
+      }
+    });
+  }
+  group.wait();
+}
+
+}
+}
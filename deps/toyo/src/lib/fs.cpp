@@ -6,10 +6,18 @@
 #include <io.h>
 #include <wchar.h>
 #else
-
+#include <fcntl.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#include <linux/fs.h>
+#endif
 #endif
 
 #include <utility>
+#include <atomic>
+#include <mutex>
 #include <exception>
 #include <stdexcept>
 #include <cerrno>
@@ -20,9 +28,12 @@
 #include "toyo/fs.hpp"
 #include "toyo/path.hpp"
 #include "toyo/charset.hpp"
+#include "toyo/executor.hpp"
 #include "cerror.hpp"
 
-#define TOYO_FS_BUFFER_SIZE 128 * 1024
+#define TOYO_FS_COPY_BUFFER_SIZE (1024 * 1024)
+// files copied by one task of copy(), most of them are small
+#define TOYO_FS_COPY_GRAIN 16
 
 #ifndef _WIN32
 #define TOYO__PATH_MAX 8192
@@ -1201,7 +1212,111 @@ void rename(const std::string& s, const std::string& d) {
   }
 }
 
-void remove(const std::string& p) {
+#ifndef _WIN32
+// a directory being emptied; it goes from its parent once its own scan and
+// every subtree handed out of it are done
+typedef struct remove_dir {
+  int fd;
+  std::string path;
+  std::string name;
+  struct remove_dir* parent;
+  std::atomic<size_t> pending;
+} remove_dir;
+
+typedef struct remove_job {
+  executor::task_group* group;  // nullptr for no workers
+  std::atomic<size_t> tasks;    // subtrees handed out and not done yet
+  size_t max_tasks;
+  std::mutex mutex;
+  int error;                    // the first one
+  std::string error_path;
+} remove_job;
+
+static void remove_failed(remove_job* job, int err, const std::string& path) {
+  std::lock_guard<std::mutex> lock(job->mutex);
+  if (job->error == 0) {
+    job->error = err;
+    job->error_path = path;
+  }
+}
+
+static void remove_finish(remove_job* job, remove_dir* dir) {
+  while (dir != nullptr && --dir->pending == 0) {
+    ::close(dir->fd);
+    remove_dir* parent = dir->parent;
+    // the root is the caller's
+    if (parent == nullptr) return;
+    if (::unlinkat(parent->fd, dir->name.c_str(), AT_REMOVEDIR) != 0 && errno != ENOENT) {
+      remove_failed(job, errno, dir->path);
+    }
+    delete dir;
+    dir = parent;
+  }
+}
+
+static void remove_scan(remove_job* job, remove_dir* dir) {
+  int fd = ::dup(dir->fd);
+  DIR* d = fd == -1 ? nullptr : ::fdopendir(fd);
+  if (d == nullptr) {
+    remove_failed(job, errno, dir->path);
+    if (fd != -1) ::close(fd);
+    remove_finish(job, dir);
+    return;
+  }
+  // readdir() may skip or repeat entries of a directory that changes under
+  // it, so the names are all read before anything is unlinked
+  std::vector<std::pair<std::string, unsigned char> > entries;
+  struct ::dirent* entry;
+  while ((entry = ::readdir(d)) != nullptr) {
+    const char* name = entry->d_name;
+    if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+    entries.push_back(std::make_pair(std::string(name), entry->d_type));
+  }
+  ::closedir(d);
+
+  for (size_t i = 0; i < entries.size(); i++) {
+    const char* name = entries[i].first.c_str();
+    bool is_dir = entries[i].second == DT_DIR;
+    if (entries[i].second == DT_UNKNOWN) {
+      struct stat st;
+      is_dir = ::fstatat(dir->fd, name, &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(st.st_mode);
+    }
+    if (!is_dir) {
+      if (::unlinkat(dir->fd, name, 0) != 0 && errno != ENOENT) {
+        remove_failed(job, errno, dir->path + "/" + name);
+      }
+      continue;
+    }
+
+    int child_fd = ::openat(dir->fd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (child_fd == -1) {
+      if (errno != ENOENT) remove_failed(job, errno, dir->path + "/" + name);
+      continue;
+    }
+    remove_dir* child = new remove_dir();
+    child->fd = child_fd;
+    child->path = dir->path + "/" + name;
+    child->name = name;
+    child->parent = dir;
+    child->pending = 1;
+    dir->pending++;
+    if (job->group != nullptr && job->tasks < job->max_tasks) {
+      job->tasks++;
+      job->group->run([job, child]() {
+        remove_scan(job, child);
+        job->tasks--;
+      });
+    } else {
+      remove_scan(job, child);
+    }
+  }
+  remove_finish(job, dir);
+}
+#endif
+
+void remove(const std::string& p, bool parallel) {
+#ifdef _WIN32
+  (void)parallel;
   if (!fs::exists(p)) {
     return;
   }
@@ -1209,18 +1324,55 @@ void remove(const std::string& p) {
   fs::stats stat = fs::lstat(p);
   if (stat.is_directory()) {
     std::vector<std::string> items = fs::readdir(p);
-    if (items.size() != 0) {
-      for (size_t i = 0; i < items.size(); i++) {
-        const std::string& item = items[i];
-        fs::remove(path::join(p, item));
-      }
-      fs::rmdir(p);
-    } else {
-      fs::rmdir(p);
+    for (size_t i = 0; i < items.size(); i++) {
+      fs::remove(path::join(p, items[i]));
     }
+    fs::rmdir(p);
   } else {
     fs::unlink(p);
   }
+#else
+  std::string path = path::normalize(p);
+  struct stat st;
+  if (::lstat(path.c_str(), &st) != 0) {
+    if (errno == ENOENT || errno == ENOTDIR) return;
+    throw cerror(errno, "remove \"" + p + "\"");
+  }
+  if (!S_ISDIR(st.st_mode)) {
+    fs::unlink(p);
+    return;
+  }
+
+  remove_dir root;
+  root.fd = ::open(path.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+  if (root.fd == -1) {
+    throw cerror(errno, "remove \"" + p + "\"");
+  }
+  root.path = p;
+  root.parent = nullptr;
+  root.pending = 1;
+
+  remove_job job;
+  job.group = nullptr;
+  job.tasks = 0;
+  job.error = 0;
+  if (parallel) {
+    executor::pool& pool = executor::pool::shared();
+    executor::task_group group(pool);
+    job.group = &group;
+    job.max_tasks = pool.size() * 4;
+    remove_scan(&job, &root);
+    group.wait();
+  } else {
+    job.max_tasks = 0;
+    remove_scan(&job, &root);
+  }
+
+  if (job.error != 0) {
+    throw cerror(job.error, "remove \"" + job.error_path + "\"");
+  }
+  fs::rmdir(p);
+#endif
 }
 
 void symlink(const std::string& o, const std::string& n) {
@@ -1389,56 +1541,255 @@ std::string realpath(const std::string& p) {
 #endif
 }
 
-void copy_file(const std::string& s, const std::string& d, bool fail_if_exists) {
+#ifdef __linux__
+// `in` to `out` from their current offsets on, `left` bytes at most;
+// false with errno when the kernel can not copy between the two
+static bool copy_in_kernel(int in, int out, off_t* left, copy_method method) {
+  while (*left > 0) {
+    size_t count = (size_t)(*left < 0x40000000 ? *left : 0x40000000);
+    ssize_t n;
+    if (method == copy_method_sendfile) {
+      n = ::sendfile(out, in, nullptr, count);
+    } else {
+#ifdef SYS_copy_file_range
+      n = syscall(SYS_copy_file_range, in, nullptr, out, nullptr, count, 0u);
+#else
+      errno = ENOSYS;
+      n = -1;
+#endif
+    }
+    if (n == -1 && errno == EINTR) continue;
+    if (n == -1) return false;
+    // the file got shorter
+    if (n == 0) break;
+    *left -= n;
+  }
+  return true;
+}
+
+// whether the kernel failed only because it can not copy between the two
+static bool copy_unsupported(int err) {
+  return err == EXDEV || err == ENOSYS || err == EINVAL || err == EOPNOTSUPP || err == EBADF;
+}
+#endif
+
+copy_method copy_file(const std::string& s, const std::string& d, bool fail_if_exists) {
   std::string source = path::resolve(s);
   std::string dest = path::resolve(d);
   std::string errmessage = "copy \"" + s + "\" -> \"" + d + "\"";
 
   if (source == dest) {
-    return;
+    return copy_method_none;
   }
 
 #ifdef _WIN32
   if (!CopyFileW(toyo::charset::a2w(source).c_str(), toyo::charset::a2w(dest).c_str(), fail_if_exists)) {
     throw std::runtime_error((get_win32_last_error_message() + " copy \"" + s + "\" -> \"" + d + "\"").c_str());
   }
+  return copy_method_system;
 #else
 
-  if (fail_if_exists && fs::exists(dest)) {
-    throw cerror(EEXIST, errmessage);
+  int in = ::open(source.c_str(), O_RDONLY | O_CLOEXEC);
+  if (in == -1) {
+    throw cerror(errno, errmessage);
+  }
+  struct stat st;
+  if (::fstat(in, &st) != 0) {
+    int err = errno;
+    ::close(in);
+    throw cerror(err, errmessage);
+  }
+  // not truncated before it is known to be another file
+  int out = ::open(dest.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC | (fail_if_exists ? O_EXCL : 0), st.st_mode & 07777);
+  if (out == -1) {
+    int err = errno;
+    ::close(in);
+    throw cerror(err, errmessage);
+  }
+  struct stat dst;
+  if (::fstat(out, &dst) == 0 && dst.st_dev == st.st_dev && dst.st_ino == st.st_ino) {
+    ::close(in);
+    ::close(out);
+    return copy_method_none;
+  }
+
+  copy_method method = copy_method_buffer;
+  bool ok = ::ftruncate(out, 0) == 0;
+  off_t left = st.st_size;
+#ifdef __linux__
+#ifdef FICLONE
+  if (ok && left > 0 && ::ioctl(out, FICLONE, in) == 0) {
+    method = copy_method_clone;
+    left = 0;
   }
+#endif
+  copy_method kernel[] = { copy_method_copy_file_range, copy_method_sendfile };
+  for (size_t i = 0; ok && left > 0 && i < sizeof(kernel) / sizeof(kernel[0]); i++) {
+    off_t before = left;
+    if (copy_in_kernel(in, out, &left, kernel[i])) {
+      method = kernel[i];
+      left = 0;
+    } else if (left != before || !copy_unsupported(errno)) {
+      ok = false;
+    }
+  }
+#endif
 
-  int mode;
-  try {
-    mode = fs::stat(source).mode;
-  } catch (const std::exception&) {
-    throw cerror(errno, errmessage);
+  // files like those in /proc tell a size of 0, only read() gets their data
+  if (ok && (left > 0 || st.st_size == 0)) {
+    std::vector<char> buf(TOYO_FS_COPY_BUFFER_SIZE);
+    ssize_t n;
+    while (ok && (n = ::read(in, buf.data(), buf.size())) != 0) {
+      if (n == -1) {
+        ok = errno == EINTR;
+        continue;
+      }
+      for (ssize_t done = 0; ok && done < n; ) {
+        ssize_t w = ::write(out, buf.data() + done, (size_t)(n - done));
+        if (w == -1) {
+          ok = errno == EINTR;
+        } else {
+          done += w;
+        }
+      }
+    }
   }
 
-  FILE* sf = ::fopen(source.c_str(), "rb+");
-  if (!sf) {
-    throw cerror(errno, errmessage);
+  // the umask applied to a new file, an old one kept its mode
+  if (ok) ok = ::fchmod(out, st.st_mode & 07777) == 0;
+  int err = errno;
+  ::close(in);
+  if (::close(out) != 0 && ok) {
+    ok = false;
+    err = errno;
   }
-  FILE* df = ::fopen(dest.c_str(), "wb+");
-  if (!df) {
-    ::fclose(sf);
-    throw cerror(errno, errmessage);
+  if (!ok) {
+    throw cerror(err, errmessage);
   }
-  unsigned char buf[TOYO_FS_BUFFER_SIZE];
-  size_t read;
-  while ((read = ::fread(buf, sizeof(unsigned char), TOYO_FS_BUFFER_SIZE, sf)) > 0) {
-    ::fwrite(buf, sizeof(unsigned char), read, df);
-    ::fflush(df);
+  return method;
+#endif
+}
+
+#ifndef _WIN32
+typedef struct copy_entry {
+  std::string path;     // relative to the roots, "" for the roots themselves
+  struct stat st;
+  std::string target;   // of a symbolic link
+} copy_entry;
+
+typedef struct copy_tree {
+  std::vector<copy_entry> dirs;   // parents before children
+  std::vector<copy_entry> files;
+  std::vector<copy_entry> links;
+} copy_tree;
+
+static std::string copy_join(const std::string& root, const std::string& rel) {
+  return rel.empty() ? root : root + "/" + rel;
+}
+
+// `fd` is the directory `rel`; sockets, fifos and devices are left out
+static void copy_walk(int fd, const std::string& rel, const std::string& source, copy_tree* tree) {
+  int dup_fd = ::dup(fd);
+  DIR* d = dup_fd == -1 ? nullptr : ::fdopendir(dup_fd);
+  if (d == nullptr) {
+    int err = errno;
+    if (dup_fd != -1) ::close(dup_fd);
+    throw cerror(err, "scandir \"" + copy_join(source, rel) + "\"");
+  }
+  struct ::dirent* item;
+  while ((item = ::readdir(d)) != nullptr) {
+    const char* name = item->d_name;
+    if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+    copy_entry entry;
+    entry.path = rel.empty() ? std::string(name) : rel + "/" + name;
+    if (::fstatat(fd, name, &entry.st, AT_SYMLINK_NOFOLLOW) != 0) {
+      int err = errno;
+      ::closedir(d);
+      throw cerror(err, "lstat \"" + copy_join(source, entry.path) + "\"");
+    }
+
+    if (S_ISREG(entry.st.st_mode)) {
+      tree->files.push_back(entry);
+    } else if (S_ISLNK(entry.st.st_mode)) {
+      std::vector<char> buf(TOYO__PATH_MAX);
+      ssize_t n = ::readlinkat(fd, name, buf.data(), buf.size());
+      if (n == -1) {
+        int err = errno;
+        ::closedir(d);
+        throw cerror(err, "readlink \"" + copy_join(source, entry.path) + "\"");
+      }
+      entry.target.assign(buf.data(), (size_t)n);
+      tree->links.push_back(entry);
+    } else if (S_ISDIR(entry.st.st_mode)) {
+      int child = ::openat(fd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+      if (child == -1) {
+        int err = errno;
+        ::closedir(d);
+        throw cerror(err, "opendir \"" + copy_join(source, entry.path) + "\"");
+      }
+      tree->dirs.push_back(entry);
+      try {
+        copy_walk(child, entry.path, source, tree);
+      } catch (const std::exception&) {
+        ::close(child);
+        ::closedir(d);
+        throw;
+      }
+      ::close(child);
+    }
   }
-  ::fclose(sf);
-  ::fclose(df);
+  ::closedir(d);
+}
 
-  fs::chmod(dest, mode);
+static void copy_times(const std::string& path, const struct stat& st, int flags) {
+  struct timespec times[2];
+#ifdef __APPLE__
+  times[0] = st.st_atimespec;
+  times[1] = st.st_mtimespec;
+#else
+  times[0] = st.st_atim;
+  times[1] = st.st_mtim;
 #endif
+  if (::utimensat(AT_FDCWD, path.c_str(), times, flags) != 0) {
+    throw cerror(errno, "utimes \"" + path + "\"");
+  }
+}
 
+static void copy_one(const copy_entry& entry, const std::string& source, const std::string& dest, const copy_options& options) {
+  std::string from = copy_join(source, entry.path);
+  std::string to = copy_join(dest, entry.path);
+  if (S_ISLNK(entry.st.st_mode)) {
+    if (::symlink(entry.target.c_str(), to.c_str()) != 0) {
+      if (errno != EEXIST || options.fail_if_exists || ::unlink(to.c_str()) != 0 ||
+        ::symlink(entry.target.c_str(), to.c_str()) != 0) {
+        throw cerror(errno, "symlink \"" + entry.target + "\" -> \"" + to + "\"");
+      }
+    }
+    copy_times(to, entry.st, AT_SYMLINK_NOFOLLOW);
+    return;
+  }
+  if (options.hardlink) {
+    if (::link(from.c_str(), to.c_str()) == 0) return;
+    if (errno == EEXIST && !options.fail_if_exists && ::unlink(to.c_str()) == 0 && ::link(from.c_str(), to.c_str()) == 0) return;
+    // across file systems the data is copied after all
+    if (errno != EXDEV && errno != EPERM && errno != EMLINK) {
+      throw cerror(errno, "link \"" + from + "\" -> \"" + to + "\"");
+    }
+  }
+  fs::copy_file(from, to, options.fail_if_exists);
+  copy_times(to, entry.st, 0);
 }
+#endif
+
+copy_options::copy_options(): fail_if_exists(false), hardlink(false), parallel(false) {}
 
 void copy(const std::string& s, const std::string& d, bool fail_if_exists) {
+  copy_options options;
+  options.fail_if_exists = fail_if_exists;
+  fs::copy(s, d, options);
+}
+
+void copy(const std::string& s, const std::string& d, const copy_options& options) {
   std::string source = path::resolve(s);
   std::string dest = path::resolve(d);
 
@@ -1446,6 +1797,7 @@ void copy(const std::string& s, const std::string& d, bool fail_if_exists) {
     return;
   }
 
+#ifdef _WIN32
   stats stat = fs::lstat(source);
 
   if (stat.is_directory()) {
@@ -1455,11 +1807,81 @@ void copy(const std::string& s, const std::string& d, bool fail_if_exists) {
     fs::mkdirs(dest);
     std::vector<std::string> items = fs::readdir(source);
     for (size_t i = 0; i < items.size(); i++) {
-      fs::copy(path::join(source, items[i]), path::join(dest, items[i]), fail_if_exists);
+      fs::copy(path::join(source, items[i]), path::join(dest, items[i]), options);
+    }
+  } else if (!options.hardlink ||
+    !CreateHardLinkW(toyo::charset::a2w(dest).c_str(), toyo::charset::a2w(source).c_str(), nullptr)) {
+    fs::copy_file(source, dest, options.fail_if_exists);
+  }
+#else
+  copy_entry root;
+  if (::lstat(source.c_str(), &root.st) != 0) {
+    throw cerror(errno, "copy \"" + s + "\" -> \"" + d + "\"");
+  }
+  if (!S_ISDIR(root.st.st_mode)) {
+    if (S_ISLNK(root.st.st_mode)) {
+      std::vector<char> buf(TOYO__PATH_MAX);
+      ssize_t n = ::readlink(source.c_str(), buf.data(), buf.size());
+      if (n == -1) {
+        throw cerror(errno, "readlink \"" + s + "\"");
+      }
+      root.target.assign(buf.data(), (size_t)n);
     }
+    copy_one(root, source, dest, options);
+    return;
+  }
+
+  if (path::relative(s, d).find("..") != 0) {
+    throw std::runtime_error(std::string("Cannot copy a directory into itself. copy \"") + s + "\" -> \"" + d + "\"");
+  }
+
+  copy_tree tree;
+  int fd = ::open(source.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd == -1) {
+    throw cerror(errno, "opendir \"" + s + "\"");
+  }
+  try {
+    copy_walk(fd, "", source, &tree);
+  } catch (const std::exception&) {
+    ::close(fd);
+    throw;
+  }
+  ::close(fd);
+
+  // the skeleton first, writable until the files are in
+  fs::mkdirs(dest);
+  for (size_t i = 0; i < tree.dirs.size(); i++) {
+    std::string to = copy_join(dest, tree.dirs[i].path);
+    if (::mkdir(to.c_str(), 0700) != 0 && errno != EEXIST) {
+      throw cerror(errno, "mkdir \"" + to + "\"");
+    }
+  }
+
+  if (options.parallel) {
+    executor::parallel_for(0, tree.files.size(), [&tree, &source, &dest, &options](size_t i) {
+      copy_one(tree.files[i], source, dest, options);
+    }, TOYO_FS_COPY_GRAIN);
   } else {
-    fs::copy_file(source, dest, fail_if_exists);
+    for (size_t i = 0; i < tree.files.size(); i++) {
+      copy_one(tree.files[i], source, dest, options);
+    }
+  }
+  for (size_t i = 0; i < tree.links.size(); i++) {
+    copy_one(tree.links[i], source, dest, options);
+  }
+
+  // children before parents, so that no later change touches a time
+  root.path = "";
+  tree.dirs.insert(tree.dirs.begin(), root);
+  for (size_t i = tree.dirs.size(); i > 0; i--) {
+    const copy_entry& entry = tree.dirs[i - 1];
+    std::string to = copy_join(dest, entry.path);
+    if (::chmod(to.c_str(), entry.st.st_mode & 07777) != 0) {
+      throw cerror(errno, "chmod \"" + to + "\"");
+    }
+    copy_times(to, entry.st, 0);
   }
+#endif
 }
 
 void move(const std::string& s, const std::string& d) {
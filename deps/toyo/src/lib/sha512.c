@@ -0,0 +1,352 @@
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <Windows.h>
+#endif
+
+#include <stdint.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "toyo/util/sha512.h"
+
+#define RIGHTROTATE64(x, c) (((x) << (64 - (c))) | ((x) >> (c)))
+
+#define SHA512_FINAL 129
+
+#ifndef SHA512_BUFFER_SIZE
+#define SHA512_BUFFER_SIZE (128 * 1024)
+#endif
+
+struct sha512_hash {
+  uint64_t data[8];
+  uint64_t len;
+  uint32_t pos;
+  uint8_t buf[128];
+};
+
+static int error_code = 0;
+
+static const uint64_t k[80] = {
+  0x428a2f98d728ae22ULL, 0x7137449123ef65cdULL, 0xb5c0fbcfec4d3b2fULL, 0xe9b5dba58189dbbcULL,
+  0x3956c25bf348b538ULL, 0x59f111f1b605d019ULL, 0x923f82a4af194f9bULL, 0xab1c5ed5da6d8118ULL,
+  0xd807aa98a3030242ULL, 0x12835b0145706fbeULL, 0x243185be4ee4b28cULL, 0x550c7dc3d5ffb4e2ULL,
+  0x72be5d74f27b896fULL, 0x80deb1fe3b1696b1ULL, 0x9bdc06a725c71235ULL, 0xc19bf174cf692694ULL,
+  0xe49b69c19ef14ad2ULL, 0xefbe4786384f25e3ULL, 0x0fc19dc68b8cd5b5ULL, 0x240ca1cc77ac9c65ULL,
+  0x2de92c6f592b0275ULL, 0x4a7484aa6ea6e483ULL, 0x5cb0a9dcbd41fbd4ULL, 0x76f988da831153b5ULL,
+  0x983e5152ee66dfabULL, 0xa831c66d2db43210ULL, 0xb00327c898fb213fULL, 0xbf597fc7beef0ee4ULL,
+  0xc6e00bf33da88fc2ULL, 0xd5a79147930aa725ULL, 0x06ca6351e003826fULL, 0x142929670a0e6e70ULL,
+  0x27b70a8546d22ffcULL, 0x2e1b21385c26c926ULL, 0x4d2c6dfc5ac42aedULL, 0x53380d139d95b3dfULL,
+  0x650a73548baf63deULL, 0x766a0abb3c77b2a8ULL, 0x81c2c92e47edaee6ULL, 0x92722c851482353bULL,
+  0xa2bfe8a14cf10364ULL, 0xa81a664bbc423001ULL, 0xc24b8b70d0f89791ULL, 0xc76c51a30654be30ULL,
+  0xd192e819d6ef5218ULL, 0xd69906245565a910ULL, 0xf40e35855771202aULL, 0x106aa07032bbd1b8ULL,
+  0x19a4c116b8d2d0c8ULL, 0x1e376c085141ab53ULL, 0x2748774cdf8eeb99ULL, 0x34b0bcb5e19b48a8ULL,
+  0x391c0cb3c5c95a63ULL, 0x4ed8aa4ae3418acbULL, 0x5b9cca4f7763e373ULL, 0x682e6ff3d6b2b8a3ULL,
+  0x748f82ee5defb2fcULL, 0x78a5636f43172f60ULL, 0x84c87814a1f0ab72ULL, 0x8cc702081a6439ecULL,
+  0x90befffa23631e28ULL, 0xa4506cebde82bde9ULL, 0xbef9a3f7b2c67915ULL, 0xc67178f2e372532bULL,
+  0xca273eceea26619cULL, 0xd186b8c721c0c207ULL, 0xeada7dd6cde0eb1eULL, 0xf57d4f7fee6ed178ULL,
+  0x06f067aa72176fbaULL, 0x0a637dc5a2c898a6ULL, 0x113f9804bef90daeULL, 0x1b710b35131c471bULL,
+  0x28db77f523047d84ULL, 0x32caab7b40c72493ULL, 0x3c9ebe0a15c9bebcULL, 0x431d67c49c100d4cULL,
+  0x4cc5d4becb3e42b6ULL, 0x597f299cfc657e2aULL, 0x5fcb6fab3ad6faecULL, 0x6c44198c4a475817ULL
+};
+
+static void to_bytes64(uint64_t val, uint8_t *bytes) {
+  bytes[7] = (uint8_t) val;
+  bytes[6] = (uint8_t) (val >> 8);
+  bytes[5] = (uint8_t) (val >> 16);
+  bytes[4] = (uint8_t) (val >> 24);
+  bytes[3] = (uint8_t) (val >> 32);
+  bytes[2] = (uint8_t) (val >> 40);
+  bytes[1] = (uint8_t) (val >> 48);
+  bytes[0] = (uint8_t) (val >> 56);
+}
+
+static uint64_t to_uint64(const uint8_t *bytes) {
+  return (uint64_t) bytes[7]
+    | ((uint64_t) bytes[6] << 8)
+    | ((uint64_t) bytes[5] << 16)
+    | ((uint64_t) bytes[4] << 24)
+    | ((uint64_t) bytes[3] << 32)
+    | ((uint64_t) bytes[2] << 40)
+    | ((uint64_t) bytes[1] << 48)
+    | ((uint64_t) bytes[0] << 56);
+}
+
+sha512_hash* sha512_init() {
+  sha512_hash* hash = (sha512_hash*)malloc(sizeof(sha512_hash));
+  if (hash == NULL) {
+    error_code = 1;
+    return NULL;
+  }
+
+  hash->data[0] = 0x6a09e667f3bcc908ULL;
+  hash->data[1] = 0xbb67ae8584caa73bULL;
+  hash->data[2] = 0x3c6ef372fe94f82bULL;
+  hash->data[3] = 0xa54ff53a5f1d36f1ULL;
+  hash->data[4] = 0x510e527fade682d1ULL;
+  hash->data[5] = 0x9b05688c2b3e6c1fULL;
+  hash->data[6] = 0x1f83d9abfb41bd6bULL;
+  hash->data[7] = 0x5be0cd19137e2179ULL;
+
+  hash->len = 0;
+  hash->pos = 0;
+  memset(hash->buf, 0, 128);
+
+  return hash;
+}
+
+void sha512_free(sha512_hash* hash) {
+  if (hash) {
+    free(hash);
+  }
+}
+
+static void sha512__update(sha512_hash* hash) {
+  uint64_t w[80];
+  uint64_t a, b, c, d, e, f, g, h;
+  uint64_t s0, s1, maj, t2, ch, t1;
+  uint32_t i;
+
+  for (i = 0; i < 16; i++)
+    w[i] = to_uint64(hash->buf + i * 8);
+
+  for (; i < 80; i++) {
+    s0 = RIGHTROTATE64(w[i-15], 1) ^ RIGHTROTATE64(w[i-15], 8) ^ (w[i-15] >> 7);
+    s1 = RIGHTROTATE64(w[i-2], 19) ^ RIGHTROTATE64(w[i-2], 61) ^ (w[i-2] >> 6);
+    w[i] = w[i-16] + s0 + w[i-7] + s1;
+  }
+
+  a = hash->data[0];
+  b = hash->data[1];
+  c = hash->data[2];
+  d = hash->data[3];
+  e = hash->data[4];
+  f = hash->data[5];
+  g = hash->data[6];
+  h = hash->data[7];
+
+  for (i = 0; i < 80; i++) {
+    s0 = RIGHTROTATE64(a, 28) ^ RIGHTROTATE64(a, 34) ^ RIGHTROTATE64(a, 39);
+    maj = (a & b) ^ (a & c) ^ (b & c);
+    t2 = s0 + maj;
+    s1 = RIGHTROTATE64(e, 14) ^ RIGHTROTATE64(e, 18) ^ RIGHTROTATE64(e, 41);
+    ch = (e & f) ^ ((~e) & g);
+    t1 = h + s1 + ch + k[i] + w[i];
+    h = g;
+    g = f;
+    f = e;
+    e = d + t1;
+    d = c;
+    c = b;
+    b = a;
+    a = t1 + t2;
+  }
+
+  hash->data[0] += a;
+  hash->data[1] += b;
+  hash->data[2] += c;
+  hash->data[3] += d;
+  hash->data[4] += e;
+  hash->data[5] += f;
+  hash->data[6] += g;
+  hash->data[7] += h;
+}
+
+int sha512_update(sha512_hash* hash, const unsigned char* data, int length) {
+  int l, left, need, resolve;
+
+  if (hash == NULL || data == NULL || length < 0) {
+    error_code = 2;
+    return error_code;
+  }
+
+  if (hash->pos == SHA512_FINAL) {
+    error_code = 3;
+    return error_code;
+  }
+
+  l = 0;
+  do {
+    need = 128 - hash->pos;
+    left = length - l;
+    resolve = need > left ? left : need;
+    memcpy(hash->buf + hash->pos, data + l, resolve);
+    hash->len += resolve;
+    l += resolve;
+    if (resolve == need) {
+      sha512__update(hash);
+      hash->pos = 0;
+    } else {
+      hash->pos += resolve;
+    }
+  } while (l < length);
+
+  return 0;
+}
+
+int sha512_digest(sha512_hash* hash, char* out) {
+  uint8_t hex[64];
+  uint32_t i;
+  if (hash == NULL || out == NULL) {
+    error_code = 2;
+    return error_code;
+  }
+  if (hash->pos == SHA512_FINAL) {
+    error_code = 3;
+    return error_code;
+  }
+
+  hash->buf[hash->pos] = 0x80;
+  if (hash->pos < 127) {
+    memset(hash->buf + hash->pos + 1, 0, 128 - hash->pos - 1);
+  }
+
+  if (hash->pos >= 112) {
+    sha512__update(hash);
+    memset(hash->buf, 0, 128);
+  }
+
+  /* the length is 128-bit, the upper half is 0 below 2^61 bytes */
+  to_bytes64(hash->len >> 61, hash->buf + 112);
+  to_bytes64(hash->len << 3, hash->buf + 120);
+  sha512__update(hash);
+  hash->pos = SHA512_FINAL;
+
+  for (i = 0; i < 8; i++) {
+    to_bytes64(hash->data[i], hex + i * 8);
+  }
+
+  for (i = 0; i < 64; i++) {
+    sprintf(out + (i * 2), "%02x", hex[i]);
+  }
+  out[128] = '\0';
+  return 0;
+}
+
+int sha512_get_last_error() {
+  return error_code;
+}
+
+const char* sha512_get_error_message(int code) {
+  static char message[256];
+  memset(message, 0, 256);
+  switch (code) {
+    case 0: strcpy(message, "Success."); break;
+    case 1: strcpy(message, "Out of memory."); break;
+    case 2: strcpy(message, "Invalid argument."); break;
+    case 3: strcpy(message, "Digest already called."); break;
+    case 4: strcpy(message, "Convert failed."); break;
+    case 5: strcpy(message, "Open failed."); break;
+    default: strcpy(message, "Unknown error."); break;
+  }
+  return message;
+}
+
+void sha512_copy(sha512_hash* dst, sha512_hash* src) {
+  if (dst == NULL || src == NULL) {
+    return;
+  }
+
+  memcpy(dst, src, sizeof(sha512_hash));
+}
+
+int sha512_cmp(sha512_hash* l, sha512_hash* r, int* result) {
+  int i;
+  if (l == NULL || r == NULL) {
+    error_code = 2;
+    return error_code;
+  }
+
+  if (result == NULL) {
+    return 0;
+  }
+
+  for (i = 0; i < 8; i++) {
+    if (l->data[i] == r->data[i]) {
+      continue;
+    }
+    *result = l->data[i] < r->data[i] ? -1 : 1;
+    return 0;
+  }
+
+  *result = 0;
+  return 0;
+}
+
+int sha512(const char* message, char* out) {
+  int r;
+  sha512_hash* hash;
+  hash = sha512_init();
+  if (hash == NULL) {
+    return error_code;
+  }
+
+  r = sha512_update(hash, (const unsigned char*)message, (int)strlen(message));
+  if (r != 0) goto clean;
+  r = sha512_digest(hash, out);
+  if (r != 0) goto clean;
+
+clean:
+  sha512_free(hash);
+  return r;
+}
+
+int sha512_file(const char* filepath, char* out) {
+  int r;
+  FILE* f;
+  uint8_t* buf;
+  sha512_hash* hash;
+  size_t read_size;
+#ifdef _WIN32
+  unsigned short* wpath;
+  r = MultiByteToWideChar(CP_UTF8, 0, filepath, -1, NULL, 0);
+  if (r == 0) {
+    error_code = 4;
+    return error_code;
+  }
+  wpath = (unsigned short*)malloc(r * sizeof(unsigned short));
+  if (wpath == NULL) {
+    error_code = 1;
+    return error_code;
+  }
+  r = MultiByteToWideChar(CP_UTF8, 0, filepath, -1, wpath, r);
+  if (r == 0) {
+    free(wpath);
+    error_code = 4;
+    return error_code;
+  }
+  f = _wfopen(wpath, L"rb");
+  free(wpath);
+#else
+  f = fopen(filepath, "rb");
+#endif
+  if (f == NULL) {
+    error_code = 5;
+    return error_code;
+  }
+
+  hash = sha512_init();
+  if (hash == NULL) {
+    fclose(f);
+    return error_code;
+  }
+
+  buf = (uint8_t*)malloc(SHA512_BUFFER_SIZE);
+  if (buf == NULL) {
+    fclose(f);
+    sha512_free(hash);
+    error_code = 1;
+    return error_code;
+  }
+
+  while ((read_size = fread(buf, 1, SHA512_BUFFER_SIZE, f)) != 0) {
+    sha512_update(hash, buf, (int)read_size);
+  }
+  free(buf);
+  fclose(f);
+  r = sha512_digest(hash, out);
+  sha512_free(hash);
+  return r;
+}
@@ -0,0 +1,169 @@
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <Windows.h>
+#endif
+
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include "toyo/util.hpp"
+
+namespace toyo {
+
+namespace util {
+  sha512::~sha512() {
+    if (hash_) {
+      sha512_free(hash_);
+      hash_ = nullptr;
+    }
+  }
+
+  sha512::sha512(): hash_(sha512_init()) {
+    if (hash_ == nullptr) {
+      throw std::runtime_error(sha512_get_error_message(sha512_get_last_error()));
+    }
+  }
+
+  sha512::sha512(const sha512& other): sha512() { sha512_copy(hash_, other.hash_); }
+  sha512::sha512(sha512&& other) {
+    hash_ = other.hash_;
+    other.hash_ = nullptr;
+  }
+  sha512& sha512::operator=(sha512&& other) {
+    hash_ = other.hash_;
+    other.hash_ = nullptr;
+    return *this;
+  }
+
+  sha512& sha512::operator=(const sha512& other) {
+    if (this == &other) {
+      return *this;
+    }
+    sha512_copy(hash_, other.hash_);
+    return *this;
+  }
+
+  bool sha512::operator==(const sha512& other) const {
+    if (this == &other) {
+      return true;
+    }
+    int result = 0;
+    int r = sha512_cmp(hash_, other.hash_, &result);
+    if (r != 0) {
+      throw std::runtime_error(sha512_get_error_message(r));
+    }
+    return result == 0;
+  }
+
+  bool sha512::operator!=(const sha512& other) const {
+    return !(*this == other);
+  }
+
+  bool sha512::operator<(const sha512& other) const {
+    if (this == &other) {
+      return false;
+    }
+    int result = 0;
+    int r = sha512_cmp(hash_, other.hash_, &result);
+    if (r != 0) {
+      throw std::runtime_error(sha512_get_error_message(r));
+    }
+    return result == -1;
+  }
+
+  bool sha512::operator>(const sha512& other) const {
+    if (this == &other) {
+      return false;
+    }
+    int result = 0;
+    int r = sha512_cmp(hash_, other.hash_, &result);
+    if (r != 0) {
+      throw std::runtime_error(sha512_get_error_message(r));
+    }
+    return result == 1;
+  }
+
+  bool sha512::operator<=(const sha512& other) const {
+    if (this == &other) {
+      return true;
+    }
+    int result = 0;
+    int r = sha512_cmp(hash_, other.hash_, &result);
+    if (r != 0) {
+      throw std::runtime_error(sha512_get_error_message(r));
+    }
+    return result == -1 || result == 0;
+  }
+
+  bool sha512::operator>=(const sha512& other) const {
+    if (this == &other) {
+      return true;
+    }
+    int result = 0;
+    int r = sha512_cmp(hash_, other.hash_, &result);
+    if (r != 0) {
+      throw std::runtime_error(sha512_get_error_message(r));
+    }
+    return result == 1 || result == 0;
+  }
+
+  void sha512::update(const uint8_t* data, int length) {
+    int r = sha512_update(hash_, data, length);
+    if (r != 0) {
+      throw std::runtime_error(sha512_get_error_message(r));
+    }
+  }
+
+  void sha512::update(const std::string& data) {
+    int r = sha512_update(hash_, (const unsigned char*)data.c_str(), (int)data.length());
+    if (r != 0) {
+      throw std::runtime_error(sha512_get_error_message(r));
+    }
+  }
+
+  void sha512::update(const std::vector<uint8_t>& data) {
+    int r = sha512_update(hash_, (const unsigned char*)data.data(), (int)data.size());
+    if (r != 0) {
+      throw std::runtime_error(sha512_get_error_message(r));
+    }
+  }
+
+  std::string sha512::digest() {
+    char hex[129];
+    int r = sha512_digest(hash_, hex);
+    if (r != 0) {
+      throw std::runtime_error(sha512_get_error_message(r));
+    }
+    return hex;
+  }
+
+  void sha512::swap(sha512& other) {
+    sha512_hash* tmp = other.hash_;
+    other.hash_ = hash_;
+    hash_ = tmp;
+  }
+
+  const sha512_hash* sha512::data() const { return hash_; }
+
+  std::string sha512::calc_str(const std::string& msg) {
+    char res[129];
+    int r = ::sha512(msg.c_str(), &res[0]);
+    if (r != 0) {
+      throw std::runtime_error(sha512_get_error_message(r));
+    }
+    return res;
+  }
+
+  std::string sha512::calc_file(const std::string& path) {
+    char res[129];
+    int r = sha512_file(path.c_str(), res);
+    if (r != 0) {
+      throw std::runtime_error(sha512_get_error_message(r));
+    }
+    return res;
+  }
+}
+
+}
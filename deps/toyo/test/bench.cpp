@@ -0,0 +1,102 @@
+// Microbenchmarks of toyo::executor, built as toyobench next to the tests.
+//
+//   toyobench [threads]
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include "toyo/executor.hpp"
+
+using namespace toyo;
+
+static double measure(const std::function<void ()>& fn) {
+  auto start = std::chrono::steady_clock::now();
+  fn();
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static uint64_t work(uint64_t n) {
+  uint64_t x = n;
+  for (int i = 0; i < 1000; i++) x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+  return x;
+}
+
+static uint64_t fib(executor::pool& p, int n) {
+  if (n < 20) {
+    return n < 2 ? n : fib(p, n - 1) + fib(p, n - 2);
+  }
+  uint64_t a = 0;
+  uint64_t b = 0;
+  executor::task_group group(p);
+  group.run([&p, &a, n]() { a = fib(p, n - 1); });
+  b = fib(p, n - 2);
+  group.wait();
+  return a + b;
+}
+
+int main(int argc, char** argv) {
+  unsigned int threads = argc > 1 ? (unsigned int)atoi(argv[1]) : 0;
+  executor::pool p(threads);
+  const int tasks = 100000;
+  std::atomic<uint64_t> sink(0);
+  printf("threads: %u\n", p.size());
+
+  double t = measure([&]() {
+    std::vector<std::thread> spawned;
+    for (int i = 0; i < tasks / 100; i++) {
+      spawned.push_back(std::thread([&sink, i]() { sink += work(i); }));
+    }
+    for (std::size_t i = 0; i < spawned.size(); i++) spawned[i].join();
+  });
+  printf("thread per task    %10.1f ns/task\n", t * 1e6 / (tasks / 100));
+
+  t = measure([&]() {
+    executor::task_group group(p);
+    for (int i = 0; i < tasks; i++) {
+      group.run([&sink, i]() { sink += work(i); });
+    }
+    group.wait();
+  });
+  printf("task_group::run    %10.1f ns/task\n", t * 1e6 / tasks);
+
+  t = measure([&]() {
+    std::vector<std::future<uint64_t>> results;
+    for (int i = 0; i < tasks; i++) {
+      results.push_back(p.submit([i]() -> uint64_t { return work(i); }));
+    }
+    for (std::size_t i = 0; i < results.size(); i++) sink += results[i].get();
+  });
+  printf("submit + future    %10.1f ns/task\n", t * 1e6 / tasks);
+
+  {
+    executor::pool bounded(threads, 64);
+    t = measure([&]() {
+      executor::task_group group(bounded);
+      for (int i = 0; i < tasks; i++) {
+        group.run([&sink, i]() { sink += work(i); });
+      }
+      group.wait();
+    });
+    printf("bounded (64)       %10.1f ns/task\n", t * 1e6 / tasks);
+  }
+
+  std::vector<uint64_t> values(tasks * 10);
+  double serial = measure([&]() {
+    for (std::size_t i = 0; i < values.size(); i++) values[i] = work(i);
+  });
+  t = measure([&]() {
+    executor::parallel_for(0, values.size(), [&values](std::size_t i) { values[i] = work(i); }, 0, p);
+  });
+  printf("parallel_for       %10.1f ms (serial %.1f ms, %.2fx)\n", t, serial, serial / t);
+
+  uint64_t r = 0;
+  t = measure([&]() { r = fib(p, 32); });
+  printf("fork-join fib(32)  %10.1f ms (%llu)\n", t, (unsigned long long)r);
+
+  return sink == 0 ? 1 : 0;
+}
@@ -1,6 +1,7 @@
 #include <iostream>
 #include <cstring>
 #include <string>
+#include <atomic>
 #include "toyo/charset.hpp"
 #include "toyo/process.hpp"
 #include "toyo/path.hpp"
@@ -8,6 +9,11 @@
 #include "toyo/console.hpp"
 #include "oid/oid.hpp"
 #include "toyo/events.hpp"
+#include "toyo/executor.hpp"
+
+#ifndef _WIN32
+#include <utime.h>
+#endif
 
 #include "cmocha/cmocha.h"
 
@@ -321,6 +327,32 @@ static int test_copy() {
     expect(!fs::exists(s))
   }
 
+  // the method taken, the mode, a longer destination that is overwritten
+  try {
+    std::string data(300000, 'c');
+    fs::mkdirs("./tmp/copyfile");
+    fs::write_file("./tmp/copyfile/src.txt", data);
+    fs::write_file("./tmp/copyfile/dst.txt", std::string(400000, 'd'));
+#ifdef _WIN32
+    expect(fs::copy_file("./tmp/copyfile/src.txt", "./tmp/copyfile/dst.txt") == fs::copy_method_system)
+#else
+    fs::chmod("./tmp/copyfile/src.txt", 0751);
+    fs::copy_method method = fs::copy_file("./tmp/copyfile/src.txt", "./tmp/copyfile/dst.txt");
+    expect(method != fs::copy_method_none && method != fs::copy_method_system)
+    expect((fs::stat("./tmp/copyfile/dst.txt").mode & 07777) == 0751)
+#endif
+    expect(fs::read_file_to_string("./tmp/copyfile/dst.txt") == data)
+    expect(fs::copy_file("./tmp/copyfile/src.txt", "./tmp/copyfile/../copyfile/src.txt") == fs::copy_method_none)
+    expect(fs::read_file_to_string("./tmp/copyfile/src.txt") == data)
+    fs::write_file("./tmp/copyfile/empty.txt", "");
+    fs::copy_file("./tmp/copyfile/empty.txt", "./tmp/copyfile/dst.txt");
+    expect(fs::read_file_to_string("./tmp/copyfile/dst.txt") == "")
+  } catch (const std::exception& e) {
+    console::error(e.what());
+    return -1;
+  }
+  fs::remove("./tmp");
+
   try {
     fs::copy("notexist", "any");
     return -1;
@@ -353,6 +385,51 @@ static int test_copy() {
     console::error(e.what());
   }
 
+  // links, modes and times, hard links and the workers
+  try {
+    fs::mkdirs("./tmp/tree/bin");
+    for (int i = 0; i < 100; i++) {
+      fs::write_file("./tmp/tree/" + std::to_string(i) + ".txt", std::to_string(i));
+    }
+    fs::write_file("./tmp/tree/bin/run", "#!/bin/sh\n");
+#ifndef _WIN32
+    fs::chmod("./tmp/tree/bin/run", 0755);
+    fs::chmod("./tmp/tree/bin", 0750);
+    fs::symlink("../1.txt", "./tmp/tree/bin/one");
+    struct utimbuf times;
+    times.actime = 1000000000;
+    times.modtime = 1000000000;
+    expect(::utime("./tmp/tree/1.txt", &times) == 0)
+    expect(::utime("./tmp/tree/bin", &times) == 0)
+#endif
+
+    fs::copy_options options;
+    options.parallel = true;
+    fs::copy("./tmp/tree", "./tmp/tree_copy", options);
+    expect(fs::read_file_to_string("./tmp/tree_copy/99.txt") == "99")
+#ifndef _WIN32
+    expect((fs::stat("./tmp/tree_copy/bin/run").mode & 07777) == 0755)
+    expect((fs::stat("./tmp/tree_copy/bin").mode & 07777) == 0750)
+    expect(fs::stat("./tmp/tree_copy/1.txt").mtime == 1000000000)
+    expect(fs::stat("./tmp/tree_copy/bin").mtime == 1000000000)
+    // still a relative link, so it points into the copy
+    expect(fs::lstat("./tmp/tree_copy/bin/one").is_symbolic_link())
+    expect(fs::realpath("./tmp/tree_copy/bin/one") == fs::realpath("./tmp/tree_copy/1.txt"))
+#endif
+
+    options.parallel = false;
+    options.hardlink = true;
+    fs::copy("./tmp/tree", "./tmp/tree_link", options);
+    expect(fs::read_file_to_string("./tmp/tree_link/42.txt") == "42")
+#ifndef _WIN32
+    expect(fs::stat("./tmp/tree/42.txt").nlink == 2)
+    expect(fs::lstat("./tmp/tree_link/bin/one").is_symbolic_link())
+#endif
+  } catch (const std::exception& e) {
+    console::error(e.what());
+    return -1;
+  }
+
   fs::remove("./tmp");
 
   return 0;
@@ -392,6 +469,143 @@ static int test_read_write() {
   return 0;
 }
 
+static int test_bulk_writer() {
+  fs::mkdirs("./tmp/bulk");
+  try {
+    fs::bulk_writer writer;
+    console::log(writer.backend());
+    for (int i = 0; i < 100; i++) {
+      int file = writer.open("./tmp/bulk/" + std::to_string(i) + ".txt");
+      writer.write(file, "bulk ", 5);
+      writer.write(file, std::to_string(i).c_str(), std::to_string(i).length());
+      writer.close(file);
+    }
+    writer.write_file("./tmp/bulk/file.txt", std::vector<unsigned char>(3, 'x'));
+    writer.flush();
+  } catch (const std::exception& e) {
+    console::error(e.what());
+    return -1;
+  }
+  expect(fs::read_file_to_string("./tmp/bulk/42.txt") == "bulk 42")
+  expect(fs::read_file_to_string("./tmp/bulk/file.txt") == "xxx")
+
+  // io_uring where the kernel has it, more entries than fit in the ring
+  try {
+    fs::bulk_writer writer(0, true);
+    console::log(writer.backend());
+    for (int i = 0; i < 1000; i++) {
+      int file = writer.open("./tmp/bulk/u" + std::to_string(i) + ".txt");
+      for (int j = 0; j < 4; j++) {
+        writer.write(file, std::to_string(j).c_str(), 1);
+      }
+      writer.close(file);
+    }
+    writer.flush();
+  } catch (const std::exception& e) {
+    console::error(e.what());
+    return -1;
+  }
+  expect(fs::read_file_to_string("./tmp/bulk/u0.txt") == "0123")
+  expect(fs::read_file_to_string("./tmp/bulk/u999.txt") == "0123")
+
+  try {
+    fs::bulk_writer writer(0, false);
+    expect(std::string(writer.backend()) == "threads")
+    for (int i = 0; i < 100; i++) {
+      writer.write_file("./tmp/bulk/t" + std::to_string(i) + ".txt", std::vector<unsigned char>(i, 't'));
+    }
+    writer.flush();
+  } catch (const std::exception& e) {
+    console::error(e.what());
+    return -1;
+  }
+  expect(fs::read_file_to_string("./tmp/bulk/t0.txt") == "")
+  expect(fs::read_file_to_string("./tmp/bulk/t99.txt") == std::string(99, 't'))
+
+  try {
+    fs::bulk_writer writer;
+    int file = writer.open("./tmp/notexist/a.txt");
+    writer.close(file);
+    writer.flush();
+    return -1;
+  } catch (const std::exception& e) {
+    console::error(e.what());
+  }
+
+  fs::remove("./tmp");
+  return 0;
+}
+
+static int make_remove_tree(const std::string& root) {
+  // more names than one getdents() call returns, and a deep chain
+  fs::mkdirs(root + "/wide");
+  for (int i = 0; i < 2000; i++) {
+    fs::write_file(root + "/wide/" + std::to_string(i) + ".txt", "x");
+  }
+  std::string deep = root;
+  for (int i = 0; i < 32; i++) {
+    deep += "/d" + std::to_string(i);
+    fs::mkdirs(deep);
+    fs::write_file(deep + "/f.txt", "x");
+  }
+#ifndef _WIN32
+  // a link is removed, not what it points to
+  fs::symlink("../keep", root + "/link");
+#endif
+  return 0;
+}
+
+static int test_remove() {
+  fs::mkdirs("./tmp/keep");
+  fs::write_file("./tmp/keep/k.txt", "k");
+  try {
+    make_remove_tree("./tmp/seq");
+    fs::remove("./tmp/seq");
+    expect(!fs::exists("./tmp/seq"))
+    make_remove_tree("./tmp/par");
+    fs::remove("./tmp/par", true);
+    expect(!fs::exists("./tmp/par"))
+    fs::remove("./tmp/notexist", true);
+  } catch (const std::exception& e) {
+    console::error(e.what());
+    return -1;
+  }
+  expect(fs::read_file_to_string("./tmp/keep/k.txt") == "k")
+  fs::remove("./tmp");
+  expect(!fs::exists("./tmp"))
+  return 0;
+}
+
+static int test_executor() {
+  executor::pool p(4, 16);
+  std::atomic<int> sum(0);
+  {
+    executor::task_group group(p);
+    for (int i = 1; i <= 100; i++) {
+      group.run([&sum, i]() { sum += i; });
+    }
+    group.wait();
+  }
+  expect(sum == 5050)
+
+  expect(p.submit([]() -> int { return 233; }).get() == 233)
+
+  std::vector<int> squares(1000);
+  executor::parallel_for(0, squares.size(), [&squares](std::size_t i) { squares[i] = (int)(i * i); }, 0, p);
+  expect(squares[999] == 999 * 999)
+
+  executor::task_group failing(p);
+  failing.run([]() { throw std::runtime_error("task error"); });
+  try {
+    failing.wait();
+    return -1;
+  } catch (const std::exception& e) {
+    console::error(e.what());
+  }
+  expect(failing.cancelled())
+  return 0;
+}
+
 static void test_console() {
   console::log("中文测试");
   console::log(std::vector<std::string>({"中文测试", "2"}));
@@ -488,7 +702,16 @@ int test() {
     test_stat,
     test_mkdirs,
     test_copy,
-    test_read_write);
+    test_read_write,
+    test_bulk_writer,
+    test_remove);
+
+  if (code != 0) {
+    fail++;
+    code = 0;
+  }
+
+  code = describe("executor", test_executor);
 
   if (code != 0) {
     fail++;
@@ -0,0 +1,51 @@
+#ifndef __XZ_H__
+#define __XZ_H__
+
+/*
+ * Streaming decoder of the .xz format with the LZMA2 filter, which is what
+ * the Node.js .tar.xz tarballs use. Input can be fed in pieces of any size;
+ * the decompressed data is handed to a callback in order.
+ *
+ * Integrity checks CRC32 and CRC64 are verified, SHA-256 and the reserved
+ * check types are skipped. Concatenated streams and stream padding are
+ * accepted. BCJ and delta filters are not supported.
+ */
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum xz_ret {
+  XZ_OK = 0,
+  XZ_MEM_ERROR = 1,
+  XZ_FORMAT_ERROR = 2,
+  XZ_OPTIONS_ERROR = 3,
+  XZ_DATA_ERROR = 4,
+  XZ_CHECK_ERROR = 5,
+  XZ_WRITE_ERROR = 6,
+  XZ_TRUNCATED_ERROR = 7
+};
+
+struct xz_dec;
+typedef struct xz_dec xz_dec;
+
+/* receives decompressed data, returns 0 to continue */
+typedef int (*xz_output)(const unsigned char*, size_t, void*);
+
+xz_dec* xz_dec_init();
+/* consumes all of `in`; returns XZ_OK or an error, after which the decoder
+   only reports that error until xz_dec_reset() */
+int xz_dec_run(xz_dec*, const unsigned char* in, size_t len, xz_output output, void* param);
+/* XZ_OK when the input so far ends after a complete stream */
+int xz_dec_finish(xz_dec*);
+void xz_dec_reset(xz_dec*);
+void xz_dec_end(xz_dec*);
+const char* xz_dec_message(int);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,938 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "xz.h"
+
+/* the largest dictionary accepted, what xz -9 and --extreme use is 64 MiB */
+#define XZ_DICT_MAX ((uint32_t)1 << 30)
+/* an LZMA2 chunk holds at most 64 KiB of compressed data */
+#define LZMA2_CHUNK_MAX (1 << 16)
+
+#define XZ_CHECK_NONE 0
+#define XZ_CHECK_CRC32 1
+#define XZ_CHECK_CRC64 4
+
+#define XZ_FILTER_LZMA2 0x21
+
+#define LZMA_STATES 12
+#define LZMA_POS_STATES_MAX 16
+#define LZMA_LITERAL_CODERS_MAX 16
+#define LZMA_LITERAL_CODER_SIZE 0x300
+#define LZMA_DIST_STATES 4
+#define LZMA_DIST_SLOTS 64
+#define LZMA_DIST_MODEL_END 14
+#define LZMA_FULL_DISTANCES 128
+#define LZMA_ALIGN_BITS 4
+#define LZMA_MATCH_LEN_MIN 2
+
+#define RC_TOP_VALUE ((uint32_t)1 << 24)
+#define RC_BIT_MODEL_TOTAL ((uint16_t)1 << 11)
+#define RC_MOVE_BITS 5
+
+enum xz_seq {
+  SEQ_STREAM_HEADER,
+  SEQ_BLOCK_START,
+  SEQ_BLOCK_HEADER,
+  SEQ_BLOCK_DATA,
+  SEQ_BLOCK_PADDING,
+  SEQ_BLOCK_CHECK,
+  SEQ_INDEX,
+  SEQ_INDEX_PADDING,
+  SEQ_INDEX_CRC,
+  SEQ_STREAM_FOOTER,
+  SEQ_STREAM_PADDING
+};
+
+enum lzma2_seq {
+  L2_CONTROL,
+  L2_USIZE_1,
+  L2_USIZE_2,
+  L2_CSIZE_1,
+  L2_CSIZE_2,
+  L2_PROPS,
+  L2_LZMA,
+  L2_COPY
+};
+
+typedef struct rc_dec {
+  uint32_t range;
+  uint32_t code;
+  const uint8_t* in;
+  size_t pos;
+  size_t limit;
+  int overrun;
+} rc_dec;
+
+typedef struct len_dec {
+  uint16_t choice;
+  uint16_t choice2;
+  uint16_t low[LZMA_POS_STATES_MAX][8];
+  uint16_t mid[LZMA_POS_STATES_MAX][8];
+  uint16_t high[256];
+} len_dec;
+
+typedef struct lzma_dec {
+  uint32_t state;
+  uint32_t rep0;
+  uint32_t rep1;
+  uint32_t rep2;
+  uint32_t rep3;
+  uint32_t lc;
+  uint32_t literal_pos_mask;
+  uint32_t pos_mask;
+  uint16_t is_match[LZMA_STATES][LZMA_POS_STATES_MAX];
+  uint16_t is_rep[LZMA_STATES];
+  uint16_t is_rep0[LZMA_STATES];
+  uint16_t is_rep1[LZMA_STATES];
+  uint16_t is_rep2[LZMA_STATES];
+  uint16_t is_rep0_long[LZMA_STATES][LZMA_POS_STATES_MAX];
+  uint16_t dist_slot[LZMA_DIST_STATES][LZMA_DIST_SLOTS];
+  uint16_t dist_special[LZMA_FULL_DISTANCES - LZMA_DIST_MODEL_END];
+  uint16_t dist_align[1 << LZMA_ALIGN_BITS];
+  len_dec match_len;
+  len_dec rep_len;
+  uint16_t literal[LZMA_LITERAL_CODERS_MAX][LZMA_LITERAL_CODER_SIZE];
+} lzma_dec;
+
+/* the circular dictionary is also the output buffer, [start, pos) is not
+   handed to the callback yet */
+typedef struct dict_buf {
+  uint8_t* buf;
+  uint32_t allocated;
+  uint32_t size;
+  uint32_t pos;
+  uint32_t start;
+  uint32_t full;
+  uint64_t total;
+} dict_buf;
+
+struct xz_dec {
+  enum xz_seq sequence;
+  int error;
+  uint32_t crc32_table[256];
+  uint64_t crc64_table[256];
+
+  /* stream header, block header, check and footer bytes */
+  uint8_t temp[1024];
+  size_t temp_pos;
+  size_t temp_size;
+  uint8_t stream_flags[2];
+  uint32_t check_type;
+  size_t check_size;
+
+  /* current block */
+  size_t block_header_size;
+  uint64_t block_compressed;
+  uint64_t block_uncompressed;
+  uint64_t block_compressed_expected;
+  uint64_t block_uncompressed_expected;
+  uint32_t block_crc32;
+  uint64_t block_crc64;
+
+  /* blocks of the current stream, compared with the index */
+  uint64_t blocks;
+  uint64_t blocks_unpadded;
+  uint64_t blocks_uncompressed;
+
+  /* index */
+  uint32_t index_crc32;
+  uint64_t index_size;
+  uint64_t index_count;
+  uint64_t index_field;
+  uint64_t index_unpadded;
+  uint64_t index_uncompressed;
+  uint64_t vli;
+  uint32_t vli_shift;
+
+  uint64_t padding;
+  int streams;
+
+  /* LZMA2 */
+  enum lzma2_seq lzma2_sequence;
+  uint32_t control;
+  uint32_t uncompressed;
+  uint32_t compressed;
+  int need_dict_reset;
+  int need_props;
+  uint8_t chunk[LZMA2_CHUNK_MAX];
+  uint32_t chunk_pos;
+  rc_dec rc;
+  lzma_dec lzma;
+  dict_buf dict;
+
+  xz_output output;
+  void* param;
+  int write_error;
+};
+
+static uint32_t crc32_update(const uint32_t* table, uint32_t crc, const uint8_t* buf, size_t size) {
+  crc = ~crc;
+  while (size-- > 0) {
+    crc = table[(crc ^ *buf++) & 0xFF] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+static uint64_t crc64_update(const uint64_t* table, uint64_t crc, const uint8_t* buf, size_t size) {
+  crc = ~crc;
+  while (size-- > 0) {
+    crc = table[(crc ^ *buf++) & 0xFF] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+static uint32_t get_le32(const uint8_t* p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t get_le64(const uint8_t* p) {
+  return (uint64_t)get_le32(p) | ((uint64_t)get_le32(p + 4) << 32);
+}
+
+/* sizes of the check fields by check type */
+static size_t check_size_of(uint32_t type) {
+  static const uint8_t sizes[16] = { 0, 4, 4, 4, 8, 8, 8, 16, 16, 16, 32, 32, 32, 64, 64, 64 };
+  return sizes[type & 0x0F];
+}
+
+/* ---- dictionary ---- */
+
+static void dict_flush(xz_dec* s) {
+  size_t n = s->dict.pos - s->dict.start;
+  const uint8_t* data = s->dict.buf + s->dict.start;
+  if (n == 0) return;
+  if (s->check_type == XZ_CHECK_CRC32) {
+    s->block_crc32 = crc32_update(s->crc32_table, s->block_crc32, data, n);
+  } else if (s->check_type == XZ_CHECK_CRC64) {
+    s->block_crc64 = crc64_update(s->crc64_table, s->block_crc64, data, n);
+  }
+  s->block_uncompressed += n;
+  if (!s->write_error && s->output != NULL && s->output(data, n, s->param) != 0) {
+    s->write_error = 1;
+  }
+  s->dict.start = s->dict.pos;
+}
+
+static void dict_reset(xz_dec* s) {
+  s->dict.full = 0;
+  s->dict.total = 0;
+}
+
+static void dict_put(xz_dec* s, uint8_t byte) {
+  dict_buf* d = &s->dict;
+  if (d->pos == d->size) {
+    dict_flush(s);
+    d->pos = 0;
+    d->start = 0;
+  }
+  d->buf[d->pos++] = byte;
+  d->total++;
+  if (d->full < d->size) d->full++;
+}
+
+/* the byte `dist` + 1 positions back */
+static uint8_t dict_get(const dict_buf* d, uint32_t dist) {
+  uint32_t offset = d->pos > dist ? d->pos - dist - 1 : d->pos + d->size - dist - 1;
+  return d->buf[offset];
+}
+
+static void dict_repeat(xz_dec* s, uint32_t len, uint32_t dist) {
+  dict_buf* d = &s->dict;
+  while (len > 0) {
+    uint32_t back;
+    uint32_t n;
+    if (d->pos == d->size) {
+      dict_flush(s);
+      d->pos = 0;
+      d->start = 0;
+    }
+    back = d->pos > dist ? d->pos - dist - 1 : d->pos + d->size - dist - 1;
+    /* both ends stay inside the buffer, the ranges may overlap */
+    n = len;
+    if (n > d->size - d->pos) n = d->size - d->pos;
+    if (n > d->size - back) n = d->size - back;
+    len -= n;
+    d->total += n;
+    d->full = d->full + n < d->size ? d->full + n : d->size;
+    if (back + n <= d->pos || back >= d->pos + n) {
+      memcpy(d->buf + d->pos, d->buf + back, n);
+      d->pos += n;
+      continue;
+    }
+    while (n-- > 0) {
+      d->buf[d->pos++] = d->buf[back++];
+    }
+  }
+}
+
+static void dict_copy(xz_dec* s, const uint8_t* in, size_t len) {
+  dict_buf* d = &s->dict;
+  while (len > 0) {
+    size_t n;
+    if (d->pos == d->size) {
+      dict_flush(s);
+      d->pos = 0;
+      d->start = 0;
+    }
+    n = d->size - d->pos;
+    if (n > len) n = len;
+    memcpy(d->buf + d->pos, in, n);
+    d->pos += (uint32_t)n;
+    d->total += n;
+    d->full = d->full + n < d->size ? d->full + (uint32_t)n : d->size;
+    in += n;
+    len -= n;
+  }
+}
+
+/* ---- range decoder ---- */
+
+static void rc_normalize(rc_dec* rc) {
+  if (rc->range < RC_TOP_VALUE) {
+    rc->range <<= 8;
+    if (rc->pos < rc->limit) {
+      rc->code = (rc->code << 8) | rc->in[rc->pos++];
+    } else {
+      rc->code <<= 8;
+      rc->overrun = 1;
+    }
+  }
+}
+
+static int rc_bit(rc_dec* rc, uint16_t* prob) {
+  uint32_t bound;
+  rc_normalize(rc);
+  bound = (rc->range >> 11) * (*prob);
+  if (rc->code < bound) {
+    rc->range = bound;
+    *prob += (RC_BIT_MODEL_TOTAL - *prob) >> RC_MOVE_BITS;
+    return 0;
+  }
+  rc->range -= bound;
+  rc->code -= bound;
+  *prob -= *prob >> RC_MOVE_BITS;
+  return 1;
+}
+
+/* `limit` is 1 << bits, the result still has the leading 1 */
+static uint32_t rc_bittree(rc_dec* rc, uint16_t* probs, uint32_t limit) {
+  uint32_t symbol = 1;
+  do {
+    symbol = (symbol << 1) | (uint32_t)rc_bit(rc, &probs[symbol]);
+  } while (symbol < limit);
+  return symbol;
+}
+
+static uint32_t rc_bittree_reverse(rc_dec* rc, uint16_t* probs, uint32_t bits) {
+  uint32_t symbol = 1;
+  uint32_t result = 0;
+  uint32_t i = 0;
+  do {
+    uint32_t bit = (uint32_t)rc_bit(rc, &probs[symbol]);
+    symbol = (symbol << 1) | bit;
+    result |= bit << i;
+  } while (++i < bits);
+  return result;
+}
+
+static uint32_t rc_direct(rc_dec* rc, uint32_t count) {
+  uint32_t result = 0;
+  do {
+    rc_normalize(rc);
+    rc->range >>= 1;
+    if (rc->code >= rc->range) {
+      rc->code -= rc->range;
+      result = (result << 1) | 1;
+    } else {
+      result <<= 1;
+    }
+  } while (--count > 0);
+  return result;
+}
+
+/* ---- LZMA ---- */
+
+static void lzma_reset(lzma_dec* lz) {
+  uint16_t* probs = &lz->is_match[0][0];
+  size_t count = (sizeof(lzma_dec) - offsetof(lzma_dec, is_match)) / sizeof(uint16_t);
+  size_t i;
+  lz->state = 0;
+  lz->rep0 = 0;
+  lz->rep1 = 0;
+  lz->rep2 = 0;
+  lz->rep3 = 0;
+  for (i = 0; i < count; i++) {
+    probs[i] = RC_BIT_MODEL_TOTAL >> 1;
+  }
+}
+
+static int lzma_props(lzma_dec* lz, uint8_t props) {
+  uint32_t lc, lp, pb;
+  if (props > (4 * 5 + 4) * 9 + 8) return 0;
+  lc = props % 9;
+  props /= 9;
+  lp = props % 5;
+  pb = props / 5;
+  if (lc + lp > 4) return 0;
+  lz->lc = lc;
+  lz->literal_pos_mask = (1u << lp) - 1;
+  lz->pos_mask = (1u << pb) - 1;
+  return 1;
+}
+
+static uint32_t lzma_len(rc_dec* rc, len_dec* l, uint32_t pos_state) {
+  if (!rc_bit(rc, &l->choice)) {
+    return rc_bittree(rc, l->low[pos_state], 8) - 8;
+  }
+  if (!rc_bit(rc, &l->choice2)) {
+    return 8 + rc_bittree(rc, l->mid[pos_state], 8) - 8;
+  }
+  return 16 + rc_bittree(rc, l->high, 256) - 256;
+}
+
+/* one whole LZMA2 chunk, `out_size` bytes into the dictionary */
+static int lzma_chunk(xz_dec* s, const uint8_t* in, size_t in_size, uint32_t out_size) {
+  lzma_dec* lz = &s->lzma;
+  rc_dec* rc = &s->rc;
+  dict_buf* d = &s->dict;
+
+  if (in_size < 5 || in[0] != 0) return XZ_DATA_ERROR;
+  rc->in = in;
+  rc->pos = 5;
+  rc->limit = in_size;
+  rc->range = 0xFFFFFFFF;
+  rc->code = ((uint32_t)in[1] << 24) | ((uint32_t)in[2] << 16) | ((uint32_t)in[3] << 8) | in[4];
+  rc->overrun = 0;
+
+  while (out_size > 0) {
+    uint32_t pos_state = (uint32_t)d->total & lz->pos_mask;
+    uint32_t len;
+
+    if (!rc_bit(rc, &lz->is_match[lz->state][pos_state])) {
+      uint32_t prev = d->full > 0 ? dict_get(d, 0) : 0;
+      uint32_t coder = ((((uint32_t)d->total) & lz->literal_pos_mask) << lz->lc) + (prev >> (8 - lz->lc));
+      uint16_t* probs = lz->literal[coder];
+      uint32_t symbol = 1;
+      if (lz->state < 7) {
+        symbol = rc_bittree(rc, probs, 0x100);
+      } else {
+        uint32_t match_byte;
+        uint32_t offset = 0x100;
+        if (lz->rep0 >= d->full) return XZ_DATA_ERROR;
+        match_byte = dict_get(d, lz->rep0);
+        do {
+          uint32_t match_bit;
+          match_byte <<= 1;
+          match_bit = match_byte & offset;
+          if (rc_bit(rc, &probs[offset + match_bit + symbol])) {
+            symbol = (symbol << 1) | 1;
+            offset &= match_bit;
+          } else {
+            symbol <<= 1;
+            offset &= ~match_bit;
+          }
+        } while (symbol < 0x100);
+      }
+      dict_put(s, (uint8_t)symbol);
+      lz->state = lz->state < 4 ? 0 : (lz->state < 10 ? lz->state - 3 : lz->state - 6);
+      out_size--;
+      continue;
+    }
+
+    if (!rc_bit(rc, &lz->is_rep[lz->state])) {
+      uint32_t dist_state;
+      uint32_t slot;
+      lz->rep3 = lz->rep2;
+      lz->rep2 = lz->rep1;
+      lz->rep1 = lz->rep0;
+      len = lzma_len(rc, &lz->match_len, pos_state);
+      lz->state = lz->state < 7 ? 7 : 10;
+
+      dist_state = len < LZMA_DIST_STATES - 1 ? len : LZMA_DIST_STATES - 1;
+      slot = rc_bittree(rc, lz->dist_slot[dist_state], LZMA_DIST_SLOTS) - LZMA_DIST_SLOTS;
+      if (slot < 4) {
+        lz->rep0 = slot;
+      } else {
+        uint32_t bits = (slot >> 1) - 1;
+        uint32_t dist = (2 | (slot & 1)) << bits;
+        if (slot < LZMA_DIST_MODEL_END) {
+          dist += rc_bittree_reverse(rc, lz->dist_special + dist - slot - 1, bits);
+        } else {
+          dist += rc_direct(rc, bits - LZMA_ALIGN_BITS) << LZMA_ALIGN_BITS;
+          dist += rc_bittree_reverse(rc, lz->dist_align, LZMA_ALIGN_BITS);
+        }
+        lz->rep0 = dist;
+      }
+      /* the end of payload marker is not used in LZMA2 */
+      if (lz->rep0 == 0xFFFFFFFF) return XZ_DATA_ERROR;
+    } else if (!rc_bit(rc, &lz->is_rep0[lz->state])) {
+      if (!rc_bit(rc, &lz->is_rep0_long[lz->state][pos_state])) {
+        if (lz->rep0 >= d->full) return XZ_DATA_ERROR;
+        dict_put(s, dict_get(d, lz->rep0));
+        lz->state = lz->state < 7 ? 9 : 11;
+        out_size--;
+        continue;
+      }
+      len = lzma_len(rc, &lz->rep_len, pos_state);
+      lz->state = lz->state < 7 ? 8 : 11;
+    } else {
+      uint32_t dist;
+      if (!rc_bit(rc, &lz->is_rep1[lz->state])) {
+        dist = lz->rep1;
+      } else {
+        if (!rc_bit(rc, &lz->is_rep2[lz->state])) {
+          dist = lz->rep2;
+        } else {
+          dist = lz->rep3;
+          lz->rep3 = lz->rep2;
+        }
+        lz->rep2 = lz->rep1;
+      }
+      lz->rep1 = lz->rep0;
+      lz->rep0 = dist;
+      len = lzma_len(rc, &lz->rep_len, pos_state);
+      lz->state = lz->state < 7 ? 8 : 11;
+    }
+
+    len += LZMA_MATCH_LEN_MIN;
+    /* a match never crosses the end of a chunk */
+    if (len > out_size || lz->rep0 >= d->full) return XZ_DATA_ERROR;
+    dict_repeat(s, len, lz->rep0);
+    out_size -= len;
+    if (rc->overrun) return XZ_DATA_ERROR;
+  }
+
+  /* the encoder flushes the pending normalization too */
+  rc_normalize(rc);
+  if (rc->overrun || rc->pos != rc->limit || rc->code != 0) return XZ_DATA_ERROR;
+  return XZ_OK;
+}
+
+/* ---- LZMA2 ---- */
+
+/* returns XZ_OK with *end set when the end of the LZMA2 data was read */
+static int lzma2_run(xz_dec* s, const uint8_t* in, size_t* in_pos, size_t in_size, int* end) {
+  while (*in_pos < in_size) {
+    uint8_t byte;
+    size_t n;
+    switch (s->lzma2_sequence) {
+      case L2_CONTROL:
+        byte = in[(*in_pos)++];
+        s->block_compressed++;
+        s->control = byte;
+        if (byte == 0x00) {
+          *end = 1;
+          return XZ_OK;
+        }
+        if (byte >= 0xE0 || byte == 0x01) {
+          s->need_props = 1;
+          s->need_dict_reset = 0;
+          dict_reset(s);
+        } else if (s->need_dict_reset) {
+          return XZ_DATA_ERROR;
+        }
+        if (byte >= 0x80) {
+          s->uncompressed = (uint32_t)(byte & 0x1F) << 16;
+          s->lzma2_sequence = L2_USIZE_1;
+          if (byte >= 0xC0) {
+            s->need_props = 0;
+          } else if (s->need_props) {
+            return XZ_DATA_ERROR;
+          } else if (byte >= 0xA0) {
+            lzma_reset(&s->lzma);
+          }
+        } else {
+          if (byte > 0x02) return XZ_DATA_ERROR;
+          s->lzma2_sequence = L2_CSIZE_1;
+        }
+        break;
+      case L2_USIZE_1:
+        s->uncompressed += (uint32_t)in[(*in_pos)++] << 8;
+        s->block_compressed++;
+        s->lzma2_sequence = L2_USIZE_2;
+        break;
+      case L2_USIZE_2:
+        s->uncompressed += (uint32_t)in[(*in_pos)++] + 1;
+        s->block_compressed++;
+        s->lzma2_sequence = L2_CSIZE_1;
+        break;
+      case L2_CSIZE_1:
+        s->compressed = (uint32_t)in[(*in_pos)++] << 8;
+        s->block_compressed++;
+        s->lzma2_sequence = L2_CSIZE_2;
+        break;
+      case L2_CSIZE_2:
+        s->compressed += (uint32_t)in[(*in_pos)++] + 1;
+        s->block_compressed++;
+        s->chunk_pos = 0;
+        if (s->control < 0x80) {
+          /* an uncompressed chunk, its size is in the compressed field */
+          s->lzma2_sequence = L2_COPY;
+        } else {
+          s->lzma2_sequence = s->control >= 0xC0 ? L2_PROPS : L2_LZMA;
+        }
+        break;
+      case L2_PROPS:
+        if (!lzma_props(&s->lzma, in[(*in_pos)++])) return XZ_OPTIONS_ERROR;
+        s->block_compressed++;
+        lzma_reset(&s->lzma);
+        s->lzma2_sequence = L2_LZMA;
+        break;
+      case L2_LZMA:
+        n = in_size - *in_pos;
+        if (n > s->compressed - s->chunk_pos) n = s->compressed - s->chunk_pos;
+        memcpy(s->chunk + s->chunk_pos, in + *in_pos, n);
+        s->chunk_pos += (uint32_t)n;
+        *in_pos += n;
+        s->block_compressed += n;
+        if (s->chunk_pos == s->compressed) {
+          int r = lzma_chunk(s, s->chunk, s->compressed, s->uncompressed);
+          if (r != XZ_OK) return r;
+          dict_flush(s);
+          if (s->write_error) return XZ_WRITE_ERROR;
+          s->lzma2_sequence = L2_CONTROL;
+        }
+        break;
+      case L2_COPY:
+        n = in_size - *in_pos;
+        if (n > s->compressed - s->chunk_pos) n = s->compressed - s->chunk_pos;
+        dict_copy(s, in + *in_pos, n);
+        s->chunk_pos += (uint32_t)n;
+        *in_pos += n;
+        s->block_compressed += n;
+        dict_flush(s);
+        if (s->write_error) return XZ_WRITE_ERROR;
+        if (s->chunk_pos == s->compressed) {
+          s->lzma2_sequence = L2_CONTROL;
+        }
+        break;
+    }
+  }
+  return XZ_OK;
+}
+
+/* ---- container ---- */
+
+/* collects s->temp_size bytes into s->temp, returns 1 once all are there */
+static int fill_temp(xz_dec* s, const uint8_t* in, size_t* in_pos, size_t in_size) {
+  size_t n = in_size - *in_pos;
+  if (n > s->temp_size - s->temp_pos) n = s->temp_size - s->temp_pos;
+  memcpy(s->temp + s->temp_pos, in + *in_pos, n);
+  s->temp_pos += n;
+  *in_pos += n;
+  return s->temp_pos == s->temp_size;
+}
+
+static int decode_vli(const uint8_t* buf, size_t* pos, size_t size, uint64_t* out) {
+  uint32_t shift = 0;
+  *out = 0;
+  while (*pos < size && shift < 63) {
+    uint8_t byte = buf[(*pos)++];
+    *out |= (uint64_t)(byte & 0x7F) << shift;
+    if (!(byte & 0x80)) {
+      return byte != 0 || shift == 0;
+    }
+    shift += 7;
+  }
+  return 0;
+}
+
+static int parse_stream_header(xz_dec* s) {
+  static const uint8_t magic[6] = { 0xFD, '7', 'z', 'X', 'Z', 0x00 };
+  if (memcmp(s->temp, magic, 6) != 0) return XZ_FORMAT_ERROR;
+  if (crc32_update(s->crc32_table, 0, s->temp + 6, 2) != get_le32(s->temp + 8)) return XZ_DATA_ERROR;
+  if (s->temp[6] != 0 || s->temp[7] > 0x0F) return XZ_OPTIONS_ERROR;
+  s->stream_flags[0] = s->temp[6];
+  s->stream_flags[1] = s->temp[7];
+  s->check_type = s->temp[7];
+  s->check_size = check_size_of(s->check_type);
+  s->blocks = 0;
+  s->blocks_unpadded = 0;
+  s->blocks_uncompressed = 0;
+  return XZ_OK;
+}
+
+static int parse_block_header(xz_dec* s) {
+  size_t size = s->temp_size - 4;
+  size_t pos = 2;
+  uint8_t flags = s->temp[1];
+  uint64_t filter_id;
+  uint64_t props_size;
+  uint32_t dict_size;
+  uint8_t props;
+
+  if (crc32_update(s->crc32_table, 0, s->temp, size) != get_le32(s->temp + size)) return XZ_DATA_ERROR;
+  /* one filter, no reserved bits */
+  if ((flags & 0x3F) != 0) return XZ_OPTIONS_ERROR;
+
+  s->block_compressed_expected = (uint64_t)-1;
+  s->block_uncompressed_expected = (uint64_t)-1;
+  if (flags & 0x40) {
+    if (!decode_vli(s->temp, &pos, size, &s->block_compressed_expected)) return XZ_DATA_ERROR;
+  }
+  if (flags & 0x80) {
+    if (!decode_vli(s->temp, &pos, size, &s->block_uncompressed_expected)) return XZ_DATA_ERROR;
+  }
+  if (!decode_vli(s->temp, &pos, size, &filter_id)) return XZ_DATA_ERROR;
+  if (filter_id != XZ_FILTER_LZMA2) return XZ_OPTIONS_ERROR;
+  if (!decode_vli(s->temp, &pos, size, &props_size) || props_size != 1 || pos >= size) return XZ_DATA_ERROR;
+  props = s->temp[pos++];
+  while (pos < size) {
+    if (s->temp[pos++] != 0) return XZ_OPTIONS_ERROR;
+  }
+
+  if (props > 40) return XZ_OPTIONS_ERROR;
+  if (props == 40) return XZ_MEM_ERROR;
+  dict_size = (uint32_t)(2 | (props & 1)) << (props / 2 + 11);
+  if (dict_size > XZ_DICT_MAX) return XZ_MEM_ERROR;
+  if (dict_size > s->dict.allocated) {
+    free(s->dict.buf);
+    s->dict.buf = (uint8_t*)malloc(dict_size);
+    s->dict.allocated = s->dict.buf != NULL ? dict_size : 0;
+    if (s->dict.buf == NULL) return XZ_MEM_ERROR;
+  }
+  s->dict.size = dict_size;
+  s->dict.pos = 0;
+  s->dict.start = 0;
+  dict_reset(s);
+
+  s->block_header_size = s->temp_size;
+  s->block_compressed = 0;
+  s->block_uncompressed = 0;
+  s->block_crc32 = 0;
+  s->block_crc64 = 0;
+  s->lzma2_sequence = L2_CONTROL;
+  s->need_dict_reset = 1;
+  s->need_props = 1;
+  return XZ_OK;
+}
+
+static int check_block(xz_dec* s) {
+  if (s->block_compressed_expected != (uint64_t)-1 && s->block_compressed_expected != s->block_compressed) return XZ_DATA_ERROR;
+  if (s->block_uncompressed_expected != (uint64_t)-1 && s->block_uncompressed_expected != s->block_uncompressed) return XZ_DATA_ERROR;
+  if (s->check_type == XZ_CHECK_CRC32 && get_le32(s->temp) != s->block_crc32) return XZ_CHECK_ERROR;
+  if (s->check_type == XZ_CHECK_CRC64 && get_le64(s->temp) != s->block_crc64) return XZ_CHECK_ERROR;
+  s->blocks++;
+  s->blocks_unpadded += s->block_header_size + s->block_compressed + s->check_size;
+  s->blocks_uncompressed += s->block_uncompressed;
+  return XZ_OK;
+}
+
+/* one byte of the index records; the field counter runs over the number
+   of records and then two fields per record */
+static int index_byte(xz_dec* s, uint8_t byte) {
+  if (s->vli_shift >= 63) return XZ_DATA_ERROR;
+  s->vli |= (uint64_t)(byte & 0x7F) << s->vli_shift;
+  if (byte & 0x80) {
+    s->vli_shift += 7;
+    return XZ_OK;
+  }
+  if (byte == 0 && s->vli_shift != 0) return XZ_DATA_ERROR;
+  if (s->index_field == 0) {
+    s->index_count = s->vli;
+    if (s->index_count != s->blocks) return XZ_DATA_ERROR;
+  } else if (s->index_field % 2 == 1) {
+    s->index_unpadded += s->vli;
+  } else {
+    s->index_uncompressed += s->vli;
+  }
+  s->index_field++;
+  s->vli = 0;
+  s->vli_shift = 0;
+  return XZ_OK;
+}
+
+static int parse_stream_footer(xz_dec* s) {
+  if (crc32_update(s->crc32_table, 0, s->temp + 4, 6) != get_le32(s->temp)) return XZ_DATA_ERROR;
+  if (s->temp[10] != 'Y' || s->temp[11] != 'Z') return XZ_FORMAT_ERROR;
+  if (((uint64_t)get_le32(s->temp + 4) + 1) * 4 != s->index_size) return XZ_DATA_ERROR;
+  if (s->temp[8] != s->stream_flags[0] || s->temp[9] != s->stream_flags[1]) return XZ_DATA_ERROR;
+  return XZ_OK;
+}
+
+static int xz_dec_main(xz_dec* s, const uint8_t* in, size_t in_size) {
+  size_t in_pos = 0;
+  int r;
+  while (in_pos < in_size) {
+    switch (s->sequence) {
+      case SEQ_STREAM_HEADER:
+        if (!fill_temp(s, in, &in_pos, in_size)) break;
+        r = parse_stream_header(s);
+        if (r != XZ_OK) return r;
+        s->sequence = SEQ_BLOCK_START;
+        break;
+      case SEQ_BLOCK_START:
+        if (in[in_pos] == 0x00) {
+          /* the index indicator */
+          s->index_crc32 = crc32_update(s->crc32_table, 0, in + in_pos, 1);
+          s->index_size = 1;
+          s->index_field = 0;
+          s->index_unpadded = 0;
+          s->index_uncompressed = 0;
+          s->vli = 0;
+          s->vli_shift = 0;
+          in_pos++;
+          s->sequence = SEQ_INDEX;
+          break;
+        }
+        s->temp_pos = 0;
+        s->temp_size = ((size_t)in[in_pos] + 1) * 4;
+        s->sequence = SEQ_BLOCK_HEADER;
+        break;
+      case SEQ_BLOCK_HEADER:
+        if (!fill_temp(s, in, &in_pos, in_size)) break;
+        r = parse_block_header(s);
+        if (r != XZ_OK) return r;
+        s->sequence = SEQ_BLOCK_DATA;
+        break;
+      case SEQ_BLOCK_DATA: {
+        int end = 0;
+        r = lzma2_run(s, in, &in_pos, in_size, &end);
+        if (r != XZ_OK) return r;
+        if (end) {
+          s->padding = s->block_header_size + s->block_compressed;
+          s->sequence = SEQ_BLOCK_PADDING;
+        }
+        break;
+      }
+      case SEQ_BLOCK_PADDING:
+        if (s->padding % 4 != 0) {
+          if (in[in_pos++] != 0) return XZ_DATA_ERROR;
+          s->padding++;
+          break;
+        }
+        s->temp_pos = 0;
+        s->temp_size = s->check_size;
+        s->sequence = SEQ_BLOCK_CHECK;
+        /* fall through */
+      case SEQ_BLOCK_CHECK:
+        if (!fill_temp(s, in, &in_pos, in_size)) break;
+        r = check_block(s);
+        if (r != XZ_OK) return r;
+        s->sequence = SEQ_BLOCK_START;
+        break;
+      case SEQ_INDEX:
+        if (s->index_field > 0 && s->index_field == s->index_count * 2 + 1) {
+          if (s->index_unpadded != s->blocks_unpadded || s->index_uncompressed != s->blocks_uncompressed) {
+            return XZ_DATA_ERROR;
+          }
+          s->sequence = SEQ_INDEX_PADDING;
+          break;
+        }
+        s->index_crc32 = crc32_update(s->crc32_table, s->index_crc32, in + in_pos, 1);
+        s->index_size++;
+        r = index_byte(s, in[in_pos++]);
+        if (r != XZ_OK) return r;
+        break;
+      case SEQ_INDEX_PADDING:
+        if (s->index_size % 4 != 0) {
+          if (in[in_pos] != 0) return XZ_DATA_ERROR;
+          s->index_crc32 = crc32_update(s->crc32_table, s->index_crc32, in + in_pos, 1);
+          s->index_size++;
+          in_pos++;
+          break;
+        }
+        s->temp_pos = 0;
+        s->temp_size = 4;
+        s->sequence = SEQ_INDEX_CRC;
+        /* fall through */
+      case SEQ_INDEX_CRC:
+        if (!fill_temp(s, in, &in_pos, in_size)) break;
+        if (get_le32(s->temp) != s->index_crc32) return XZ_DATA_ERROR;
+        s->index_size += 4;
+        s->temp_pos = 0;
+        s->temp_size = 12;
+        s->sequence = SEQ_STREAM_FOOTER;
+        break;
+      case SEQ_STREAM_FOOTER:
+        if (!fill_temp(s, in, &in_pos, in_size)) break;
+        r = parse_stream_footer(s);
+        if (r != XZ_OK) return r;
+        s->streams++;
+        s->padding = 0;
+        s->sequence = SEQ_STREAM_PADDING;
+        break;
+      case SEQ_STREAM_PADDING:
+        if (in[in_pos] == 0x00) {
+          s->padding++;
+          in_pos++;
+          break;
+        }
+        /* the next of concatenated streams */
+        if (s->padding % 4 != 0) return XZ_DATA_ERROR;
+        s->temp_pos = 0;
+        s->temp_size = 12;
+        s->sequence = SEQ_STREAM_HEADER;
+        break;
+    }
+  }
+  return XZ_OK;
+}
+
+xz_dec* xz_dec_init() {
+  uint32_t i, j;
+  xz_dec* s = (xz_dec*)malloc(sizeof(xz_dec));
+  if (s == NULL) return NULL;
+  memset(s, 0, offsetof(xz_dec, chunk));
+  for (i = 0; i < 256; i++) {
+    uint32_t r32 = i;
+    uint64_t r64 = i;
+    for (j = 0; j < 8; j++) {
+      r32 = (r32 >> 1) ^ ((r32 & 1) ? 0xEDB88320u : 0);
+      r64 = (r64 >> 1) ^ ((r64 & 1) ? 0xC96C5795D7870F42ull : 0);
+    }
+    s->crc32_table[i] = r32;
+    s->crc64_table[i] = r64;
+  }
+  memset(&s->dict, 0, sizeof(dict_buf));
+  xz_dec_reset(s);
+  return s;
+}
+
+void xz_dec_reset(xz_dec* s) {
+  s->sequence = SEQ_STREAM_HEADER;
+  s->error = XZ_OK;
+  s->temp_pos = 0;
+  s->temp_size = 12;
+  s->streams = 0;
+  s->padding = 0;
+  s->write_error = 0;
+}
+
+int xz_dec_run(xz_dec* s, const unsigned char* in, size_t len, xz_output output, void* param) {
+  if (s->error != XZ_OK) return s->error;
+  s->output = output;
+  s->param = param;
+  s->error = xz_dec_main(s, in, len);
+  if (s->error == XZ_OK && s->write_error) s->error = XZ_WRITE_ERROR;
+  return s->error;
+}
+
+int xz_dec_finish(xz_dec* s) {
+  if (s->error != XZ_OK) return s->error;
+  if (s->streams == 0 || s->sequence != SEQ_STREAM_PADDING || s->padding % 4 != 0) {
+    return XZ_TRUNCATED_ERROR;
+  }
+  return XZ_OK;
+}
+
+void xz_dec_end(xz_dec* s) {
+  if (s) {
+    free(s->dict.buf);
+    free(s);
+  }
+}
+
+const char* xz_dec_message(int code) {
+  switch (code) {
+    case XZ_OK: return "Success.";
+    case XZ_MEM_ERROR: return "Dictionary too large or out of memory.";
+    case XZ_FORMAT_ERROR: return "Not an xz stream.";
+    case XZ_OPTIONS_ERROR: return "Unsupported xz options or filter.";
+    case XZ_DATA_ERROR: return "Corrupt xz data.";
+    case XZ_CHECK_ERROR: return "xz integrity check failed.";
+    case XZ_WRITE_ERROR: return "Output stopped.";
+    case XZ_TRUNCATED_ERROR: return "Unexpected end of xz stream.";
+    default: return "Unknown error.";
+  }
+}
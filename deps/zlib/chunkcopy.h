@@ -0,0 +1,111 @@
+/* chunkcopy.h -- match copies 16 bytes at a time
+ * For conditions of distribution and use, see copyright notice in zlib.h
+ */
+
+/* WARNING: this file should *not* be used by applications. It is
+   part of the implementation of the compression library and is
+   subject to change. Applications should only use zlib.h.
+ */
+
+/*
+  inflate_fast_chunk_() copies matches with whole 16 byte loads and stores
+  (SSE2 or NEON, plain memcpy() elsewhere) instead of byte by byte. A copy
+  may store up to CHUNKCOPY_CHUNK_SIZE - 1 bytes past its end; the caller
+  makes sure there is room for them in the output buffer, inflate()
+  overwrites them later.
+ */
+
+#ifndef CHUNKCOPY_H
+#define CHUNKCOPY_H
+
+#include "zutil.h"
+
+#define CHUNKCOPY_CHUNK_SIZE 16
+
+#if defined(_MSC_VER)
+#  define Z_INLINE __inline
+#else
+#  define Z_INLINE __inline__
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  include <emmintrin.h>
+typedef __m128i z_vec128i_t;
+#  define loadchunk(s) _mm_loadu_si128((const __m128i *)(s))
+#  define storechunk(d, c) _mm_storeu_si128((__m128i *)(d), (c))
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#  include <arm_neon.h>
+typedef uint8x16_t z_vec128i_t;
+#  define loadchunk(s) vld1q_u8((const uint8_t *)(s))
+#  define storechunk(d, c) vst1q_u8((uint8_t *)(d), (c))
+#else
+typedef struct { unsigned char b[CHUNKCOPY_CHUNK_SIZE]; } z_vec128i_t;
+local Z_INLINE z_vec128i_t loadchunk(const unsigned char FAR *s)
+{
+    z_vec128i_t c;
+    zmemcpy(c.b, s, CHUNKCOPY_CHUNK_SIZE);
+    return c;
+}
+#  define storechunk(d, c) zmemcpy((d), (c).b, CHUNKCOPY_CHUNK_SIZE)
+#endif
+
+/*
+  Copies len (> 0) bytes from `from`, which is a chunk or more behind `out`
+  or does not overlap it. The first store covers the odd part, the rest
+  are whole chunks; only a copy shorter than a chunk writes past out + len.
+ */
+local Z_INLINE unsigned char FAR *chunkcopy_core(out, from, len)
+    unsigned char FAR *out;
+    const unsigned char FAR *from;
+    unsigned len;
+{
+    unsigned bump = (--len % CHUNKCOPY_CHUNK_SIZE) + 1;
+    storechunk(out, loadchunk(from));
+    out += bump;
+    from += bump;
+    len /= CHUNKCOPY_CHUNK_SIZE;
+    while (len-- > 0) {
+        storechunk(out, loadchunk(from));
+        out += CHUNKCOPY_CHUNK_SIZE;
+        from += CHUNKCOPY_CHUNK_SIZE;
+    }
+    return out;
+}
+
+/*
+  A match closer than a chunk: every store repeats the pattern once more and
+  doubles its period, until it is a chunk wide or covers the match.
+ */
+local Z_INLINE unsigned char FAR *chunkcopy_lapped(out, dist, len)
+    unsigned char FAR *out;
+    unsigned dist;
+    unsigned len;
+{
+    while (dist < len && dist < CHUNKCOPY_CHUNK_SIZE) {
+        storechunk(out, loadchunk(out - dist));
+        len -= dist;
+        out += dist;
+        dist += dist;
+    }
+    return chunkcopy_core(out, out - dist, len);
+}
+
+/* len bytes from dist back in the output, byte by byte near `safe` */
+local Z_INLINE unsigned char FAR *chunkcopy_output(out, dist, len, safe)
+    unsigned char FAR *out;
+    unsigned dist;
+    unsigned len;
+    unsigned char FAR *safe;
+{
+    if ((z_size_t)(safe - out) < (z_size_t)len + CHUNKCOPY_CHUNK_SIZE) {
+        const unsigned char FAR *from = out - dist;
+        while (len--)
+            *out++ = *from++;
+        return out;
+    }
+    if (dist >= CHUNKCOPY_CHUNK_SIZE)
+        return chunkcopy_core(out, out - dist, len);
+    return chunkcopy_lapped(out, dist, len);
+}
+
+#endif /* CHUNKCOPY_H */
@@ -0,0 +1,56 @@
+/* cpu_features.c -- runtime detection of the SIMD paths
+ * For conditions of distribution and use, see copyright notice in zlib.h
+ */
+
+#include "zutil.h"
+#include "cpu_features.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#  define CPU_X86
+#  ifdef _MSC_VER
+#    include <intrin.h>
+#  else
+#    include <cpuid.h>
+#  endif
+#elif defined(__aarch64__) && defined(__linux__)
+#  define CPU_ARM_LINUX
+#  include <sys/auxv.h>
+#  include <asm/hwcap.h>
+#elif defined(__aarch64__) && defined(__APPLE__)
+#  define CPU_ARM_APPLE
+#endif
+
+int ZLIB_INTERNAL x86_cpu_enable_simd = 0;
+int ZLIB_INTERNAL arm_cpu_enable_crc32 = 0;
+
+/* Every thread computes the same flags, so a race on the first calls only
+   means some of them take the portable path once. */
+local volatile int cpu_checked = 0;
+
+void ZLIB_INTERNAL cpu_check_features()
+{
+    if (cpu_checked)
+        return;
+#if defined(CPU_X86)
+    {
+        unsigned ecx;
+#  ifdef _MSC_VER
+        int regs[4];
+        __cpuid(regs, 1);
+        ecx = (unsigned)regs[2];
+#  else
+        unsigned eax, ebx, edx;
+        if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+            ecx = 0;
+#  endif
+        /* bit 20 SSE4.2, bit 1 PCLMULQDQ */
+        x86_cpu_enable_simd = (ecx & (1U << 20)) && (ecx & (1U << 1));
+    }
+#elif defined(CPU_ARM_LINUX)
+    arm_cpu_enable_crc32 = (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+#elif defined(CPU_ARM_APPLE)
+    /* every Apple ARM64 core has it */
+    arm_cpu_enable_crc32 = 1;
+#endif
+    cpu_checked = 1;
+}
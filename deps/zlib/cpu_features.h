@@ -0,0 +1,19 @@
+/* cpu_features.h -- runtime detection of the SIMD paths
+ * For conditions of distribution and use, see copyright notice in zlib.h
+ */
+
+/* WARNING: this file should *not* be used by applications. It is
+   part of the implementation of the compression library and is
+   subject to change. Applications should only use zlib.h.
+ */
+
+#ifndef CPU_FEATURES_H
+#define CPU_FEATURES_H
+
+/* set by cpu_check_features(), zero until then */
+extern int ZLIB_INTERNAL x86_cpu_enable_simd;    /* SSE4.2 and PCLMULQDQ */
+extern int ZLIB_INTERNAL arm_cpu_enable_crc32;   /* ARMv8 CRC32 instructions */
+
+void ZLIB_INTERNAL cpu_check_features OF((void));
+
+#endif /* CPU_FEATURES_H */
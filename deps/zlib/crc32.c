@@ -30,6 +30,11 @@
 
 #include "zutil.h"      /* for STDC and FAR definitions */
 
+#ifdef CRC32_SIMD
+#  include "cpu_features.h"
+#  include "crc32_simd.h"
+#endif
+
 /* Definitions for doing the crc four data bytes at a time. */
 #if !defined(NOBYFOUR) && defined(Z_U4)
 #  define BYFOUR
@@ -206,6 +211,27 @@ unsigned long ZEXPORT crc32_z(crc, buf, len)
 {
     if (buf == Z_NULL) return 0UL;
 
+#ifdef CRC32_SIMD
+    /* long buffers go to the instructions the CPU has, the tables below
+       only see what is left */
+    if (len >= Z_CRC32_SSE42_MINIMUM_LENGTH) {
+        cpu_check_features();
+#  if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+        if (x86_cpu_enable_simd) {
+            z_size_t chunk_size = len & ~(z_size_t)Z_CRC32_SSE42_CHUNKSIZE_MASK;
+            crc = ~crc32_sse42_simd_(buf, chunk_size, ~(uint32_t)crc) & 0xffffffffUL;
+            len -= chunk_size;
+            if (!len)
+                return crc;
+            buf += chunk_size;
+        }
+#  elif defined(__aarch64__)
+        if (arm_cpu_enable_crc32)
+            return armv8_crc32_little((uint32_t)crc, buf, len);
+#  endif
+    }
+#endif /* CRC32_SIMD */
+
 #ifdef DYNAMIC_CRC_TABLE
     if (crc_table_empty)
         make_crc_table();
@@ -0,0 +1,194 @@
+/* crc32_simd.c -- CRC-32 with PCLMULQDQ folding or ARMv8 CRC32 instructions
+ * For conditions of distribution and use, see copyright notice in zlib.h
+ *
+ * The x86 path folds 64 bytes at a time with carry-less multiplies and
+ * reduces the result with Barrett's method, as described in Intel's "Fast
+ * CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction".
+ * Both paths are compiled for their instruction set with function target
+ * attributes, so the rest of the library keeps its baseline flags; callers
+ * check cpu_features.h first.
+ */
+
+#include "zutil.h"
+
+#ifdef CRC32_SIMD
+
+#include "crc32_simd.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+
+#include <emmintrin.h>
+#include <smmintrin.h>
+#include <wmmintrin.h>
+
+#if defined(__GNUC__) || defined(__clang__)
+#  define TARGET_SSE42_PCLMUL __attribute__((target("sse4.2,pclmul")))
+#  define ZALIGN(n) __attribute__((aligned(n)))
+#else
+#  define TARGET_SSE42_PCLMUL
+#  define ZALIGN(n) __declspec(align(n))
+#endif
+
+TARGET_SSE42_PCLMUL
+uint32_t ZLIB_INTERNAL crc32_sse42_simd_(buf, len, crc)
+    const unsigned char *buf;
+    z_size_t len;
+    uint32_t crc;
+{
+    /* the bit-reflected fold constants k1..k5 and the CRC-32 and Barrett
+       polynomials from the end of the paper */
+    static const uint64_t ZALIGN(16) k1k2[] = { 0x0154442bd4, 0x01c6e41596 };
+    static const uint64_t ZALIGN(16) k3k4[] = { 0x01751997d0, 0x00ccaa009e };
+    static const uint64_t ZALIGN(16) k5k0[] = { 0x0163cd6124, 0x0000000000 };
+    static const uint64_t ZALIGN(16) poly[] = { 0x01db710641, 0x01f7011641 };
+
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+    /* there is at least one block of 64 */
+    x1 = _mm_loadu_si128((const __m128i *)(buf + 0x00));
+    x2 = _mm_loadu_si128((const __m128i *)(buf + 0x10));
+    x3 = _mm_loadu_si128((const __m128i *)(buf + 0x20));
+    x4 = _mm_loadu_si128((const __m128i *)(buf + 0x30));
+
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)crc));
+
+    x0 = _mm_load_si128((const __m128i *)k1k2);
+
+    buf += 64;
+    len -= 64;
+
+    /* fold four blocks of 16 in parallel */
+    while (len >= 64) {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+
+        y5 = _mm_loadu_si128((const __m128i *)(buf + 0x00));
+        y6 = _mm_loadu_si128((const __m128i *)(buf + 0x10));
+        y7 = _mm_loadu_si128((const __m128i *)(buf + 0x20));
+        y8 = _mm_loadu_si128((const __m128i *)(buf + 0x30));
+
+        x1 = _mm_xor_si128(x1, x5);
+        x2 = _mm_xor_si128(x2, x6);
+        x3 = _mm_xor_si128(x3, x7);
+        x4 = _mm_xor_si128(x4, x8);
+
+        x1 = _mm_xor_si128(x1, y5);
+        x2 = _mm_xor_si128(x2, y6);
+        x3 = _mm_xor_si128(x3, y7);
+        x4 = _mm_xor_si128(x4, y8);
+
+        buf += 64;
+        len -= 64;
+    }
+
+    /* fold into 128 bits */
+    x0 = _mm_load_si128((const __m128i *)k3k4);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(x1, x2);
+    x1 = _mm_xor_si128(x1, x5);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(x1, x3);
+    x1 = _mm_xor_si128(x1, x5);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(x1, x4);
+    x1 = _mm_xor_si128(x1, x5);
+
+    /* then the remaining blocks of 16 one at a time */
+    while (len >= 16) {
+        x2 = _mm_loadu_si128((const __m128i *)buf);
+
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(x1, x2);
+        x1 = _mm_xor_si128(x1, x5);
+
+        buf += 16;
+        len -= 16;
+    }
+
+    /* fold 128 bits to 64 */
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+    x1 = _mm_srli_si128(x1, 8);
+    x1 = _mm_xor_si128(x1, x2);
+
+    x0 = _mm_loadl_epi64((const __m128i *)k5k0);
+
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, x3);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    /* Barrett reduction to 32 bits */
+    x0 = _mm_load_si128((const __m128i *)poly);
+
+    x2 = _mm_and_si128(x1, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+    x2 = _mm_and_si128(x2, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    return (uint32_t)_mm_extract_epi32(x1, 1);
+}
+
+#elif defined(__aarch64__)
+
+#include <arm_acle.h>
+
+#if defined(__clang__)
+#  define TARGET_ARMV8_CRC __attribute__((target("crc")))
+#else
+#  define TARGET_ARMV8_CRC __attribute__((target("+crc")))
+#endif
+
+TARGET_ARMV8_CRC
+uint32_t ZLIB_INTERNAL armv8_crc32_little(crc, buf, len)
+    uint32_t crc;
+    const unsigned char *buf;
+    z_size_t len;
+{
+    uint32_t c = ~crc;
+    const uint64_t *buf8;
+
+    while (len && ((uintptr_t)buf & 7)) {
+        c = __crc32b(c, *buf++);
+        --len;
+    }
+    buf8 = (const uint64_t *)(const void *)buf;
+    while (len >= 64) {
+        c = __crc32d(c, *buf8++);
+        c = __crc32d(c, *buf8++);
+        c = __crc32d(c, *buf8++);
+        c = __crc32d(c, *buf8++);
+        c = __crc32d(c, *buf8++);
+        c = __crc32d(c, *buf8++);
+        c = __crc32d(c, *buf8++);
+        c = __crc32d(c, *buf8++);
+        len -= 64;
+    }
+    while (len >= 8) {
+        c = __crc32d(c, *buf8++);
+        len -= 8;
+    }
+    buf = (const unsigned char *)buf8;
+    while (len--)
+        c = __crc32b(c, *buf++);
+    return ~c;
+}
+
+#endif
+
+#endif /* CRC32_SIMD */
@@ -0,0 +1,28 @@
+/* crc32_simd.h -- CRC-32 with PCLMULQDQ folding or ARMv8 CRC32 instructions
+ * For conditions of distribution and use, see copyright notice in zlib.h
+ */
+
+/* WARNING: this file should *not* be used by applications. It is
+   part of the implementation of the compression library and is
+   subject to change. Applications should only use zlib.h.
+ */
+
+#ifndef CRC32_SIMD_H
+#define CRC32_SIMD_H
+
+#include <stdint.h>
+
+/* the folding loop wants at least 64 bytes, in whole 16 byte blocks */
+#define Z_CRC32_SSE42_MINIMUM_LENGTH 64
+#define Z_CRC32_SSE42_CHUNKSIZE_MASK 15
+
+/* `crc` and the result are not inverted, like inside crc32_little() */
+uint32_t ZLIB_INTERNAL crc32_sse42_simd_ OF((const unsigned char *buf,
+                                             z_size_t len, uint32_t crc));
+
+/* takes and returns the finished CRC, like crc32_z() */
+uint32_t ZLIB_INTERNAL armv8_crc32_little OF((uint32_t crc,
+                                              const unsigned char *buf,
+                                              z_size_t len));
+
+#endif /* CRC32_SIMD_H */
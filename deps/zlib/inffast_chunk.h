@@ -0,0 +1,27 @@
+/* inffast_chunk.h -- header to use inffast_chunk.c
+ * For conditions of distribution and use, see copyright notice in zlib.h
+ */
+
+/* WARNING: this file should *not* be used by applications. It is
+   part of the implementation of the compression library and is
+   subject to change. Applications should only use zlib.h.
+ */
+
+#include "inffast.h"
+
+/* 64-bit little-endian targets refill the bit buffer eight bytes at once */
+#if defined(__x86_64__) || defined(_M_X64) || defined(_M_ARM64) || \
+    (defined(__aarch64__) && defined(__BYTE_ORDER__) && \
+     __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#  define INFLATE_CHUNK_READ_64LE
+#endif
+
+/* inflate() calls inflate_fast_chunk_() with at least this much room */
+#ifdef INFLATE_CHUNK_READ_64LE
+#  define INFLATE_FAST_MIN_INPUT 17
+#else
+#  define INFLATE_FAST_MIN_INPUT 6
+#endif
+#define INFLATE_FAST_MIN_OUTPUT 258
+
+void ZLIB_INTERNAL inflate_fast_chunk_ OF((z_streamp strm, unsigned start));
@@ -83,7 +83,11 @@
 #include "zutil.h"
 #include "inftrees.h"
 #include "inflate.h"
-#include "inffast.h"
+#ifdef INFLATE_CHUNK_SIMD
+#  include "inffast_chunk.h"
+#else
+#  include "inffast.h"
+#endif
 
 #ifdef MAKEFIXED
 #  ifndef BUILDFIXED
@@ -1042,9 +1046,16 @@ int flush;
         case LEN_:
             state->mode = LEN;
         case LEN:
+#ifdef INFLATE_CHUNK_SIMD
+            if (have >= INFLATE_FAST_MIN_INPUT &&
+                left >= INFLATE_FAST_MIN_OUTPUT) {
+                RESTORE();
+                inflate_fast_chunk_(strm, out);
+#else
             if (have >= 6 && left >= 258) {
                 RESTORE();
                 inflate_fast(strm, out);
+#endif
                 LOAD();
                 if (state->mode == TYPE)
                     state->back = -1;
@@ -0,0 +1,38 @@
+# Compares inflate and CRC-32 speed of stock zlib and the SIMD build
+# (see buildzlib.sh) on the given .tar.gz files, or on a Node.js tarball.
+#
+#   ./scripts/benchzlib.sh [file.tar.gz...]
+
+set -e
+
+root=`pwd`
+work=`mktemp -d`
+trap 'rm -rf "$work"' EXIT
+
+files="$@"
+if [ -z "$files" ]; then
+  unamestr=`uname`
+  os=`echo $unamestr | tr "A-Z" "a-z"`
+  curl -fsSL -o "$work/node.tar.gz" "https://nodejs.org/dist/v12.16.2/node-v12.16.2-$os-x64.tar.gz"
+  files="$work/node.tar.gz"
+fi
+
+for build in stock simd; do
+  if [ "$build" = "stock" ]; then
+    cflags="-O3"
+  else
+    cflags="-O3 -DINFLATE_CHUNK_SIMD -DCRC32_SIMD"
+  fi
+  cp -rp ./deps/zlib "$work/$build"
+  cd "$work/$build"
+  chmod +x ./configure
+  CFLAGS="$cflags" ./configure --static > /dev/null
+  make libz.a > /dev/null
+  cc -O2 -I. -o zbench "$root/scripts/zbench.c" libz.a
+  cd "$root"
+done
+
+for build in stock simd; do
+  echo "== $build"
+  "$work/$build/zbench" $files
+done
@@ -10,8 +10,15 @@ REM cd deps\zlib\contrib\vstudio\vc16
 REM msbuild zlibvc.sln /t:Rebuild /p:Configuration=Release /p:Platform="Win32"
 REM cd ..\..\..\..\..
 
+REM set NODEV_ZLIB_SIMD=0 to build stock zlib without the chunked inflate and SIMD CRC-32
+if "%NODEV_ZLIB_SIMD%"=="0" (
+  set ZLIB_LOC=-MT
+) else (
+  set ZLIB_LOC=-MT -DINFLATE_CHUNK_SIMD -DCRC32_SIMD
+)
+
 cd deps\zlib
-nmake /f win32\Makefile.msc LOC=-MT
+nmake /f win32\Makefile.msc "LOC=%ZLIB_LOC%"
 cd ..\..
 mkdir lib
 copy /Y deps\zlib\zlib.lib  lib\zlib.lib
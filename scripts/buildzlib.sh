@@ -1,6 +1,13 @@
+# NODEV_ZLIB_SIMD=0 builds stock zlib without the chunked inflate and SIMD CRC-32
+if [ "$NODEV_ZLIB_SIMD" = "0" ]; then
+  ZLIB_CFLAGS="-O3"
+else
+  ZLIB_CFLAGS="-O3 -DINFLATE_CHUNK_SIMD -DCRC32_SIMD"
+fi
+
 cd ./deps/zlib
 chmod +x ./configure
-./configure
+CFLAGS="$ZLIB_CFLAGS" ./configure
 make
 cd ../..
 mkdir -p ./lib
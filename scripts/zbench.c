@@ -0,0 +1,105 @@
+/*
+ * Inflate and CRC-32 throughput of the zlib it is linked with, over the
+ * given .tar.gz files. Built twice by benchzlib.sh, against stock zlib and
+ * against the SIMD build, to compare the two.
+ *
+ *   zbench [-n rounds] file.tar.gz...
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "zlib.h"
+
+#define ZBENCH_OUT (256 * 1024)
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static unsigned char* read_all(const char* path, size_t* size) {
+  FILE* fp = fopen(path, "rb");
+  unsigned char* data = NULL;
+  size_t cap = 0, len = 0, n;
+  if (fp == NULL) return NULL;
+  do {
+    if (len == cap) {
+      cap = cap ? cap * 2 : 1 << 20;
+      data = (unsigned char*)realloc(data, cap);
+    }
+    n = fread(data + len, 1, cap - len, fp);
+    len += n;
+  } while (n > 0);
+  fclose(fp);
+  *size = len;
+  return data;
+}
+
+/* inflates the whole gzip stream, returns the uncompressed size or 0 */
+static size_t inflate_all(const unsigned char* in, size_t size, unsigned char* out, unsigned long* crc) {
+  z_stream strm;
+  size_t total = 0;
+  int r;
+  memset(&strm, 0, sizeof(strm));
+  if (inflateInit2(&strm, 31) != Z_OK) return 0;
+  strm.next_in = (unsigned char*)in;
+  strm.avail_in = (uInt)size;
+  do {
+    strm.next_out = out;
+    strm.avail_out = ZBENCH_OUT;
+    r = inflate(&strm, Z_NO_FLUSH);
+    if (r != Z_OK && r != Z_STREAM_END) {
+      inflateEnd(&strm);
+      return 0;
+    }
+    if (crc) *crc = crc32(*crc, out, ZBENCH_OUT - strm.avail_out);
+    total += ZBENCH_OUT - strm.avail_out;
+  } while (r != Z_STREAM_END);
+  inflateEnd(&strm);
+  return total;
+}
+
+int main(int argc, char** argv) {
+  int rounds = 10;
+  int i = 1;
+  if (argc > 2 && strcmp(argv[1], "-n") == 0) {
+    rounds = atoi(argv[2]);
+    i = 3;
+  }
+  if (i >= argc || rounds <= 0) {
+    fprintf(stderr, "Usage: zbench [-n rounds] file.tar.gz...\n");
+    return 1;
+  }
+
+  unsigned char* out = (unsigned char*)malloc(ZBENCH_OUT);
+  for (; i < argc; i++) {
+    size_t size;
+    unsigned char* in = read_all(argv[i], &size);
+    unsigned long crc = crc32(0L, Z_NULL, 0);
+    size_t total = in ? inflate_all(in, size, out, &crc) : 0;
+    if (total == 0) {
+      fprintf(stderr, "%s: not a gzip file\n", argv[i]);
+      free(in);
+      continue;
+    }
+
+    double start = now();
+    for (int r = 0; r < rounds; r++) inflate_all(in, size, out, NULL);
+    double inflate_time = (now() - start) / rounds;
+
+    /* CRC-32 over the compressed bytes, same as over anything else */
+    unsigned long check = 0;
+    start = now();
+    for (int r = 0; r < rounds; r++) check ^= crc32(0L, in, (uInt)size);
+    double crc_time = (now() - start) / rounds;
+
+    printf("%s\n  inflate %8.1f MB/s  (%.1f MB out, crc %08lx)\n  crc32   %8.1f MB/s  (%08lx)\n",
+      argv[i], total / inflate_time / 1e6, total / 1e6, crc, size / crc_time / 1e6, check);
+    free(in);
+  }
+  free(out);
+  return 0;
+}
@@ -10,6 +10,8 @@
 
 #include <string>
 #include <map>
+#include <vector>
+#include <cstdlib>
 #include "json.hpp"
 #include "cli.hpp"
 #include "toyo/fs.hpp"
@@ -29,6 +31,21 @@
       member = (json)[(key)].get<std::string>();\
     }\
   } while (0)
+#define JSON_CONFIGURE_INT(json, key, member) \
+  do {\
+    if (JSON_HAS(json, key) && (json)[(key)].is_number_integer()) {\
+      member = (json)[(key)].get<int>();\
+    }\
+  } while (0)
+#define JSON_CONFIGURE_STRINGS(json, key, member) \
+  do {\
+    if (JSON_HAS(json, key) && (json)[(key)].is_array()) {\
+      member.clear();\
+      for (auto& item : (json)[(key)]) {\
+        if (item.is_string()) member.push_back(item.get<std::string>());\
+      }\
+    }\
+  } while (0)
 
 namespace nodev {
 
@@ -36,19 +53,35 @@ class nodev_config {
  public:
   std::string prefix;
   std::string node_mirror;
+  std::vector<std::string> node_mirrors;
   std::string node_cache_dir;
   std::string node_arch;
   std::string npm_mirror;
+  std::vector<std::string> npm_mirrors;
   std::string npm_cache_dir;
+  std::string npm_source;
+  int connections;
+  int jobs;
+  int retries;
+  int low_speed_limit;
+  int low_speed_time;
   std::string config_path;
 
   nodev_config():
     prefix(toyo::path::__dirname()),
     node_mirror("https://nodejs.org/dist"),
+    node_mirrors(),
     node_cache_dir(""),
     node_arch(get_arch()),
-    npm_mirror("https://github.com/npm/cli/archive"),
+    npm_mirror("https://registry.npmjs.org"),
+    npm_mirrors(),
     npm_cache_dir(""),
+    npm_source("node"),
+    connections(4),
+    jobs(4),
+    retries(3),
+    low_speed_limit(1024),
+    low_speed_time(20),
     config_path("") {
 
     auto env_paths = toyo::path::env_paths::create(NODEV_EXECUTABLE_NAME);
@@ -67,21 +100,44 @@ class nodev_config {
       const std::string prefix_key = "prefix";
       const std::string npm_key = "npm";
       const std::string mirror_key = "mirror";
+      const std::string mirrors_key = "mirrors";
       const std::string cache_dir_key = "cacheDir";
       const std::string arch_key = "arch";
+      const std::string source_key = "source";
+      const std::string download_key = "download";
+      const std::string connections_key = "connections";
+      const std::string jobs_key = "jobs";
+      const std::string retries_key = "retries";
+      const std::string low_speed_limit_key = "lowSpeedLimit";
+      const std::string low_speed_time_key = "lowSpeedTime";
       if (JSON_HAS(configjson, prefix_key) && configjson[prefix_key].is_string()) {
         this->prefix = configjson[prefix_key].get<std::string>();
       }
       if (JSON_HAS(configjson, node_key) && configjson[node_key].is_object()) {
         nlohmann::json node = configjson[node_key];
         JSON_CONFIGURE(node, mirror_key, node_mirror);
+        JSON_CONFIGURE_STRINGS(node, mirrors_key, node_mirrors);
         JSON_CONFIGURE(node, cache_dir_key, node_cache_dir);
         JSON_CONFIGURE(node, arch_key, node_arch);
       }
       if (JSON_HAS(configjson, npm_key) && configjson[npm_key].is_object()) {
         nlohmann::json npm = configjson[npm_key];
         JSON_CONFIGURE(npm, mirror_key, npm_mirror);
+        JSON_CONFIGURE_STRINGS(npm, mirrors_key, npm_mirrors);
         JSON_CONFIGURE(npm, cache_dir_key, npm_cache_dir);
+        JSON_CONFIGURE(npm, source_key, npm_source);
+        npm_mirror = npm_registry(npm_mirror);
+        for (std::size_t i = 0; i < npm_mirrors.size(); i++) {
+          npm_mirrors[i] = npm_registry(npm_mirrors[i]);
+        }
+      }
+      if (JSON_HAS(configjson, download_key) && configjson[download_key].is_object()) {
+        nlohmann::json download = configjson[download_key];
+        JSON_CONFIGURE_INT(download, connections_key, connections);
+        JSON_CONFIGURE_INT(download, jobs_key, jobs);
+        JSON_CONFIGURE_INT(download, retries_key, retries);
+        JSON_CONFIGURE_INT(download, low_speed_limit_key, low_speed_limit);
+        JSON_CONFIGURE_INT(download, low_speed_time_key, low_speed_time);
       }
     }
   }
@@ -131,9 +187,9 @@ class nodev_config {
 
   void set_npm_mirror(const std::string& value) {
     if (value == "default") {
-      npm_mirror = "https://github.com/npm/cli/archive";
+      npm_mirror = "https://registry.npmjs.org";
     } else if (value == "taobao") {
-      npm_mirror = "https://npm.taobao.org/mirrors/npm";
+      npm_mirror = "https://registry.npmmirror.com";
     } else {
       npm_mirror = value;
     }
@@ -155,6 +211,16 @@ class nodev_config {
     }
   }
 
+  void set_connections(int value) {
+    connections = value < 1 ? 1 : value;
+
+    if (config_path != "") {
+      auto configjson = toyo::fs::exists(config_path) ? nlohmann::json::parse(toyo::fs::read_file_to_string(config_path)) : nlohmann::json();
+      configjson["download"]["connections"] = connections;
+      this->write(configjson);
+    }
+  }
+
   void write(const nlohmann::json& json) {
     if (config_path != "") {
       toyo::fs::mkdirs(toyo::path::dirname(config_path));
@@ -168,26 +234,66 @@ class nodev_config {
     }
 
     if (cli.has("npm_mirror")) {
-      npm_mirror = cli.get_option("npm_mirror");
+      npm_mirror = npm_registry(cli.get_option("npm_mirror"));
     }
 
     if (cli.has("node_arch")) {
       node_arch = cli.get_option("node_arch");
     }
+
+    if (cli.has("connections")) {
+      connections = atoi(cli.get_option("connections").c_str());
+      if (connections < 1) connections = 1;
+    }
+
+    if (cli.has("jobs")) {
+      jobs = atoi(cli.get_option("jobs").c_str());
+      if (jobs < 1) jobs = 1;
+    }
   }
 
   void print() {
     std::map<std::string, std::string> res;
     res["prefix"] = this->prefix;
     res["node_mirror"] = this->node_mirror;
+    res["node_mirrors"] = join(this->node_mirrors);
     res["node_cache_dir"] = this->node_cache_dir;
     res["node_arch"] = this->node_arch;
     res["npm_mirror"] = this->npm_mirror;
+    res["npm_mirrors"] = join(this->npm_mirrors);
     res["npm_cache_dir"] = this->npm_cache_dir;
+    res["npm_source"] = this->npm_source;
+    res["connections"] = std::to_string(this->connections);
+    res["jobs"] = std::to_string(this->jobs);
+    res["retries"] = std::to_string(this->retries);
+    res["low_speed_limit"] = std::to_string(this->low_speed_limit);
+    res["low_speed_time"] = std::to_string(this->low_speed_time);
 
     toyo::console::log(res);
   }
  private:
+  // npm.mirror used to be where the npm/cli zips were, configs written then
+  // still name those
+  static std::string npm_registry(const std::string& mirror) {
+    std::string url = mirror;
+    while (!url.empty() && url[url.length() - 1] == '/') url.erase(url.length() - 1);
+    if (url == "https://github.com/npm/cli/archive") {
+      return "https://registry.npmjs.org";
+    }
+    if (url == "https://npm.taobao.org/mirrors/npm") {
+      return "https://registry.npmmirror.com";
+    }
+    return mirror;
+  }
+
+  static std::string join(const std::vector<std::string>& list) {
+    std::string res = "";
+    for (std::size_t i = 0; i < list.size(); i++) {
+      res += (i == 0 ? "" : ", ") + list[i];
+    }
+    return res;
+  }
+
   std::string get_arch() {
 #ifdef _WIN32
   #ifdef _WIN64
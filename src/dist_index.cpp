@@ -0,0 +1,387 @@
+#include "dist_index.hpp"
+
+#include <ctime>
+#include <cstring>
+#include <cstdlib>
+#include <cctype>
+#include <algorithm>
+#include <exception>
+
+#include "json.hpp"
+#include "json_stream.hpp"
+#include "toyo/fs.hpp"
+#include "toyo/path.hpp"
+
+#define NODEV_INDEX_MAGIC "NDVI"
+#define NODEV_INDEX_FORMAT 1
+// seconds the cached index is trusted before it is revalidated
+#define NODEV_INDEX_TTL (60 * 60)
+
+namespace nodev {
+
+typedef struct indexHeader {
+  char magic[4];
+  uint32_t format;
+  uint32_t count;
+  uint32_t etag;            // offsets into the string pool
+  uint32_t last_modified;
+  uint32_t reserved;
+  int64_t checked;          // unix time of the last successful check
+} indexHeader;
+
+typedef struct indexRecord {
+  uint16_t major;
+  uint16_t minor;
+  uint16_t patch;
+  uint16_t reserved;
+  uint32_t version;
+  uint32_t npm;
+  uint32_t lts;
+  uint32_t date;
+  uint32_t files;           // comma separated
+} indexRecord;
+
+static bool parse_semver(const std::string& v, uint16_t* major, uint16_t* minor, uint16_t* patch) {
+  std::size_t start = (!v.empty() && (v[0] == 'v' || v[0] == 'V')) ? 1 : 0;
+  unsigned long parts[3] = { 0, 0, 0 };
+  for (int i = 0; i < 3; i++) {
+    if (start >= v.length() || !isdigit((unsigned char)v[start])) return false;
+    char* end = nullptr;
+    parts[i] = strtoul(v.c_str() + start, &end, 10);
+    start = end - v.c_str();
+    if (i < 2) {
+      if (start >= v.length() || v[start] != '.') return false;
+      start++;
+    }
+  }
+  if (start != v.length() || parts[0] > 0xffff || parts[1] > 0xffff || parts[2] > 0xffff) return false;
+  *major = (uint16_t)parts[0];
+  *minor = (uint16_t)parts[1];
+  *patch = (uint16_t)parts[2];
+  return true;
+}
+
+static bool newer(const indexRecord& a, const indexRecord& b) {
+  if (a.major != b.major) return a.major > b.major;
+  if (a.minor != b.minor) return a.minor > b.minor;
+  return a.patch > b.patch;
+}
+
+static std::string lower(std::string s) {
+  for (std::size_t i = 0; i < s.length(); i++) {
+    s[i] = (char)tolower((unsigned char)s[i]);
+  }
+  return s;
+}
+
+static uint32_t add_string(std::string& pool, const std::string& s) {
+  if (s.empty()) return 0;
+  uint32_t offset = (uint32_t)pool.length();
+  pool.append(s);
+  pool.push_back('\0');
+  return offset;
+}
+
+static indexHeader read_header(const std::string& data) {
+  indexHeader header;
+  memcpy(&header, data.data(), sizeof(indexHeader));
+  return header;
+}
+
+static indexRecord read_record(const std::string& data, std::size_t i) {
+  indexRecord record;
+  memcpy(&record, data.data() + sizeof(indexHeader) + i * sizeof(indexRecord), sizeof(indexRecord));
+  return record;
+}
+
+dist_index::dist_index(const std::string& path): path_(path), data_(""), builder_() {
+  load();
+}
+
+bool dist_index::load() {
+  data_ = "";
+  try {
+    if (!toyo::fs::exists(path_)) return false;
+    std::string data = toyo::fs::read_file_to_string(path_);
+    if (data.length() < sizeof(indexHeader)) return false;
+    indexHeader header = read_header(data);
+    std::size_t pool = sizeof(indexHeader) + (std::size_t)header.count * sizeof(indexRecord);
+    if (memcmp(header.magic, NODEV_INDEX_MAGIC, 4) != 0 || header.format != NODEV_INDEX_FORMAT ||
+        data.length() <= pool || data[data.length() - 1] != '\0') {
+      return false;
+    }
+    data_ = data;
+  } catch (const std::exception&) {
+    data_ = "";
+  }
+  return loaded();
+}
+
+bool dist_index::save() const {
+  try {
+    toyo::fs::mkdirs(toyo::path::dirname(path_));
+    toyo::fs::write_file(path_ + ".tmp", data_);
+    toyo::fs::rename(path_ + ".tmp", path_);
+  } catch (const std::exception&) {
+    return false;
+  }
+  return true;
+}
+
+bool dist_index::loaded() const {
+  return !data_.empty();
+}
+
+bool dist_index::stale() const {
+  if (!loaded()) return true;
+  return (int64_t)time(nullptr) - read_header(data_).checked > NODEV_INDEX_TTL;
+}
+
+const char* dist_index::str(uint32_t offset) const {
+  std::size_t pool = sizeof(indexHeader) + (std::size_t)read_header(data_).count * sizeof(indexRecord);
+  if (pool + offset >= data_.length()) return "";
+  return data_.c_str() + pool + offset;
+}
+
+distVersion dist_index::record(std::size_t i) const {
+  indexRecord r = read_record(data_, i);
+  distVersion v;
+  v.version = str(r.version);
+  v.npm = str(r.npm);
+  v.lts = str(r.lts);
+  v.date = str(r.date);
+  std::string files = str(r.files);
+  std::size_t start = 0;
+  while (start < files.length()) {
+    std::size_t comma = files.find(',', start);
+    if (comma == std::string::npos) comma = files.length();
+    v.files.push_back(files.substr(start, comma - start));
+    start = comma + 1;
+  }
+  return v;
+}
+
+bool dist_index::find(const std::string& version, distVersion* out) const {
+  if (!loaded()) return false;
+  indexRecord key;
+  memset(&key, 0, sizeof(indexRecord));
+  if (!parse_semver(version, &key.major, &key.minor, &key.patch)) return false;
+
+  // records are sorted newest first
+  std::size_t lo = 0;
+  std::size_t hi = read_header(data_).count;
+  while (lo < hi) {
+    std::size_t mid = lo + (hi - lo) / 2;
+    indexRecord r = read_record(data_, mid);
+    if (newer(r, key)) {
+      lo = mid + 1;
+    } else if (newer(key, r)) {
+      hi = mid;
+    } else {
+      if (out != nullptr) *out = record(mid);
+      return true;
+    }
+  }
+  return false;
+}
+
+std::string dist_index::resolve(const std::string& alias) const {
+  if (!loaded()) return "";
+  std::size_t count = read_header(data_).count;
+  std::string a = lower(alias);
+
+  if (a == "latest" || a == "current" || a == "node") {
+    return count > 0 ? std::string(str(read_record(data_, 0).version)) : "";
+  }
+  if (a == "lts" || a == "lts/*" || a.compare(0, 4, "lts/") == 0) {
+    std::string codename = (a == "lts" || a == "lts/*") ? "" : a.substr(4);
+    for (std::size_t i = 0; i < count; i++) {
+      indexRecord r = read_record(data_, i);
+      std::string lts = str(r.lts);
+      if (!lts.empty() && (codename.empty() || lower(lts) == codename)) {
+        return str(r.version);
+      }
+    }
+    return "";
+  }
+
+  // "18", "v18.2" or "18.2.0": the newest release with that prefix
+  std::size_t start = (!a.empty() && a[0] == 'v') ? 1 : 0;
+  long parts[3] = { -1, -1, -1 };
+  int n = 0;
+  while (start < a.length() && n < 3) {
+    if (!isdigit((unsigned char)a[start])) return "";
+    char* end = nullptr;
+    parts[n++] = strtol(a.c_str() + start, &end, 10);
+    start = end - a.c_str();
+    if (start < a.length()) {
+      if (a[start] != '.') return "";
+      start++;
+    }
+  }
+  if (n == 0 || start < a.length()) return "";
+  for (std::size_t i = 0; i < count; i++) {
+    indexRecord r = read_record(data_, i);
+    if (r.major == parts[0] && (parts[1] < 0 || r.minor == parts[1]) && (parts[2] < 0 || r.patch == parts[2])) {
+      return str(r.version);
+    }
+  }
+  return "";
+}
+
+bool dist_index::is_version(const std::string& version) {
+  uint16_t major, minor, patch;
+  return parse_semver(version, &major, &minor, &patch);
+}
+
+// collects the fields of one release without building a DOM
+class record_sax : public nlohmann::json_sax<nlohmann::json> {
+ public:
+  record_sax(): version(""), npm(""), lts(""), date(""), files(""), depth_(0), key_("") {}
+
+  std::string version;
+  std::string npm;
+  std::string lts;
+  std::string date;
+  std::string files;
+
+  virtual bool null() override { return true; }
+  virtual bool boolean(bool) override { return true; }
+  virtual bool number_integer(number_integer_t) override { return true; }
+  virtual bool number_unsigned(number_unsigned_t) override { return true; }
+  virtual bool number_float(number_float_t, const string_t&) override { return true; }
+  virtual bool string(string_t& val) override {
+    if (depth_ == 1) {
+      if (key_ == "version") version = val;
+      else if (key_ == "npm") npm = val;
+      else if (key_ == "lts") lts = val;
+      else if (key_ == "date") date = val;
+    } else if (depth_ == 2 && key_ == "files") {
+      files += (files.empty() ? "" : ",") + val;
+    }
+    return true;
+  }
+  virtual bool start_object(std::size_t) override { depth_++; return true; }
+  virtual bool key(string_t& val) override {
+    if (depth_ == 1) key_ = val;
+    return true;
+  }
+  virtual bool end_object() override { depth_--; return true; }
+  virtual bool start_array(std::size_t) override { depth_++; return true; }
+  virtual bool end_array() override { depth_--; return true; }
+  virtual bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception&) override {
+    return false;
+  }
+
+ private:
+  int depth_;
+  std::string key_;
+};
+
+/*
+ * Turns index.json into records while it is downloaded, one release at a
+ * time.
+ */
+class index_builder : public json_array_stream {
+ public:
+  index_builder(): json_array_stream(), records(), pool(1, '\0') {}
+
+  std::vector<indexRecord> records;
+  std::string pool;
+
+ protected:
+  virtual bool on_element(const std::string& text) override {
+    record_sax sax;
+    if (!nlohmann::json::sax_parse(text, &sax)) {
+      return fail("Invalid index.json record");
+    }
+    indexRecord r;
+    memset(&r, 0, sizeof(indexRecord));
+    if (!parse_semver(sax.version, &r.major, &r.minor, &r.patch)) {
+      // not a release, skipped
+      return true;
+    }
+    r.version = add_string(pool, sax.version[0] == 'v' ? sax.version.substr(1) : sax.version);
+    r.npm = add_string(pool, sax.npm);
+    r.lts = add_string(pool, sax.lts);
+    r.date = add_string(pool, sax.date);
+    r.files = add_string(pool, sax.files);
+    records.push_back(r);
+    return true;
+  }
+};
+
+bool dist_index::build(const std::string& etag, const std::string& last_modified) {
+  if (!builder_ || !builder_->ended()) return false;
+  std::vector<indexRecord>& records = builder_->records;
+  std::string& pool = builder_->pool;
+  std::stable_sort(records.begin(), records.end(), newer);
+
+  indexHeader header;
+  memset(&header, 0, sizeof(indexHeader));
+  memcpy(header.magic, NODEV_INDEX_MAGIC, 4);
+  header.format = NODEV_INDEX_FORMAT;
+  header.count = (uint32_t)records.size();
+  header.etag = add_string(pool, etag);
+  header.last_modified = add_string(pool, last_modified);
+  header.checked = (int64_t)time(nullptr);
+
+  std::string data((const char*)&header, sizeof(indexHeader));
+  if (!records.empty()) {
+    data.append((const char*)records.data(), records.size() * sizeof(indexRecord));
+  }
+  data.append(pool);
+  data_ = data;
+  builder_.reset();
+  return true;
+}
+
+fetchRequest* dist_index::refresh_request(const std::string& mirror) {
+  fetchRequest* request = create_fetch_request(mirror + "/index.json", 0);
+  builder_ = std::make_shared<index_builder>();
+  request->writer = [](const char* data, std::size_t len, void* param) -> int {
+    index_builder* builder = (index_builder*) param;
+    return builder->write(data, len) ? 0 : -1;
+  };
+  request->writer_param = builder_.get();
+  if (loaded()) {
+    indexHeader header = read_header(data_);
+    std::string etag = str(header.etag);
+    std::string last_modified = str(header.last_modified);
+    if (!etag.empty()) request->headers.push_back("If-None-Match: " + etag);
+    if (!last_modified.empty()) request->headers.push_back("If-Modified-Since: " + last_modified);
+  }
+  return request;
+}
+
+bool dist_index::update(const fetchRequest* request) {
+  if (request->result == CURLE_OK && request->code == 304 && loaded()) {
+    indexHeader header = read_header(data_);
+    header.checked = (int64_t)time(nullptr);
+    memcpy(&data_[0], &header, sizeof(indexHeader));
+    save();
+    return true;
+  }
+  if (!fetch_ok(request)) return false;
+
+  auto etag = request->response_headers.find("etag");
+  auto last_modified = request->response_headers.find("last-modified");
+  if (!build(etag != request->response_headers.end() ? etag->second : "",
+      last_modified != request->response_headers.end() ? last_modified->second : "")) {
+    return false;
+  }
+  save();
+  return true;
+}
+
+bool dist_index::refresh(const std::string& mirror, const std::string& history, long timeout) {
+  fetchRequest* request = refresh_request(mirror);
+  request->timeout = timeout;
+  std::vector<fetchRequest*> requests(1, request);
+  fetch_all(requests, 1, history);
+  bool r = update(request);
+  delete request;
+  return r;
+}
+
+}
@@ -0,0 +1,69 @@
+#ifndef __NODEV_DIST_INDEX_HPP__
+#define __NODEV_DIST_INDEX_HPP__
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <memory>
+#include "fetch.hpp"
+
+namespace nodev {
+
+class index_builder;
+
+typedef struct distVersion {
+  std::string version;  // without the leading "v"
+  std::string npm;
+  std::string lts;      // codename, empty when not an LTS release
+  std::string date;
+  std::vector<std::string> files;
+} distVersion;
+
+/*
+ * Local copy of the mirror's index.json in a compact binary file: a fixed
+ * size record per release, sorted newest first, followed by a string pool.
+ * Lookups never touch the network; refresh_request() builds a conditional
+ * GET so the index is only downloaded again when it really changed.
+ */
+class dist_index {
+ public:
+  dist_index(const std::string& path);
+
+  // a cached index was found
+  bool loaded() const;
+  // the cached index is older than NODEV_INDEX_TTL
+  bool stale() const;
+  bool find(const std::string& version, distVersion* out) const;
+  // exact versions, "latest", "lts/*", "lts/<codename>", "18" or "18.2";
+  // returns "" when nothing matches
+  std::string resolve(const std::string& alias) const;
+
+  // GET of `mirror`/index.json, conditional when something is cached; the
+  // body is parsed as it arrives and never held as a whole
+  fetchRequest* refresh_request(const std::string& mirror);
+  // takes the response of refresh_request(), rebuilds and saves the index
+  bool update(const fetchRequest* request);
+  // refresh_request(), fetch_all() and update() in one go, `history` as
+  // in fetch_all(), `timeout` as in fetchRequest
+  bool refresh(const std::string& mirror, const std::string& history = "", long timeout = 0);
+
+  // "18.2.0" or "v18.2.0"
+  static bool is_version(const std::string& version);
+
+ private:
+  dist_index();
+  bool load();
+  bool save() const;
+  bool build(const std::string& etag, const std::string& last_modified);
+  const char* str(uint32_t offset) const;
+  distVersion record(std::size_t i) const;
+
+  std::string path_;
+  std::string data_;
+  // parses the body of the pending refresh_request()
+  std::shared_ptr<index_builder> builder_;
+};
+
+}
+
+#endif
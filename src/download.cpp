@@ -1,16 +1,64 @@
 #include "download.hpp"
 
 #include <sstream>
+#include <vector>
 #include <cmath>
 #include <cstddef>
 #include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <random>
+#include <thread>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <Windows.h>
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <sys/stat.h>
+#endif
 
 #include "toyo/path.hpp"
 #include "toyo/fs.hpp"
 #include "toyo/charset.hpp"
+#include "net_stats.hpp"
+
+#define NODEV_SEGMENT_MIN_SIZE (1024 * 1024)
+#define NODEV_SEGMENT_MAX_RETRY 3
+// a transfer slower than this for NODEV_LOW_SPEED_TIME seconds is given up,
+// and continued from the next mirror if there is one
+#define NODEV_LOW_SPEED_LIMIT 1024
+#define NODEV_LOW_SPEED_TIME 20
+// first and longest wait between retry rounds, in milliseconds
+#define NODEV_RETRY_BASE_DELAY 1000
+#define NODEV_RETRY_MAX_DELAY 30000
+// stdio buffer of every file being downloaded to, so that the small chunks
+// curl hands over reach the disk in few large writes
+#define NODEV_WRITE_BUFFER_SIZE (1024 * 1024)
+#define NODEV_RECEIVE_BUFFER_SIZE (256 * 1024)
+// how often the ranges of a segmented download are saved for resuming
+#define NODEV_CHECKPOINT_INTERVAL_MS 1000
 
 namespace nodev {
 
+// outcome of one attempt against one URL: a failed transfer is continued
+// from another mirror or retried later, a rejected one is not asked from
+// that mirror again, a fatal one can not be continued at all
+enum transfer_result { transfer_ok, transfer_failed, transfer_rejected, transfer_fatal };
+
+// worth asking again later: 5xx, 408 and 429, anything else means the
+// mirror does not have the file
+static bool transient_status(long code) {
+  return code >= 500 || code == 408 || code == 429;
+}
+
 //static size_t onDataString(void* buffer, size_t size, size_t nmemb, progressInfo * userp) {
 //  const char* d = (const char*)buffer;
 //  // userp->headerString.append(d, size * nmemb);
@@ -22,6 +70,238 @@ namespace nodev {
 //  return size * nmemb;
 //}
 
+static FILE* open_file(const std::string& path, const char* mode) {
+  FILE* fp = nullptr;
+#ifdef _WIN32
+  _wfopen_s(&fp, toyo::charset::a2w(path).c_str(), toyo::charset::a2w(mode).c_str());
+#else
+  fp = fopen(path.c_str(), mode);
+#endif
+  return fp;
+}
+
+static int seek_file(FILE* fp, curl_off_t offset) {
+#ifdef _WIN32
+  return _fseeki64(fp, offset, SEEK_SET);
+#else
+  return fseeko(fp, (off_t)offset, SEEK_SET);
+#endif
+}
+
+static FILE* open_output(const std::string& path, const char* mode) {
+  FILE* fp = open_file(path, mode);
+  if (fp != nullptr) setvbuf(fp, nullptr, _IOFBF, NODEV_WRITE_BUFFER_SIZE);
+  return fp;
+}
+
+// reserves the blocks of the first `len` bytes so that a full disk fails
+// before the transfer rather than near its end; with `keep_size` the file
+// size stays as it is and appending goes on as before. Only a lack of space
+// is an error, a file system that can not preallocate is written as usual
+static bool reserve_file(FILE* fp, curl_off_t len, bool keep_size) {
+#if defined(__linux__)
+  fflush(fp);
+  if (fallocate(fileno(fp), keep_size ? FALLOC_FL_KEEP_SIZE : 0, 0, (off_t)len) == 0) return true;
+  return errno != ENOSPC && errno != EFBIG;
+#else
+  (void)fp;
+  (void)len;
+  (void)keep_size;
+  return true;
+#endif
+}
+
+// the data reaches the disk before a rename publishes it under its final
+// name, a crash can not leave a truncated file there
+static bool sync_file(const std::string& path) {
+#ifdef _WIN32
+  int fd = _wopen(toyo::charset::a2w(path).c_str(), _O_RDWR | _O_BINARY);
+  if (fd == -1) return false;
+  bool ok = _commit(fd) == 0;
+  _close(fd);
+#else
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd == -1) return false;
+#if defined(__linux__)
+  bool ok = fdatasync(fd) == 0;
+#else
+  bool ok = fsync(fd) == 0;
+#endif
+  close(fd);
+#endif
+  return ok;
+}
+
+bool local_file(const std::string& url, std::string* path) {
+  std::string file;
+  if (url.compare(0, 7, "file://") == 0) {
+    file = url.substr(7);
+    // "file://localhost/srv/dist"
+    if (file.compare(0, 9, "localhost") == 0) file = file.substr(9);
+#ifdef _WIN32
+    // "file:///D:/dist"
+    if (file.length() > 2 && file[0] == '/' && file[2] == ':') file = file.substr(1);
+#endif
+    std::string decoded = "";
+    for (std::size_t i = 0; i < file.length(); i++) {
+      if (file[i] == '%' && i + 2 < file.length() && isxdigit((unsigned char)file[i + 1]) && isxdigit((unsigned char)file[i + 2])) {
+        decoded += (char)strtol(file.substr(i + 1, 2).c_str(), nullptr, 16);
+        i += 2;
+      } else {
+        decoded += file[i];
+      }
+    }
+    file = decoded;
+  } else if (url.find("://") == std::string::npos) {
+    file = url;
+  } else {
+    return false;
+  }
+  if (path != nullptr) *path = file;
+  return true;
+}
+
+// `from` to `to` with as little copying as the file systems allow: a hard
+// link on the same file system, then whatever toyo::fs::copy_file() finds
+// (a reflink, an in-kernel copy, user space). `linked` tells whether `to`
+// shares the data of `from`, nothing needs to be synced
+static bool place_file(const std::string& from, const std::string& to, bool* linked) {
+  *linked = false;
+#ifdef _WIN32
+  if (CreateHardLinkW(toyo::charset::a2w(to).c_str(), toyo::charset::a2w(from).c_str(), nullptr)) {
+    *linked = true;
+    return true;
+  }
+#else
+  if (link(from.c_str(), to.c_str()) == 0) {
+    *linked = true;
+    return true;
+  }
+#endif
+  try {
+    *linked = toyo::fs::copy_file(from, to) == toyo::fs::copy_method_clone;
+  } catch (const std::exception&) {
+    return false;
+  }
+  return true;
+}
+
+static void init_progress(progressInfo* info, const std::string& path, long size, downloadCallback callback, void* param) {
+  auto now = std::chrono::steady_clock::now();
+  auto aday = std::chrono::hours(24);
+
+  info->path = path;
+  info->curl = nullptr;
+  info->fp = nullptr;
+  info->size = size;
+  info->sum = 0;
+  info->speed = 0;
+  info->peak_speed = 0;
+  info->start_time = now;
+  info->end_time = now - aday;
+  info->end = false;
+  info->last_time = now - aday;
+  info->total = -1;
+  info->param = param;
+  info->code = -1;
+  info->callback = callback;
+  info->connections = 1;
+  info->writer = nullptr;
+  info->writer_param = nullptr;
+  info->writer_state = 0;
+  info->stream_pos = 0;
+  info->hash = nullptr;
+  info->hash512 = nullptr;
+  info->low_speed_limit = NODEV_LOW_SPEED_LIMIT;
+  info->low_speed_time = NODEV_LOW_SPEED_TIME;
+}
+
+// called at the end of every progress interval, before `speed` restarts
+static void sample_speed(progressInfo* info, std::chrono::steady_clock::time_point now) {
+  double seconds = std::chrono::duration<double>(now - info->last_time).count();
+  if (seconds > 0 && info->speed / seconds > info->peak_speed) {
+    info->peak_speed = info->speed / seconds;
+  }
+}
+
+// the transfer can end before the body does: the writer has everything it
+// needs and there is no hash to complete
+static bool stream_stopped(const progressInfo* info) {
+  return info->writer_state == 1 && info->hash == nullptr && info->hash512 == nullptr;
+}
+
+// the body is hashed as it arrives, by whichever digest is expected
+static bool hashing(const progressInfo* info) {
+  return info->hash != nullptr || info->hash512 != nullptr;
+}
+
+static void reset_hash(progressInfo* info) {
+  if (info->hash != nullptr) *(info->hash) = toyo::util::sha256();
+  if (info->hash512 != nullptr) *(info->hash512) = toyo::util::sha512();
+}
+
+static void update_hash(progressInfo* info, const void* data, std::size_t len) {
+  if (info->hash != nullptr) info->hash->update((const uint8_t*)data, (int)len);
+  if (info->hash512 != nullptr) info->hash512->update((const uint8_t*)data, (int)len);
+}
+
+static const char* hash_name(const progressInfo* info) {
+  return info->hash512 != nullptr ? "SHA512" : "SHA256";
+}
+
+// hands data that follows everything streamed so far to the hash and the
+// writer, returns false when the transfer should stop
+static bool feed_stream(progressInfo* info, const char* data, std::size_t len) {
+  update_hash(info, data, len);
+  if (info->writer != nullptr && info->writer_state == 0) {
+    info->writer_state = info->writer(data, len, info->writer_param);
+  }
+  info->stream_pos += len;
+  return info->writer_state != -1 && !stream_stopped(info);
+}
+
+static bool hash_file(progressInfo* info, const std::string& path, curl_off_t len) {
+  FILE* fp = open_file(path, "rb");
+  if (fp == nullptr) return false;
+  std::vector<unsigned char> buf(256 * 1024);
+  while (len > 0) {
+    std::size_t n = len < (curl_off_t)buf.size() ? (std::size_t)len : buf.size();
+    std::size_t read = fread(buf.data(), 1, n, fp);
+    if (read == 0) break;
+    update_hash(info, buf.data(), read);
+    len -= read;
+  }
+  fclose(fp);
+  return len == 0;
+}
+
+// the body must be streamed to the end for the digest to mean anything
+static bool check_hash(progressInfo* info, curl_off_t total, const std::string& expected, std::string* error) {
+  if (!hashing(info)) return true;
+  if (total >= 0 && info->stream_pos != total) {
+    *error = "Incomplete body: " + info->path;
+    return false;
+  }
+  std::string actual = info->hash != nullptr ? info->hash->digest() : info->hash512->digest();
+  if (actual != expected) {
+    *error = std::string(hash_name(info)) + " mismatch: " + info->path + "\n  expected " + expected + "\n  actual   " + actual;
+    return false;
+  }
+  return true;
+}
+
+static void setup_request(CURL* curl, const std::string& url, struct curl_slist* headers, const progressInfo* info) {
+  curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+  curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+  curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 10);
+  curl_easy_setopt(curl, CURLOPT_BUFFERSIZE, (long)NODEV_RECEIVE_BUFFER_SIZE);
+  curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, info->low_speed_limit);
+  curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, info->low_speed_time);
+  curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1);
+  curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
+  curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L);
+}
+
 static size_t onDataWrite(void* buffer, size_t size, size_t nmemb, progressInfo * userp) {
   if (userp->code == -1) {
     curl_easy_getinfo(userp->curl, CURLINFO_RESPONSE_CODE, &(userp->code));
@@ -29,6 +309,10 @@ static size_t onDataWrite(void* buffer, size_t size, size_t nmemb, progressInfo
   if (userp->code >= 400) {
     return size * nmemb;
   }
+  if (userp->size > 0 && userp->code == 200 && userp->writer != nullptr) {
+    // the range was ignored, a stream can not start over
+    return 0;
+  }
 
   if (userp->total == -1) {
     curl_off_t cl;
@@ -38,27 +322,34 @@ static size_t onDataWrite(void* buffer, size_t size, size_t nmemb, progressInfo
     }
   }
 
-  if (userp->fp == nullptr) {
-    toyo::fs::mkdirs(toyo::path::dirname(userp->path));
-#ifdef _WIN32
-    _wfopen_s(&(userp->fp), (toyo::charset::a2w(userp->path) + L".tmp").c_str(), L"ab+");
-#else
-    userp->fp = fopen((userp->path + ".tmp").c_str(), "ab+");
-#endif
-    if (!(userp->fp)) {
-      return size * nmemb;
+  size_t iRec = 0;
+  if (userp->writer != nullptr) {
+    if (!feed_stream(userp, (const char*)buffer, size * nmemb)) {
+      return 0;
+    }
+    iRec = size * nmemb;
+  } else {
+    // opened by the header callback
+    if (userp->fp == nullptr) {
+      userp->writer_state = -1;
+      return 0;
     }
-  }
 
-  size_t iRec = fwrite(buffer, size, nmemb, userp->fp);
+    iRec = fwrite(buffer, 1, size * nmemb, userp->fp);
+    if (iRec != size * nmemb) {
+      userp->writer_state = -1;
+      return 0;
+    }
+    update_hash(userp, buffer, iRec);
+  }
 
   userp->sum += iRec;
   userp->speed += iRec;
   auto now = std::chrono::steady_clock::now();
   if ((now - userp->last_time) > std::chrono::milliseconds(200)) {
+    sample_speed(userp, now);
     userp->last_time = now;
     userp->speed = 0;
-    fflush(userp->fp);
     if (userp->callback) {
       userp->callback(userp, userp->param);
     }
@@ -78,15 +369,654 @@ static int onClose(progressInfo* userp, curl_socket_t item) {
   return 0;
 }
 
-bool download (const std::string& url, const std::string& path, downloadCallback callback, void* param, char* msg) {
-  if (toyo::fs::exists(path)) {
-    if (toyo::fs::stat(path).is_directory()) {
+/* resume */
+
+// the headers of the last response of a redirect chain
+typedef struct responseInfo {
+  long code;
+  bool accept_ranges;
+  std::string etag;
+  std::string last_modified;
+  curl_off_t range_start;   // of Content-Range, -1 without one
+  curl_off_t length;        // complete length of Content-Range or Content-Length
+} responseInfo;
+
+// what `path`.tmp was downloaded from, kept in `path`.tmp.resume so that a
+// later attempt only continues it when the server still has the same file
+typedef struct resumeInfo {
+  std::string origin;
+  std::string validator;
+  curl_off_t total;
+  std::string digest;   // expected SHA-256 or SHA-512, empty when unknown
+} resumeInfo;
+
+static void reset_response(responseInfo* res) {
+  res->code = -1;
+  res->accept_ranges = false;
+  res->etag = "";
+  res->last_modified = "";
+  res->range_start = -1;
+  res->length = -1;
+}
+
+// returns true on the empty line that ends the headers
+static bool parse_header(const char* buffer, size_t len, responseInfo* res) {
+  std::string line(buffer, len);
+  if (line.compare(0, 5, "HTTP/") == 0) {
+    // every response of a redirect chain starts over
+    reset_response(res);
+    std::size_t sp = line.find(' ');
+    if (sp != std::string::npos) res->code = atol(line.c_str() + sp + 1);
+    return false;
+  }
+  std::size_t colon = line.find(':');
+  if (colon == std::string::npos) {
+    return line.find_first_not_of("\r\n") == std::string::npos;
+  }
+  std::string name = line.substr(0, colon);
+  for (std::size_t i = 0; i < name.length(); i++) {
+    name[i] = (char)tolower((unsigned char)name[i]);
+  }
+  std::size_t begin = line.find_first_not_of(" \t", colon + 1);
+  std::size_t end = line.find_last_not_of(" \t\r\n");
+  std::string value = begin == std::string::npos || end < begin ? "" : line.substr(begin, end - begin + 1);
+
+  if (name == "accept-ranges") {
+    res->accept_ranges = value.find("bytes") != std::string::npos;
+  } else if (name == "etag") {
+    res->etag = value;
+  } else if (name == "last-modified") {
+    res->last_modified = value;
+  } else if (name == "content-range") {
+    // bytes 100-199/1000
+    long long first = -1, last = -1, complete = -1;
+    if (sscanf(value.c_str(), "bytes %lld-%lld/%lld", &first, &last, &complete) == 3) {
+      res->range_start = (curl_off_t)first;
+      res->length = (curl_off_t)complete;
+    }
+  } else if (name == "content-length" && res->range_start == -1) {
+    res->length = (curl_off_t)atoll(value.c_str());
+  }
+  return false;
+}
+
+// a strong ETag, or else Last-Modified; a weak ETag can not be used in If-Range
+static std::string validator_of(const responseInfo* res) {
+  if (!res->etag.empty() && res->etag.compare(0, 2, "W/") != 0) return res->etag;
+  return res->last_modified;
+}
+
+static bool load_resume(const std::string& path, resumeInfo* resume) {
+  std::string content;
+  try {
+    content = toyo::fs::read_file_to_string(path + ".tmp.resume");
+  } catch (const std::exception&) {
+    return false;
+  }
+  std::istringstream in(content);
+  std::string total;
+  if (!std::getline(in, resume->origin) || !std::getline(in, resume->validator) || !std::getline(in, total)) {
+    return false;
+  }
+  resume->total = (curl_off_t)atoll(total.c_str());
+  // written by older versions without it
+  if (!std::getline(in, resume->digest)) resume->digest = "";
+  return resume->total > 0;
+}
+
+static void save_resume(const std::string& path, const resumeInfo& resume) {
+  try {
+    toyo::fs::mkdirs(toyo::path::dirname(path));
+    toyo::fs::write_file(path + ".tmp.resume", resume.origin + "\n" + resume.validator + "\n" + std::to_string(resume.total) + "\n" + resume.digest + "\n");
+  } catch (const std::exception&) {
+    // without it the next run starts over
+  }
+}
+
+static void discard_tmp(const std::string& path) {
+  toyo::fs::remove(path + ".tmp");
+  toyo::fs::remove(path + ".tmp.seg");
+  toyo::fs::remove(path + ".tmp.resume");
+}
+
+// an earlier .tmp is only continued when the server provably still has the
+// same file: the same validator from the same mirror, or, as mirrors do not
+// share validators, the same length and the same expected digest from
+// another one; a length alone could splice two files
+static bool same_file(const resumeInfo& saved, const std::string& origin, const std::string& validator, curl_off_t total, const std::string& digest) {
+  if (saved.origin == origin && !saved.validator.empty()) {
+    return saved.validator == validator && saved.total == total;
+  }
+  return saved.total > 0 && saved.total == total && !digest.empty() && saved.digest == digest;
+}
+
+/* segmented download */
+
+typedef struct segmentInfo {
+  CURL* curl;
+  FILE* fp;
+  curl_off_t pos;   // next byte to write
+  curl_off_t end;   // last byte of the range, inclusive
+  long code;
+  int retry;
+  progressInfo* info;
+} segmentInfo;
+
+static size_t onProbeHeader(char* buffer, size_t size, size_t nitems, responseInfo* probe) {
+  parse_header(buffer, size * nitems, probe);
+  return size * nitems;
+}
+
+static bool probe_ranges(const std::string& url, struct curl_slist* headers, const progressInfo* info, curl_off_t* total, std::string* validator) {
+  CURL* curl = curl_easy_init();
+  responseInfo probe;
+  reset_response(&probe);
+
+  setup_request(curl, url, headers, info);
+  curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
+  curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, &onProbeHeader);
+  curl_easy_setopt(curl, CURLOPT_HEADERDATA, &probe);
+
+  CURLcode code = curl_easy_perform(curl);
+  long status = 0;
+  curl_off_t cl = -1;
+  if (code == CURLE_OK) {
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+    curl_easy_getinfo(curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &cl);
+  }
+  curl_easy_cleanup(curl);
+
+  *total = cl;
+  *validator = validator_of(&probe);
+  return code == CURLE_OK && status == 200 && probe.accept_ranges && cl > 0;
+}
+
+static size_t onSegmentWrite(void* buffer, size_t size, size_t nmemb, segmentInfo* seg) {
+  size_t len = size * nmemb;
+  if (seg->code == -1) {
+    curl_easy_getinfo(seg->curl, CURLINFO_RESPONSE_CODE, &(seg->code));
+  }
+  if (seg->code != 206 || seg->pos > seg->end) {
+    // the server ignored the range, or the range was shortened by a split
+    return 0;
+  }
+
+  curl_off_t room = seg->end - seg->pos + 1;
+  size_t n = (curl_off_t)len > room ? (size_t)room : len;
+  curl_off_t at = seg->pos;
+  size_t written = fwrite(buffer, 1, n, seg->fp);
+  seg->pos += written;
+  seg->info->sum += (long)written;
+  seg->info->speed += (int)written;
+
+  // the head of the file is streamed as it arrives
+  if (at == seg->info->stream_pos && (seg->info->writer != nullptr || hashing(seg->info))) {
+    if (!feed_stream(seg->info, (const char*)buffer, written)) return 0;
+  }
+
+  return written == len ? len : 0;
+}
+
+// streams the part of the file that is complete on disk but has not been
+// streamed yet, that is everything up to the next missing range
+static bool catch_up_stream(progressInfo* info, const std::vector<segmentInfo*>& segs, const std::string& tmp, curl_off_t total) {
+  if (info->writer == nullptr && !hashing(info)) return true;
+  if (info->writer_state == -1 || stream_stopped(info)) return true;
+
+  curl_off_t limit = total;
+  for (std::size_t i = 0; i < segs.size(); i++) {
+    if (segs[i]->pos <= segs[i]->end && segs[i]->end >= info->stream_pos && segs[i]->pos < limit) {
+      limit = segs[i]->pos;
+    }
+  }
+  if (limit <= info->stream_pos) return true;
+
+  for (std::size_t i = 0; i < segs.size(); i++) {
+    if (segs[i]->fp != nullptr) fflush(segs[i]->fp);
+  }
+  FILE* fp = open_file(tmp, "rb");
+  if (fp == nullptr) return false;
+  if (seek_file(fp, info->stream_pos) != 0) {
+    fclose(fp);
+    return false;
+  }
+  std::vector<char> buf(256 * 1024);
+  bool ok = true;
+  while (info->stream_pos < limit && info->writer_state != -1 && !stream_stopped(info)) {
+    curl_off_t left = limit - info->stream_pos;
+    std::size_t n = left < (curl_off_t)buf.size() ? (std::size_t)left : buf.size();
+    std::size_t read = fread(buf.data(), 1, n, fp);
+    if (read == 0) {
+      ok = false;
+      break;
+    }
+    feed_stream(info, buf.data(), read);
+  }
+  fclose(fp);
+  return ok;
+}
+
+static void save_segments(const std::string& segfile, curl_off_t total, const std::vector<segmentInfo*>& segs) {
+  // a saved position must never be ahead of what reached the file, or a
+  // resume after a crash would keep a hole
+  for (std::size_t i = 0; i < segs.size(); i++) {
+    if (segs[i]->fp != nullptr) fflush(segs[i]->fp);
+  }
+  std::ostringstream out;
+  out << total << "\n";
+  for (std::size_t i = 0; i < segs.size(); i++) {
+    if (segs[i]->pos <= segs[i]->end) {
+      out << segs[i]->pos << " " << segs[i]->end << "\n";
+    }
+  }
+  try {
+    toyo::fs::write_file(segfile, out.str());
+  } catch (const std::exception&) {
+    // resume information is best effort
+  }
+}
+
+static bool load_segments(const std::string& segfile, curl_off_t total, std::vector<segmentInfo*>& segs) {
+  std::string content;
+  try {
+    content = toyo::fs::read_file_to_string(segfile);
+  } catch (const std::exception&) {
+    return false;
+  }
+  std::istringstream in(content);
+  curl_off_t saved_total = -1;
+  if (!(in >> saved_total) || saved_total != total) {
+    return false;
+  }
+  curl_off_t pos, end;
+  while (in >> pos >> end) {
+    if (pos < 0 || end >= total || pos > end) {
       return false;
     }
+    segmentInfo* seg = new segmentInfo();
+    seg->pos = pos;
+    seg->end = end;
+    segs.push_back(seg);
+  }
+  return true;
+}
+
+static bool grow_file(const std::string& path, curl_off_t total) {
+  if (toyo::fs::exists(path) && toyo::fs::stat(path).size >= (long)total) {
     return true;
   }
+  FILE* fp = open_file(path, "rb+");
+  if (fp == nullptr) {
+    fp = open_file(path, "wb+");
+    if (fp == nullptr) return false;
+  }
+  // allocated for real rather than sparse, the ranges then fill it in place
+  bool ok = reserve_file(fp, total, false) &&
+    seek_file(fp, total - 1) == 0 && fputc(0, fp) != EOF;
+  fclose(fp);
+  return ok;
+}
 
-  CURL* curl = curl_easy_init();
+static segmentInfo* split_segment(std::vector<segmentInfo*>& segs) {
+  segmentInfo* largest = nullptr;
+  curl_off_t remaining = 0;
+  for (std::size_t i = 0; i < segs.size(); i++) {
+    curl_off_t r = segs[i]->end - segs[i]->pos + 1;
+    if (r > remaining) {
+      remaining = r;
+      largest = segs[i];
+    }
+  }
+  if (largest == nullptr || remaining < 2 * NODEV_SEGMENT_MIN_SIZE) {
+    return nullptr;
+  }
+
+  segmentInfo* seg = new segmentInfo();
+  seg->pos = largest->pos + remaining / 2;
+  seg->end = largest->end;
+  largest->end = seg->pos - 1;
+  segs.push_back(seg);
+  return seg;
+}
+
+static bool start_segment(CURLM* multi, segmentInfo* seg, const std::string& url, const std::string& tmp, struct curl_slist* headers) {
+  seg->fp = open_output(tmp, "rb+");
+  if (seg->fp == nullptr) {
+    return false;
+  }
+  if (seek_file(seg->fp, seg->pos) != 0) {
+    fclose(seg->fp);
+    seg->fp = nullptr;
+    return false;
+  }
+
+  seg->curl = curl_easy_init();
+  seg->code = -1;
+  setup_request(seg->curl, url, headers, seg->info);
+  std::string range = std::to_string(seg->pos) + "-" + std::to_string(seg->end);
+  curl_easy_setopt(seg->curl, CURLOPT_RANGE, range.c_str());
+  curl_easy_setopt(seg->curl, CURLOPT_WRITEFUNCTION, &onSegmentWrite);
+  curl_easy_setopt(seg->curl, CURLOPT_WRITEDATA, seg);
+  curl_easy_setopt(seg->curl, CURLOPT_PRIVATE, seg);
+  curl_multi_add_handle(multi, seg->curl);
+  return true;
+}
+
+static void stop_segment(CURLM* multi, segmentInfo* seg) {
+  if (seg->curl != nullptr) {
+    curl_multi_remove_handle(multi, seg->curl);
+    curl_easy_cleanup(seg->curl);
+    seg->curl = nullptr;
+  }
+  if (seg->fp != nullptr) {
+    fclose(seg->fp);
+    seg->fp = nullptr;
+  }
+}
+
+static transfer_result download_segmented(const std::string& url, const std::string& path, curl_off_t total, const std::string& validator, struct curl_slist* headers, progressInfo* info, int connections, bool failover, const std::string& digest, transferStats* stats, char* msg) {
+  std::string tmp = path + ".tmp";
+  std::string segfile = path + ".tmp.seg";
+  std::vector<segmentInfo*> segs;
+
+  toyo::fs::mkdirs(toyo::path::dirname(path));
+
+  resumeInfo resume;
+  bool same = load_resume(path, &resume) && same_file(resume, net_stats::mirror_of(url), validator, total, digest);
+  bool resumed = same && toyo::fs::exists(segfile) && toyo::fs::exists(tmp) &&
+    toyo::fs::stat(tmp).size == (long)total && load_segments(segfile, total, segs);
+  if (!resumed) {
+    for (std::size_t i = 0; i < segs.size(); i++) delete segs[i];
+    segs.clear();
+    curl_off_t done = 0;
+    if (info->stream_pos > 0 && info->writer != nullptr) {
+      // an earlier single stream fed the writer up to `stream_pos`, the
+      // ranges go on from there when it is the same file
+      if (!same || info->stream_pos >= total) {
+        if (msg != nullptr) {
+          strcpy(msg, std::string("The file changed on the server: " + url).c_str());
+        }
+        return transfer_fatal;
+      }
+      toyo::fs::remove(tmp);
+      done = info->stream_pos;
+    } else {
+      if (info->stream_pos > 0) {
+        // the hash starts over with the file
+        reset_hash(info);
+        info->stream_pos = 0;
+      }
+      if (same && !toyo::fs::exists(segfile) && toyo::fs::exists(tmp)) {
+        // continue a partial single stream download
+        done = toyo::fs::stat(tmp).size;
+        if (done >= total) done = 0;
+      } else {
+        toyo::fs::remove(tmp);
+      }
+    }
+    segmentInfo* seg = new segmentInfo();
+    seg->pos = done;
+    seg->end = total - 1;
+    segs.push_back(seg);
+  }
+
+  if (!grow_file(tmp, total)) {
+    for (std::size_t i = 0; i < segs.size(); i++) delete segs[i];
+    if (msg != nullptr) {
+      strcpy(msg, std::string("Can not allocate " + std::to_string(total) + " bytes for: " + tmp).c_str());
+    }
+    return transfer_fatal;
+  }
+
+  curl_off_t remaining = 0;
+  for (std::size_t i = 0; i < segs.size(); i++) {
+    segs[i]->curl = nullptr;
+    segs[i]->fp = nullptr;
+    segs[i]->code = -1;
+    segs[i]->retry = 0;
+    segs[i]->info = info;
+    remaining += segs[i]->end - segs[i]->pos + 1;
+  }
+  info->size = (long)(total - remaining);
+  info->total = (long)total;
+  resume.origin = net_stats::mirror_of(url);
+  resume.validator = validator;
+  resume.total = total;
+  resume.digest = digest;
+  save_resume(path, resume);
+  save_segments(segfile, total, segs);
+
+  CURLM* multi = curl_multi_init();
+
+  // start with two connections and keep adding one while the measured
+  // throughput still grows, up to `connections`
+  int target = connections < 2 ? connections : 2;
+  bool grow = target < connections;
+  int active = 0;
+  bool failed = false;
+  bool fatal = false;
+  std::string error = "";
+  auto window_start = std::chrono::steady_clock::now();
+  auto last_checkpoint = window_start;
+  long window_sum = 0;
+  double last_rate = 0;
+
+  while (true) {
+    int running = 0;
+    curl_multi_perform(multi, &running);
+
+    int left = 0;
+    CURLMsg* m = nullptr;
+    while ((m = curl_multi_info_read(multi, &left)) != nullptr) {
+      if (m->msg != CURLMSG_DONE) continue;
+      CURLcode result = m->data.result;
+      segmentInfo* seg = nullptr;
+      curl_easy_getinfo(m->easy_handle, CURLINFO_PRIVATE, (char**)&seg);
+      // the first range to finish stands for the connection setup
+      if (stats->url.empty()) collect_transfer_stats(m->easy_handle, stats);
+      stop_segment(multi, seg);
+      active--;
+      if (seg->pos > seg->end || info->writer_state == -1 || stream_stopped(info)) {
+        continue;
+      }
+      // a range that got too slow is better continued from another mirror
+      bool collapsed = result == CURLE_OPERATION_TIMEDOUT && failover;
+      if ((seg->code == 206 || seg->code == -1) && !collapsed && seg->retry < NODEV_SEGMENT_MAX_RETRY) {
+        seg->retry++;
+        continue;
+      }
+      failed = true;
+      error = result != CURLE_OK && result != CURLE_WRITE_ERROR ?
+        std::string(curl_easy_strerror(result)) + ": " + url :
+        "[" + std::to_string(seg->code) + "] " + url;
+    }
+    if (!failed && !catch_up_stream(info, segs, tmp, total)) {
+      failed = fatal = true;
+      error = "Can not read file: " + tmp;
+    }
+    if (!failed && info->writer_state == -1) {
+      failed = fatal = true;
+      error = "Write failed: " + url;
+    }
+    if (failed || stream_stopped(info)) break;
+
+    // keep `target` connections busy, steal half of the largest range
+    // when every range is already in flight
+    while (active < target) {
+      segmentInfo* next = nullptr;
+      for (std::size_t i = 0; i < segs.size(); i++) {
+        if (segs[i]->curl == nullptr && segs[i]->pos <= segs[i]->end) {
+          next = segs[i];
+          break;
+        }
+      }
+      if (next == nullptr) next = split_segment(segs);
+      if (next == nullptr) break;
+      next->info = info;
+      if (!start_segment(multi, next, url, tmp, headers)) {
+        failed = fatal = true;
+        error = "Can not write file: " + tmp;
+        break;
+      }
+      active++;
+      if (active > stats->connections) stats->connections = active;
+    }
+    if (failed || active == 0) break;
+
+    auto now = std::chrono::steady_clock::now();
+    if ((now - info->last_time) > std::chrono::milliseconds(200)) {
+      sample_speed(info, now);
+      info->last_time = now;
+      info->speed = 0;
+      info->connections = active;
+      if ((now - last_checkpoint) > std::chrono::milliseconds(NODEV_CHECKPOINT_INTERVAL_MS)) {
+        last_checkpoint = now;
+        save_segments(segfile, total, segs);
+      }
+      if (info->callback) {
+        info->callback(info, info->param);
+      }
+    }
+    if (grow && (now - window_start) > std::chrono::seconds(1)) {
+      double seconds = std::chrono::duration<double>(now - window_start).count();
+      double rate = (double)(info->sum - window_sum) / seconds;
+      if (last_rate == 0 || rate > last_rate * 1.1) {
+        target++;
+        grow = target < connections;
+      } else {
+        grow = false;
+      }
+      last_rate = rate;
+      window_start = now;
+      window_sum = info->sum;
+    }
+
+    curl_multi_wait(multi, nullptr, 0, 200, nullptr);
+  }
+
+  for (std::size_t i = 0; i < segs.size(); i++) {
+    if (stats->url.empty() && segs[i]->curl != nullptr) collect_transfer_stats(segs[i]->curl, stats);
+    stop_segment(multi, segs[i]);
+  }
+  curl_multi_cleanup(multi);
+
+  info->end_time = std::chrono::steady_clock::now();
+  info->end = true;
+
+  if (failed) {
+    stats->result = error;
+    save_segments(segfile, total, segs);
+    for (std::size_t i = 0; i < segs.size(); i++) delete segs[i];
+    printf("\n%s\n", error.c_str());
+    if (msg != nullptr) {
+      strcpy(msg, std::string("Request failed: " + url).c_str());
+    }
+    return fatal ? transfer_fatal : transfer_failed;
+  }
+
+  for (std::size_t i = 0; i < segs.size(); i++) delete segs[i];
+  if (info->callback) {
+    info->callback(info, info->param);
+  }
+  toyo::fs::remove(segfile);
+  toyo::fs::remove(path + ".tmp.resume");
+  if (!check_hash(info, total, digest, &error)) {
+    toyo::fs::remove(tmp);
+    stats->result = std::string(hash_name(info)) + " mismatch";
+    printf("\n%s\n", error.c_str());
+    if (msg != nullptr) {
+      strcpy(msg, std::string("Verification failed: " + url).c_str());
+    }
+    return transfer_fatal;
+  }
+  if (info->writer != nullptr) {
+    toyo::fs::remove(tmp);
+  } else {
+    if (!sync_file(tmp)) {
+      if (msg != nullptr) {
+        strcpy(msg, std::string("Can not write file: " + tmp).c_str());
+      }
+      return transfer_fatal;
+    }
+    toyo::fs::rename(tmp, path);
+  }
+  return transfer_ok;
+}
+
+typedef struct singleResponse {
+  responseInfo response;
+  progressInfo* info;
+  std::string path;
+  std::string origin;
+  resumeInfo saved;
+  std::string digest;
+  curl_off_t offset;
+  bool if_range;
+  // the partial body belongs to another file
+  bool changed;
+  // the body does not fit on the disk
+  bool no_space;
+} singleResponse;
+
+// opens `path`.tmp once the headers of a successful response are in, before
+// any of the body arrives: a full body to a range request starts the file
+// over, and the blocks of the whole file are reserved up front
+static bool open_body(singleResponse* res) {
+  progressInfo* info = res->info;
+  if (info->writer != nullptr || info->fp != nullptr) return true;
+  bool restart = info->size > 0 && res->response.code != 206;
+  toyo::fs::mkdirs(toyo::path::dirname(res->path));
+  info->fp = open_output(res->path + ".tmp", restart ? "wb" : "ab");
+  // no other mirror can help with the disk
+  if (info->fp == nullptr) {
+    info->writer_state = -1;
+    return false;
+  }
+  if (restart) {
+    reset_hash(info);
+    info->stream_pos = 0;
+    info->size = 0;
+  }
+  if (res->response.length > 0 && !reserve_file(info->fp, res->response.length, true)) {
+    res->no_space = true;
+    info->writer_state = -1;
+    return false;
+  }
+  return true;
+}
+
+static size_t onSingleHeader(char* buffer, size_t size, size_t nitems, singleResponse* res) {
+  if (!parse_header(buffer, size * nitems, &res->response)) return size * nitems;
+  long code = res->response.code;
+  if (code < 200 || code >= 300) return size * nitems;
+  if (code != 200 && code != 206) return open_body(res) ? size * nitems : 0;
+
+  std::string validator = validator_of(&res->response);
+  // a 206 to a request without a range only has to start at 0
+  if (code == 206 && (res->response.range_start != res->offset ||
+    (res->offset > 0 && !same_file(res->saved, res->origin, validator, res->response.length, res->digest)))) {
+    res->changed = true;
+    return 0;
+  }
+  if (code == 200 && res->offset > 0 && res->if_range && res->info->writer != nullptr) {
+    // If-Range did not match, a stream can not start over
+    res->changed = true;
+    return 0;
+  }
+  if (res->response.length > 0) {
+    resumeInfo resume;
+    resume.origin = res->origin;
+    resume.validator = validator;
+    resume.total = res->response.length;
+    resume.digest = res->digest;
+    save_resume(res->path, resume);
+  }
+  return open_body(res) ? size * nitems : 0;
+}
+
+// `changed` is set when the partial file turned out to belong to another
+// version of the file, which is then worth one fresh start
+static transfer_result download_single_once(const std::string& url, const std::string& path, progressInfo* info, const std::string& digest, transferStats* stats, char* msg, bool* changed) {
   struct curl_slist* headers = nullptr;
 
   /*headers = curl_slist_append(headers, "Connection: Keep-Alive");
@@ -94,88 +1024,414 @@ bool download (const std::string& url, const std::string& path, downloadCallback
   headers = curl_slist_append(headers, "Accept: */*");
   headers = curl_slist_append(headers, "User-Agent: Node Version Manager");
 
-  long size = 0;
-  try {
-    size = toyo::fs::stat(path + ".tmp").size;
-  } catch (const std::exception&) {
-    // ignore
+  if (toyo::fs::exists(path + ".tmp.seg")) {
+    // a preallocated segmented .tmp can not be continued by a single stream
+    toyo::fs::remove(path + ".tmp");
+    toyo::fs::remove(path + ".tmp.seg");
+    if (info->writer == nullptr) info->stream_pos = 0;
   }
 
-  if (size != 0) {
-    headers = curl_slist_append(headers, (std::string("Range: bytes=") + std::to_string(size) + "-").c_str());
+  singleResponse res;
+  reset_response(&res.response);
+  res.info = info;
+  res.path = path;
+  res.origin = net_stats::mirror_of(url);
+  res.digest = digest;
+  res.if_range = false;
+  res.changed = false;
+  res.no_space = false;
+  if (!load_resume(path, &res.saved)) {
+    res.saved.total = -1;
   }
 
-  curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+  // a writer continues where the previous attempt stopped, a file continues
+  // from what is on disk
+  curl_off_t offset = info->stream_pos;
+  if (info->writer == nullptr) {
+    offset = 0;
+    try {
+      offset = toyo::fs::stat(path + ".tmp").size;
+    } catch (const std::exception&) {
+      // ignore
+    }
+  }
+  if (offset != 0 && (res.saved.total <= 0 || offset >= res.saved.total)) {
+    // nothing tells which file the partial body belongs to
+    if (info->writer != nullptr) {
+      curl_slist_free_all(headers);
+      if (msg != nullptr) {
+        strcpy(msg, std::string("Can not continue: " + url).c_str());
+      }
+      return transfer_fatal;
+    }
+    discard_tmp(path);
+    offset = 0;
+  }
+  if (info->writer == nullptr) {
+    if (hashing(info)) {
+      // the part kept from an earlier run is hashed before the rest arrives
+      reset_hash(info);
+      if (offset != 0 && !hash_file(info, path + ".tmp", offset)) {
+        curl_slist_free_all(headers);
+        if (msg != nullptr) {
+          strcpy(msg, std::string("Can not read file: " + path + ".tmp").c_str());
+        }
+        return transfer_fatal;
+      }
+    }
+    info->stream_pos = offset;
+  }
+  res.offset = offset;
 
-  curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+  if (offset != 0) {
+    headers = curl_slist_append(headers, (std::string("Range: bytes=") + std::to_string(offset) + "-").c_str());
+    // the server sends the whole file instead when it changed
+    if (res.saved.origin == res.origin && !res.saved.validator.empty()) {
+      headers = curl_slist_append(headers, ("If-Range: " + res.saved.validator).c_str());
+      res.if_range = true;
+    }
+  }
 
+  CURL* curl = curl_easy_init();
+  setup_request(curl, url, headers, info);
   curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "GET");
-  curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 10);
-  curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1);
   //curl_easy_setopt(curl, CURLOPT_TIMEOUT, 10);
 
-  auto now = std::chrono::steady_clock::now();
-  auto aday = std::chrono::hours(24);
-  
-  progressInfo info;
-  info.path = path;
-  info.curl = curl;
-  info.fp = nullptr;
-  info.size = size;
-  info.sum = 0;
-  info.speed = 0;
-  info.start_time = now;
-  info.end_time = now - aday;
-  info.end = false;
-  info.last_time = now - aday;
-  info.total = -1;
-  info.param = param;
-  info.code = -1;
-  info.callback = callback;
-
-  // curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, &onDataString);
-  // curl_easy_setopt(curl, CURLOPT_HEADERDATA, &info);
+  info->curl = curl;
+  info->size = (long)offset;
+  info->sum = 0;
+  info->total = -1;
+  info->code = -1;
+  info->end = false;
 
+  curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, &onSingleHeader);
+  curl_easy_setopt(curl, CURLOPT_HEADERDATA, &res);
   curl_easy_setopt(curl, CURLOPT_CLOSESOCKETFUNCTION, &onClose);
-  curl_easy_setopt(curl, CURLOPT_CLOSESOCKETDATA, &info);
+  curl_easy_setopt(curl, CURLOPT_CLOSESOCKETDATA, info);
   curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, &onDataWrite);
-  curl_easy_setopt(curl, CURLOPT_WRITEDATA, &info);
-  curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
-  curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L);
+  curl_easy_setopt(curl, CURLOPT_WRITEDATA, info);
 
   CURLcode code = curl_easy_perform(curl);
+  // the writer got everything it needs
+  bool stopped = code == CURLE_WRITE_ERROR && stream_stopped(info);
+  curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &(info->code));
+  collect_transfer_stats(curl, stats);
+  curl_slist_free_all(headers);
+  curl_easy_cleanup(curl);
+  info->curl = nullptr;
 
-  if (code != CURLE_OK) {
-    printf("%s\n", curl_easy_strerror(code));
-    if (info.fp != nullptr) {
-      fclose(info.fp);
-      info.fp = nullptr;
+  if (info->fp != nullptr) {
+    fclose(info->fp);
+    info->fp = nullptr;
+  }
+
+  if (res.changed) {
+    stats->result = "Changed on the server";
+    if (msg != nullptr) {
+      strcpy(msg, std::string("The file changed on the server: " + url).c_str());
     }
-    curl_slist_free_all(headers);
-    curl_easy_cleanup(curl);
+    // a stream can not take the start of the file again
+    if (info->writer == nullptr) *changed = true;
+    return transfer_fatal;
+  }
+
+  if (res.no_space) {
+    stats->result = "Not enough disk space";
+    if (msg != nullptr) {
+      strcpy(msg, std::string("Not enough disk space for: " + path).c_str());
+    }
+    return transfer_fatal;
+  }
+
+  if (code != CURLE_OK && !stopped) {
+    stats->result = curl_easy_strerror(code);
+    printf("%s\n", curl_easy_strerror(code));
     if (msg != nullptr) {
       strcpy(msg, std::string("Request failed: " + url).c_str());
     }
-    return false;
+    return info->writer_state == -1 ? transfer_fatal : transfer_failed;
+  }
+
+  if (info->code >= 400 || (info->writer == nullptr && !toyo::fs::exists(path + ".tmp"))) {
+    stats->result = "HTTP " + std::to_string(info->code);
+    if (msg != nullptr) {
+      strcpy(msg, std::string("[" + std::to_string(info->code) + "] " + url).c_str());
+    }
+    return transient_status(info->code) ? transfer_failed : transfer_rejected;
+  }
+
+  std::string error;
+  if (!check_hash(info, -1, digest, &error)) {
+    if (info->writer == nullptr) discard_tmp(path);
+    stats->result = std::string(hash_name(info)) + " mismatch";
+    printf("\n%s\n", error.c_str());
+    if (msg != nullptr) {
+      strcpy(msg, std::string("Verification failed: " + url).c_str());
+    }
+    return transfer_fatal;
+  }
+
+  if (info->writer == nullptr) {
+    if (!sync_file(path + ".tmp")) {
+      if (msg != nullptr) {
+        strcpy(msg, std::string("Can not write file: " + path + ".tmp").c_str());
+      }
+      return transfer_fatal;
+    }
+    toyo::fs::rename(path + ".tmp", path);
+  }
+  toyo::fs::remove(path + ".tmp.resume");
+  return transfer_ok;
+}
+
+static transfer_result download_single(const std::string& url, const std::string& path, progressInfo* info, const std::string& digest, transferStats* stats, char* msg) {
+  bool changed = false;
+  transfer_result r = download_single_once(url, path, info, digest, stats, msg, &changed);
+  if (!changed) return r;
+  // once; a file that changes again is left to the next run
+  printf("\nThe file changed on the server, starting over\n");
+  discard_tmp(path);
+  info->stream_pos = 0;
+  changed = false;
+  return download_single_once(url, path, info, digest, stats, msg, &changed);
+}
+
+// a mirror on a local or mounted file system: the file is placed into the
+// cache by place_file(), and the hash and the writer read it straight from
+// the mirror, continuing where an earlier attempt stopped
+static transfer_result download_local(const std::string& url, const std::string& file, const std::string& path, progressInfo* info, const std::string& digest, transferStats* stats, char* msg) {
+  curl_off_t total = -1;
+  try {
+    toyo::fs::stats st = toyo::fs::stat(file);
+    if (!st.is_directory()) total = (curl_off_t)st.size;
+  } catch (const std::exception&) {
+    // not there
+  }
+  stats->url = url;
+  if (total < 0) {
+    stats->result = "No such file";
+    if (msg != nullptr) {
+      strcpy(msg, std::string("No such file: " + file).c_str());
+    }
+    return transfer_rejected;
   }
 
-  if (info.fp != nullptr) {
-    fclose(info.fp);
-    info.fp = nullptr;
-    if (toyo::fs::exists(path + ".tmp")) {
-      toyo::fs::rename(path + ".tmp", path);
+  info->size = 0;
+  info->sum = 0;
+  info->total = (long)total;
+  info->code = 200;
+  info->end = false;
+  stats->code = 200;
+
+  if (info->writer == nullptr) {
+    discard_tmp(path);
+    toyo::fs::mkdirs(toyo::path::dirname(path));
+    bool linked = false;
+    if (!place_file(file, path + ".tmp", &linked) || (!linked && !sync_file(path + ".tmp"))) {
+      toyo::fs::remove(path + ".tmp");
+      stats->result = "Can not copy";
+      if (msg != nullptr) {
+        strcpy(msg, std::string("Can not copy " + file + " to " + path + ".tmp").c_str());
+      }
+      return transfer_fatal;
     }
+    info->stream_pos = 0;
+    reset_hash(info);
   } else {
-    curl_slist_free_all(headers);
-    curl_easy_cleanup(curl);
+    info->size = (long)info->stream_pos;
+  }
+
+  if (hashing(info) || info->writer != nullptr) {
+    FILE* fp = open_file(file, "rb");
+    if (fp == nullptr || (info->stream_pos > 0 && seek_file(fp, info->stream_pos) != 0)) {
+      if (fp != nullptr) fclose(fp);
+      stats->result = "Can not read";
+      if (msg != nullptr) {
+        strcpy(msg, std::string("Can not read file: " + file).c_str());
+      }
+      return transfer_failed;
+    }
+    std::vector<char> buf(NODEV_WRITE_BUFFER_SIZE);
+    std::size_t n;
+    while ((n = fread(buf.data(), 1, buf.size(), fp)) > 0) {
+      bool more = feed_stream(info, buf.data(), n);
+      info->sum += (long)n;
+      info->speed += (int)n;
+      auto now = std::chrono::steady_clock::now();
+      if ((now - info->last_time) > std::chrono::milliseconds(200)) {
+        sample_speed(info, now);
+        info->last_time = now;
+        info->speed = 0;
+        if (info->callback) info->callback(info, info->param);
+      }
+      if (!more) break;
+    }
+    bool read_error = ferror(fp) != 0;
+    fclose(fp);
+    if (info->writer_state == -1) {
+      stats->result = "Writer failed";
+      if (msg != nullptr) {
+        strcpy(msg, std::string("Can not extract: " + file).c_str());
+      }
+      return transfer_fatal;
+    }
+    if (read_error) {
+      stats->result = "Can not read";
+      if (msg != nullptr) {
+        strcpy(msg, std::string("Can not read file: " + file).c_str());
+      }
+      return transfer_failed;
+    }
+  } else {
+    info->sum = (long)total;
+  }
+
+  std::string error;
+  if (!check_hash(info, total, digest, &error)) {
+    if (info->writer == nullptr) discard_tmp(path);
+    stats->result = std::string(hash_name(info)) + " mismatch";
+    printf("\n%s\n", error.c_str());
     if (msg != nullptr) {
-      strcpy(msg, std::string("[" + std::to_string(info.code) + "] " + url).c_str());
+      strcpy(msg, std::string("Verification failed: " + url).c_str());
     }
-    return false;
+    return transfer_fatal;
   }
-  curl_slist_free_all(headers);
-  curl_easy_cleanup(curl);
-  return true;
+
+  if (info->writer == nullptr) {
+    toyo::fs::rename(path + ".tmp", path);
+  }
+  info->end_time = std::chrono::steady_clock::now();
+  info->end = true;
+  if (info->callback) info->callback(info, info->param);
+  return transfer_ok;
+}
+
+// milliseconds before retry round `round`, between half and all of an
+// exponentially growing delay so that many clients do not retry in step
+static long backoff_delay(int round) {
+  long delay = NODEV_RETRY_MAX_DELAY;
+  if (round < 16) {
+    delay = (long)NODEV_RETRY_BASE_DELAY << (round - 1);
+    if (delay > NODEV_RETRY_MAX_DELAY) delay = NODEV_RETRY_MAX_DELAY;
+  }
+  std::random_device rd;
+  std::uniform_int_distribution<long> jitter(delay / 2, delay);
+  return jitter(rd);
+}
+
+// the timings come from one connection, the rest covers the whole attempt
+static void record_attempt(const std::string& history, const std::string& url, transfer_result r, const progressInfo* info, std::chrono::steady_clock::time_point start, transferStats* stats) {
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  if (stats->url.empty()) stats->url = url;
+  if (r == transfer_ok) {
+    stats->result = "ok";
+  } else if (stats->result.empty()) {
+    stats->result = "failed";
+  }
+  // every attempt starts counting from 0
+  stats->bytes = info->sum;
+  stats->total = (curl_off_t)(seconds * 1000000);
+  stats->avg_speed = seconds > 0 ? info->sum / seconds : 0;
+  // shorter than one progress interval
+  stats->peak_speed = info->peak_speed > stats->avg_speed ? info->peak_speed : stats->avg_speed;
+  net_stats(history).append(*stats);
+}
+
+bool download (const std::string& url, const std::string& path, downloadCallback callback, void* param, char* msg, const downloadOptions* options) {
+  downloadWriter writer = options != nullptr ? options->writer : nullptr;
+  if (writer == nullptr && toyo::fs::exists(path)) {
+    if (toyo::fs::stat(path).is_directory()) {
+      return false;
+    }
+    return true;
+  }
+
+  std::vector<std::string> urls(1, url);
+  if (options != nullptr) {
+    urls.insert(urls.end(), options->fallback_urls.begin(), options->fallback_urls.end());
+  }
+  std::string sha256 = options != nullptr ? options->sha256 : "";
+  std::string sha512 = options != nullptr && sha256.empty() ? options->sha512 : "";
+  std::string digest = sha256.empty() ? sha512 : sha256;
+  int connections = options != nullptr ? options->connections : 1;
+  int retries = options != nullptr ? options->retries : 0;
+
+  toyo::util::sha256 hash;
+  toyo::util::sha512 hash512;
+  progressInfo info;
+  init_progress(&info, path, 0, callback, param);
+  if (writer != nullptr) {
+    info.writer = writer;
+    info.writer_param = options->writer_param;
+  }
+  if (!sha256.empty()) info.hash = &hash;
+  if (!sha512.empty()) info.hash512 = &hash512;
+  if (options != nullptr && options->low_speed_limit > 0) info.low_speed_limit = options->low_speed_limit;
+  if (options != nullptr && options->low_speed_time > 0) info.low_speed_time = options->low_speed_time;
+
+  // every mirror continues from where the previous one stopped; when all of
+  // them failed the next round starts after a jittered exponential backoff
+  std::vector<bool> rejected(urls.size(), false);
+  transfer_result r = transfer_failed;
+  bool first = true;
+  for (int round = 0; round <= retries && r == transfer_failed; round++) {
+    if (round > 0) {
+      if (std::find(rejected.begin(), rejected.end(), false) == rejected.end()) break;
+      long delay = backoff_delay(round);
+      printf("\nRetrying in %.1fs (%d/%d)\n", delay / 1000.0, round, retries);
+      std::this_thread::sleep_for(std::chrono::milliseconds(delay));
+    }
+    for (std::size_t i = 0; i < urls.size() && r == transfer_failed; i++) {
+      if (rejected[i]) continue;
+      if (!first) {
+        printf("\nContinuing from %s\n", urls[i].c_str());
+      }
+      first = false;
+      bool failover = i + 1 < urls.size() || round < retries;
+      bool segmented = false;
+      transferStats stats;
+      init_transfer_stats(&stats);
+      auto attempt_start = std::chrono::steady_clock::now();
+      info.peak_speed = 0;
+      std::string file;
+      bool local = local_file(urls[i], &file);
+      if (local) {
+        info.start_time = std::chrono::steady_clock::now();
+        r = download_local(urls[i], file, path, &info, digest, &stats, msg);
+      } else if (connections > 1) {
+        struct curl_slist* headers = nullptr;
+        headers = curl_slist_append(headers, "Accept: */*");
+        headers = curl_slist_append(headers, "User-Agent: Node Version Manager");
+        curl_off_t total = -1;
+        std::string validator = "";
+        if (probe_ranges(urls[i], headers, &info, &total, &validator) && total >= 2 * NODEV_SEGMENT_MIN_SIZE) {
+          // a range of a file that changed since the probe fails instead
+          // of being mixed with the others
+          if (!validator.empty()) {
+            headers = curl_slist_append(headers, ("If-Range: " + validator).c_str());
+          }
+          segmented = true;
+          info.start_time = std::chrono::steady_clock::now();
+          info.sum = 0;
+          info.end = false;
+          r = download_segmented(urls[i], path, total, validator, headers, &info, connections, failover, digest, &stats, msg);
+        }
+        curl_slist_free_all(headers);
+      }
+      if (!local && !segmented) {
+        r = download_single(urls[i], path, &info, digest, &stats, msg);
+      }
+      // the history is about the network
+      if (!local && options != nullptr && !options->history.empty()) {
+        record_attempt(options->history, urls[i], r, &info, attempt_start, &stats);
+      }
+      if (r == transfer_rejected) {
+        rejected[i] = true;
+        r = transfer_failed;
+      }
+    }
+  }
+  return r == transfer_ok;
 }
 
 }
@@ -3,7 +3,10 @@
 
 #include <string>
 #include <chrono>
+#include <cstddef>
+#include <vector>
 #include "curl/curl.h"
+#include "toyo/util.hpp"
 
 namespace nodev {
 
@@ -11,6 +14,10 @@ typedef struct progressInfo progressInfo;
 
 typedef void (*downloadCallback)(progressInfo*, void*);
 
+// receives the response body in order, returns 0 to continue, 1 when
+// nothing more is needed and -1 on error
+typedef int (*downloadWriter)(const char*, std::size_t, void*);
+
 typedef struct progressInfo {
   CURL* curl;
   FILE* fp;
@@ -18,6 +25,8 @@ typedef struct progressInfo {
   long sum;
   long total;
   int speed;
+  // best throughput of a progress interval so far, bytes per second
+  double peak_speed;
   bool end;
   std::chrono::steady_clock::time_point start_time;
   std::chrono::steady_clock::time_point last_time;
@@ -26,9 +35,53 @@ typedef struct progressInfo {
   downloadCallback callback;
   void* param;
   long code;
+  int connections;
+  downloadWriter writer;
+  void* writer_param;
+  int writer_state;
+  curl_off_t stream_pos;
+  // of the body, at most one of them is set
+  toyo::util::sha256* hash;
+  toyo::util::sha512* hash512;
+  // a transfer below `low_speed_limit` bytes per second for
+  // `low_speed_time` seconds is given up
+  long low_speed_limit;
+  long low_speed_time;
 } progressInfo;
 
-bool download (const std::string& url, const std::string& path, downloadCallback callback, void* param, char* msg = nullptr);
+typedef struct downloadOptions {
+  // upper bound of parallel range requests, 1 disables segmented download
+  int connections;
+  // when set, the body is handed to the writer and nothing is left at
+  // `path`; a segmented download still keeps `path`.tmp as scratch space
+  // for out-of-order ranges and removes it once done
+  downloadWriter writer;
+  void* writer_param;
+  // expected SHA-256 of the body in lowercase hex, computed while the data
+  // arrives; on mismatch the download fails and the .tmp is discarded
+  std::string sha256;
+  // the same for SHA-512 (128 hex digits), used when `sha256` is empty
+  std::string sha512;
+  // the same file on other mirrors, tried in order when a transfer fails
+  // or stalls; each one continues from where the previous one stopped
+  std::vector<std::string> fallback_urls;
+  // every attempt is appended to this net_stats history when set
+  std::string history;
+  // rounds over all mirrors after the first one fails, with a jittered
+  // exponential backoff in between; a partial file is continued only when
+  // its ETag / Last-Modified still match (If-Range)
+  int retries;
+  // 0 keeps the defaults, 1 KB/s for 20 seconds
+  long low_speed_limit;
+  long low_speed_time;
+} downloadOptions;
+
+// "file:///srv/dist/..." or a plain path such as "/srv/dist/..." names a
+// file on a local or mounted file system, which download() links or copies
+// instead of transferring; `path` receives the file system path
+bool local_file(const std::string& url, std::string* path);
+
+bool download (const std::string& url, const std::string& path, downloadCallback callback, void* param, char* msg = nullptr, const downloadOptions* options = nullptr);
 
 }
 
@@ -0,0 +1,228 @@
+#include "fetch.hpp"
+
+#include <cstddef>
+#include <cctype>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+#include "toyo/fs.hpp"
+#include "toyo/charset.hpp"
+#include "net_stats.hpp"
+#include "download.hpp"
+
+namespace nodev {
+
+static size_t onFetchData(void* buffer, size_t size, size_t nmemb, fetchRequest* request) {
+  if (request->code == -1) {
+    curl_easy_getinfo(request->curl, CURLINFO_RESPONSE_CODE, &(request->code));
+  }
+  if (request->writer != nullptr && request->code >= 200 && request->code < 300) {
+    if (request->writer_state == 0) {
+      request->writer_state = request->writer((const char*)buffer, size * nmemb, request->writer_param);
+    }
+    return request->writer_state == 0 ? size * nmemb : 0;
+  }
+  request->body.append((const char*)buffer, size * nmemb);
+  return size * nmemb;
+}
+
+static size_t onFetchHeader(char* buffer, size_t size, size_t nitems, fetchRequest* request) {
+  std::string line(buffer, size * nitems);
+  if (line.compare(0, 5, "HTTP/") == 0) {
+    // every response of a redirect chain starts over
+    request->response_headers.clear();
+    return size * nitems;
+  }
+  std::size_t colon = line.find(':');
+  if (colon == std::string::npos) return size * nitems;
+  std::string name = line.substr(0, colon);
+  for (std::size_t i = 0; i < name.length(); i++) {
+    name[i] = (char)tolower((unsigned char)name[i]);
+  }
+  std::size_t begin = line.find_first_not_of(" \t", colon + 1);
+  std::size_t end = line.find_last_not_of(" \t\r\n");
+  request->response_headers[name] = begin == std::string::npos || end < begin ? "" : line.substr(begin, end - begin + 1);
+  return size * nitems;
+}
+
+fetchRequest* create_fetch_request(const std::string& url, int priority, fetchCallback callback, void* param) {
+  fetchRequest* request = new fetchRequest();
+  request->curl = nullptr;
+  request->url = url;
+  request->priority = priority;
+  request->timeout = 0;
+  request->body = "";
+  request->writer = nullptr;
+  request->writer_param = nullptr;
+  request->writer_state = 0;
+  request->code = -1;
+  request->result = CURLE_OK;
+  request->callback = callback;
+  request->param = param;
+  return request;
+}
+
+bool fetch_ok(const fetchRequest* request) {
+  // a writer may stop the transfer once it has what it needs
+  bool stopped = request->result == CURLE_WRITE_ERROR && request->writer_state == 1;
+  return (request->result == CURLE_OK || stopped) && request->code >= 200 && request->code < 300 &&
+    request->writer_state != -1;
+}
+
+// moves a failed request to its next mirror, false when there is none
+static bool next_mirror(fetchRequest* request) {
+  if (fetch_ok(request) || request->code == 304 || request->writer != nullptr || request->fallback_urls.empty()) {
+    return false;
+  }
+  request->url = request->fallback_urls.front();
+  request->fallback_urls.erase(request->fallback_urls.begin());
+  request->body = "";
+  request->response_headers.clear();
+  request->code = -1;
+  request->result = CURLE_OK;
+  return true;
+}
+
+static CURL* start_fetch(CURLM* multi, fetchRequest* request, struct curl_slist** headers) {
+  *headers = curl_slist_append(*headers, "Accept: */*");
+  *headers = curl_slist_append(*headers, "User-Agent: Node Version Manager");
+  for (std::size_t i = 0; i < request->headers.size(); i++) {
+    *headers = curl_slist_append(*headers, request->headers[i].c_str());
+  }
+
+  CURL* curl = curl_easy_init();
+  request->curl = curl;
+  curl_easy_setopt(curl, CURLOPT_HTTPHEADER, *headers);
+  curl_easy_setopt(curl, CURLOPT_URL, request->url.c_str());
+  // every encoding curl was built with, index.json shrinks about 8x
+  curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");
+  curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 10);
+  if (request->timeout > 0) curl_easy_setopt(curl, CURLOPT_TIMEOUT, request->timeout);
+  curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1);
+  curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
+  curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L);
+  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, &onFetchData);
+  curl_easy_setopt(curl, CURLOPT_WRITEDATA, request);
+  curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, &onFetchHeader);
+  curl_easy_setopt(curl, CURLOPT_HEADERDATA, request);
+  curl_easy_setopt(curl, CURLOPT_PRIVATE, request);
+  curl_multi_add_handle(multi, curl);
+  return curl;
+}
+
+// a request to a local mirror is answered from the file system without a
+// transfer, as a 200 or a 404; validators are not needed to skip anything
+static void fetch_local(fetchRequest* request, const std::string& file) {
+  request->result = CURLE_OK;
+  request->code = 404;
+  if (!toyo::fs::exists(file) || toyo::fs::stat(file).is_directory()) return;
+  std::ifstream in(toyo::charset::a2acp(file), std::ios::in | std::ios::binary);
+  if (!in) return;
+  request->code = 200;
+  std::vector<char> buf(256 * 1024);
+  while (in) {
+    in.read(buf.data(), buf.size());
+    std::size_t n = (std::size_t)in.gcount();
+    if (n == 0) break;
+    if (request->writer != nullptr) {
+      request->writer_state = request->writer(buf.data(), n, request->writer_param);
+      if (request->writer_state != 0) break;
+    } else {
+      request->body.append(buf.data(), n);
+    }
+  }
+  if (in.bad()) request->result = CURLE_READ_ERROR;
+}
+
+static void record_fetch(const std::string& history, CURL* curl, const fetchRequest* request) {
+  transferStats stats;
+  init_transfer_stats(&stats);
+  collect_transfer_stats(curl, &stats);
+  if (stats.url.empty()) stats.url = request->url;
+  if (fetch_ok(request) || request->code == 304) {
+    stats.result = "ok";
+  } else {
+    stats.result = request->result != CURLE_OK ? curl_easy_strerror(request->result) : "HTTP " + std::to_string(request->code);
+  }
+  curl_off_t speed = 0;
+  curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD_T, &(stats.bytes));
+  curl_easy_getinfo(curl, CURLINFO_SPEED_DOWNLOAD_T, &speed);
+  // too short to sample a peak
+  stats.avg_speed = stats.peak_speed = (double)speed;
+  net_stats(history).append(stats);
+}
+
+bool fetch_all(const std::vector<fetchRequest*>& requests, int max_connections, const std::string& history) {
+  std::vector<fetchRequest*> queue = requests;
+  std::stable_sort(queue.begin(), queue.end(), [](const fetchRequest* a, const fetchRequest* b) -> bool {
+    return a->priority < b->priority;
+  });
+
+  // one header list per request, released once all of them are done
+  std::vector<struct curl_slist*> headers(queue.size(), nullptr);
+
+  CURLM* multi = curl_multi_init();
+  std::size_t next = 0;
+  int active = 0;
+  bool ok = true;
+
+  while (next < queue.size() || active > 0) {
+    while (next < queue.size() && (max_connections < 1 || active < max_connections)) {
+      fetchRequest* request = queue[next];
+      std::string file;
+      next++;
+      if (local_file(request->url, &file)) {
+        fetch_local(request, file);
+        if (next_mirror(request)) {
+          next--;
+          continue;
+        }
+        if (!fetch_ok(request)) ok = false;
+        if (request->callback) {
+          request->callback(request, request->param);
+        }
+        continue;
+      }
+      start_fetch(multi, request, &headers[next - 1]);
+      active++;
+    }
+
+    int running = 0;
+    curl_multi_perform(multi, &running);
+
+    int left = 0;
+    CURLMsg* m = nullptr;
+    while ((m = curl_multi_info_read(multi, &left)) != nullptr) {
+      if (m->msg != CURLMSG_DONE) continue;
+      CURL* curl = m->easy_handle;
+      fetchRequest* request = nullptr;
+      curl_easy_getinfo(curl, CURLINFO_PRIVATE, (char**)&request);
+      request->result = m->data.result;
+      curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &(request->code));
+      if (!history.empty()) record_fetch(history, curl, request);
+      curl_multi_remove_handle(multi, curl);
+      curl_easy_cleanup(curl);
+      request->curl = nullptr;
+      active--;
+      if (next_mirror(request)) {
+        queue.push_back(request);
+        headers.push_back(nullptr);
+        continue;
+      }
+      if (!fetch_ok(request)) ok = false;
+      if (request->callback) {
+        request->callback(request, request->param);
+      }
+    }
+
+    if (active > 0) curl_multi_wait(multi, nullptr, 0, 200, nullptr);
+  }
+
+  curl_multi_cleanup(multi);
+  for (std::size_t i = 0; i < headers.size(); i++) {
+    curl_slist_free_all(headers[i]);
+  }
+  return ok;
+}
+
+}
@@ -0,0 +1,59 @@
+#ifndef __NODEV_FETCH_HPP__
+#define __NODEV_FETCH_HPP__
+
+#include <string>
+#include <vector>
+#include <map>
+#include <cstddef>
+#include "curl/curl.h"
+
+namespace nodev {
+
+typedef struct fetchRequest fetchRequest;
+
+typedef void (*fetchCallback)(fetchRequest*, void*);
+
+// receives the body as it arrives instead of `body`, returns 0 to continue,
+// 1 when nothing more is needed and -1 on error
+typedef int (*fetchWriter)(const char*, std::size_t, void*);
+
+// a small GET kept in memory, such as SHASUMS256.txt or index.json; the
+// body is requested compressed and decoded by curl
+typedef struct fetchRequest {
+  CURL* curl;
+  std::string url;
+  // the same resource on other mirrors, tried in order when the request
+  // fails; not for a writer, which can not take the body twice
+  std::vector<std::string> fallback_urls;
+  // lower values start first when more requests are queued than connections
+  int priority;
+  // extra request headers, e.g. "If-None-Match: ..."
+  std::vector<std::string> headers;
+  // limit for the whole transfer in seconds, 0 for none
+  long timeout;
+  std::string body;
+  fetchWriter writer;
+  void* writer_param;
+  int writer_state;
+  // response headers of the last response, names in lower case
+  std::map<std::string, std::string> response_headers;
+  long code;
+  CURLcode result;
+  // runs as soon as this request is done, while the others are still going
+  fetchCallback callback;
+  void* param;
+} fetchRequest;
+
+fetchRequest* create_fetch_request(const std::string& url, int priority, fetchCallback callback = nullptr, void* param = nullptr);
+
+// the request got a complete 2xx body
+bool fetch_ok(const fetchRequest* request);
+
+// performs every request on one curl multi handle, at most `max_connections`
+// at a time; returns true when all of them succeeded. Each transfer is
+// appended to the net_stats `history` when one is given
+bool fetch_all(const std::vector<fetchRequest*>& requests, int max_connections, const std::string& history = "");
+
+}
+
+#endif
@@ -0,0 +1,107 @@
+#include "json_stream.hpp"
+
+namespace nodev {
+
+static bool is_space(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+json_array_stream::~json_array_stream() {}
+
+json_array_stream::json_array_stream():
+  started_(false),
+  ended_(false),
+  stopped_(false),
+  in_string_(false),
+  escape_(false),
+  depth_(0),
+  element_(""),
+  error_("") {}
+
+bool json_array_stream::ended() const {
+  return ended_;
+}
+
+bool json_array_stream::stopped() const {
+  return stopped_;
+}
+
+const std::string& json_array_stream::error() const {
+  return error_;
+}
+
+bool json_array_stream::fail(const std::string& message) {
+  if (error_.empty()) {
+    error_ = message;
+  }
+  return false;
+}
+
+bool json_array_stream::write(const char* data, std::size_t len) {
+  if (!error_.empty() || stopped_) return false;
+
+  std::size_t i = 0;
+  while (i < len) {
+    char c = data[i];
+    if (ended_) {
+      if (!is_space(c)) return fail("Unexpected data after JSON array");
+      i++;
+      continue;
+    }
+    if (!started_) {
+      if (c == '[') {
+        started_ = true;
+      } else if (!is_space(c)) {
+        return fail("JSON array expected");
+      }
+      i++;
+      continue;
+    }
+
+    if (depth_ == 0) {
+      // between elements
+      if (c == ']') {
+        ended_ = true;
+      } else if (c == '{' || c == '[') {
+        depth_ = 1;
+        element_.assign(1, c);
+      } else if (!is_space(c) && c != ',') {
+        return fail("JSON array of objects expected");
+      }
+      i++;
+      continue;
+    }
+
+    // inside an element, copy up to where it ends
+    std::size_t start = i;
+    for (; i < len && depth_ > 0; i++) {
+      c = data[i];
+      if (in_string_) {
+        if (escape_) {
+          escape_ = false;
+        } else if (c == '\\') {
+          escape_ = true;
+        } else if (c == '"') {
+          in_string_ = false;
+        }
+      } else if (c == '"') {
+        in_string_ = true;
+      } else if (c == '{' || c == '[') {
+        depth_++;
+      } else if (c == '}' || c == ']') {
+        depth_--;
+      }
+    }
+    element_.append(data + start, i - start);
+    if (depth_ == 0) {
+      if (!on_element(element_)) {
+        stopped_ = true;
+        return false;
+      }
+      element_.clear();
+    }
+  }
+  return true;
+}
+
+}
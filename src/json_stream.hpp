@@ -0,0 +1,47 @@
+#ifndef __NODEV_JSON_STREAM_HPP__
+#define __NODEV_JSON_STREAM_HPP__
+
+#include <string>
+#include <cstddef>
+
+namespace nodev {
+
+/*
+ * Push splitter of a JSON array of objects such as index.json. The text
+ * arrives in chunks of any size; every element is handed to on_element()
+ * as soon as it is complete, so only one element is held in memory.
+ */
+class json_array_stream {
+ public:
+  virtual ~json_array_stream();
+  json_array_stream();
+  json_array_stream(const json_array_stream&) = delete;
+  json_array_stream& operator=(const json_array_stream&) = delete;
+
+  // false on malformed input or when on_element() asked to stop
+  bool write(const char* data, std::size_t len);
+  // the closing bracket has been read
+  bool ended() const;
+  // on_element() asked to stop
+  bool stopped() const;
+  const std::string& error() const;
+
+ protected:
+  // returns false to stop reading
+  virtual bool on_element(const std::string& text) = 0;
+  bool fail(const std::string& message);
+
+ private:
+  bool started_;
+  bool ended_;
+  bool stopped_;
+  bool in_string_;
+  bool escape_;
+  int depth_;
+  std::string element_;
+  std::string error_;
+};
+
+}
+
+#endif
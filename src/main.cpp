@@ -1,4 +1,5 @@
 
+#include <algorithm>
 #include "program.hpp"
 #include "cli.hpp"
 
@@ -72,6 +73,16 @@ int main(int argc, char** argv) {
     return 0;
   }
 
+  if (command == "connections") {
+    auto args = cli.get_argument();
+    if (args.size() == 0) {
+      program.connections();
+      return 0;
+    }
+    program.connections(args[0]);
+    return 0;
+  }
+
   if (command == "prefix") {
     auto args = cli.get_argument();
     if (args.size() == 0) {
@@ -87,6 +98,11 @@ int main(int argc, char** argv) {
     return 0;
   }
 
+  if (command == "net-stats" || command == "net_stats") {
+    program.net_stats();
+    return 0;
+  }
+
   if (command == "rm" || command == "uninstall") {
     auto args = cli.get_argument();
     if (args.size() == 0) {
@@ -103,12 +119,24 @@ int main(int argc, char** argv) {
 
   if (command == "get" || command == "install" || command == "get_node" || command == "getnode") {
     auto args = cli.get_argument();
+    if (cli.has("manifest") && !nodev::program::read_manifest(cli.get_option("manifest"), &args)) {
+      return 1;
+    }
     if (args.size() == 0) {
-      toyo::console::log("Example: \n\n  nodev %s 12.16.2", command.c_str());
+      toyo::console::log("Example: \n\n  nodev %s 12.16.2 14 lts/*\n  nodev %s --manifest=versions.txt", command.c_str(), command.c_str());
       return 0;
     }
 
-    return program.get(args[0]) ? 0 : 1;
+    // aliases are resolved first, "14" and "14.21.3" are one install
+    std::vector<std::string> versions;
+    for (std::size_t i = 0; i < args.size(); i++) {
+      std::string version = program.resolve_version(args[i]);
+      if (version.empty()) return 1;
+      if (std::find(versions.begin(), versions.end(), version) == versions.end()) {
+        versions.push_back(version);
+      }
+    }
+    return program.get(versions) ? 0 : 1;
   }
 
   if (command == "get_npm" || command == "getnpm") {
@@ -128,7 +156,9 @@ int main(int argc, char** argv) {
       return 0;
     }
 
-    return program.use(args[0]) ? 0 : 1;
+    std::string version = program.resolve_version(args[0]);
+    if (version.empty()) return 1;
+    return program.use(version) ? 0 : 1;
   }
 
   if (command == "use_npm" || command == "usenpm") {
@@ -0,0 +1,179 @@
+#include "mirror.hpp"
+
+#include <ctime>
+#include <cstddef>
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <exception>
+
+#include "curl/curl.h"
+#include "toyo/fs.hpp"
+#include "toyo/path.hpp"
+#include "download.hpp"
+
+// bytes asked from every mirror, enough to measure more than the handshake
+#define NODEV_MIRROR_PROBE_SIZE (64 * 1024)
+#define NODEV_MIRROR_PROBE_TIMEOUT_MS 5000
+// seconds a score stays valid before the mirrors are probed again
+#define NODEV_MIRROR_SCORE_TTL (60 * 60)
+
+namespace nodev {
+
+typedef struct mirrorProbe {
+  CURL* curl;
+  struct curl_slist* headers;
+  std::string mirror;
+  std::size_t received;
+} mirrorProbe;
+
+static size_t onProbeData(void*, size_t size, size_t nmemb, mirrorProbe* probe) {
+  probe->received += size * nmemb;
+  // a mirror that ignores the range has given enough to be measured
+  return probe->received >= NODEV_MIRROR_PROBE_SIZE ? 0 : size * nmemb;
+}
+
+// the workers of a batch rank mirrors at the same time; the scores are
+// read, probed and written back by one of them at a time
+static std::mutex health_mutex;
+
+mirror_health::mirror_health(const std::string& path): path_(path), scores_(nlohmann::json::object()) {}
+
+void mirror_health::load() {
+  try {
+    if (toyo::fs::exists(path_)) {
+      nlohmann::json data = nlohmann::json::parse(toyo::fs::read_file_to_string(path_));
+      if (data.is_object()) scores_ = data;
+    }
+  } catch (const std::exception&) {
+    // scores are rebuilt by the next probe
+  }
+}
+
+void mirror_health::save() const {
+  try {
+    toyo::fs::mkdirs(toyo::path::dirname(path_));
+    // another process never reads half of it
+    toyo::fs::write_file(path_ + ".tmp", scores_.dump(2));
+    toyo::fs::rename(path_ + ".tmp", path_);
+  } catch (const std::exception&) {
+    // scores are best effort
+  }
+}
+
+void mirror_health::probe(const std::vector<std::string>& mirrors, const std::string& probe_path) {
+  CURLM* multi = curl_multi_init();
+  std::vector<mirrorProbe*> probes;
+  std::string range = "0-" + std::to_string(NODEV_MIRROR_PROBE_SIZE - 1);
+
+  for (std::size_t i = 0; i < mirrors.size(); i++) {
+    mirrorProbe* probe = new mirrorProbe();
+    probe->mirror = mirrors[i];
+    probe->received = 0;
+    probe->headers = curl_slist_append(nullptr, "User-Agent: Node Version Manager");
+    probe->curl = curl_easy_init();
+    std::string url = mirrors[i] + probe_path;
+    curl_easy_setopt(probe->curl, CURLOPT_HTTPHEADER, probe->headers);
+    curl_easy_setopt(probe->curl, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(probe->curl, CURLOPT_RANGE, range.c_str());
+    curl_easy_setopt(probe->curl, CURLOPT_TIMEOUT_MS, (long)NODEV_MIRROR_PROBE_TIMEOUT_MS);
+    curl_easy_setopt(probe->curl, CURLOPT_FOLLOWLOCATION, 1);
+    curl_easy_setopt(probe->curl, CURLOPT_SSL_VERIFYPEER, 0L);
+    curl_easy_setopt(probe->curl, CURLOPT_SSL_VERIFYHOST, 0L);
+    curl_easy_setopt(probe->curl, CURLOPT_WRITEFUNCTION, &onProbeData);
+    curl_easy_setopt(probe->curl, CURLOPT_WRITEDATA, probe);
+    curl_easy_setopt(probe->curl, CURLOPT_PRIVATE, probe);
+    curl_multi_add_handle(multi, probe->curl);
+    probes.push_back(probe);
+  }
+
+  int running = 0;
+  do {
+    curl_multi_perform(multi, &running);
+    int left = 0;
+    CURLMsg* m = nullptr;
+    while ((m = curl_multi_info_read(multi, &left)) != nullptr) {
+      if (m->msg != CURLMSG_DONE) continue;
+      mirrorProbe* probe = nullptr;
+      curl_easy_getinfo(m->easy_handle, CURLINFO_PRIVATE, (char**)&probe);
+      long status = 0;
+      double seconds = 0;
+      curl_easy_getinfo(probe->curl, CURLINFO_RESPONSE_CODE, &status);
+      curl_easy_getinfo(probe->curl, CURLINFO_TOTAL_TIME, &seconds);
+      bool ok = (m->data.result == CURLE_OK || m->data.result == CURLE_WRITE_ERROR) &&
+        (status == 200 || status == 206) && probe->received > 0;
+
+      nlohmann::json& score = scores_[probe->mirror];
+      double speed = ok && seconds > 0 ? (double)probe->received / seconds : 0;
+      double last = score.is_object() && score["speed"].is_number() ? score["speed"].get<double>() : 0;
+      int failures = score.is_object() && score["failures"].is_number_integer() ? score["failures"].get<int>() : 0;
+      score = nlohmann::json::object();
+      // a single probe is noisy, keep some of the history
+      score["speed"] = ok ? (last > 0 ? (last + speed) / 2 : speed) : 0;
+      score["failures"] = ok ? 0 : failures + 1;
+      score["time"] = (long long)time(nullptr);
+    }
+    if (running > 0) curl_multi_wait(multi, nullptr, 0, 200, nullptr);
+  } while (running > 0);
+
+  for (std::size_t i = 0; i < probes.size(); i++) {
+    curl_multi_remove_handle(multi, probes[i]->curl);
+    curl_easy_cleanup(probes[i]->curl);
+    curl_slist_free_all(probes[i]->headers);
+    delete probes[i];
+  }
+  curl_multi_cleanup(multi);
+  save();
+}
+
+std::vector<std::string> mirror_health::rank(const std::vector<std::string>& mirrors, const std::string& probe_path) {
+  std::vector<std::string> res = mirrors;
+  if (mirrors.size() < 2) return res;
+
+  std::lock_guard<std::mutex> lock(health_mutex);
+  // what another worker probed meanwhile
+  load();
+
+  // a local mirror needs no probe, it is always the fastest
+  std::vector<std::string> remote;
+  for (std::size_t i = 0; i < mirrors.size(); i++) {
+    if (!local_file(mirrors[i], nullptr)) remote.push_back(mirrors[i]);
+  }
+
+  long long now = (long long)time(nullptr);
+  bool stale = false;
+  for (std::size_t i = 0; i < remote.size(); i++) {
+    auto it = scores_.find(remote[i]);
+    if (it == scores_.end() || !it->is_object() || !(*it)["time"].is_number_integer() ||
+        now - (*it)["time"].get<long long>() > NODEV_MIRROR_SCORE_TTL) {
+      stale = true;
+      break;
+    }
+  }
+  if (stale) probe(remote, probe_path);
+
+  std::map<std::string, std::pair<int, double> > keys;
+  for (std::size_t i = 0; i < mirrors.size(); i++) {
+    auto it = scores_.find(mirrors[i]);
+    int failures = 1;
+    double speed = 0;
+    if (it != scores_.end() && it->is_object()) {
+      if ((*it)["failures"].is_number_integer()) failures = (*it)["failures"].get<int>();
+      if ((*it)["speed"].is_number()) speed = (*it)["speed"].get<double>();
+    }
+    keys[mirrors[i]] = std::make_pair(failures, speed);
+  }
+  std::stable_sort(res.begin(), res.end(), [&keys](const std::string& a, const std::string& b) -> bool {
+    bool la = local_file(a, nullptr);
+    bool lb = local_file(b, nullptr);
+    if (la != lb) return la;
+    const std::pair<int, double>& ka = keys[a];
+    const std::pair<int, double>& kb = keys[b];
+    if (ka.first != kb.first) return ka.first < kb.first;
+    return ka.second > kb.second;
+  });
+  return res;
+}
+
+}
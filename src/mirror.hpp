@@ -0,0 +1,35 @@
+#ifndef __NODEV_MIRROR_HPP__
+#define __NODEV_MIRROR_HPP__
+
+#include <string>
+#include <vector>
+#include "json.hpp"
+
+namespace nodev {
+
+/*
+ * Health and throughput of download mirrors. Mirrors are probed together
+ * with a small range request, the scores are kept in a JSON file so that
+ * the next runs can skip probing for a while.
+ */
+class mirror_health {
+ public:
+  mirror_health(const std::string& path);
+
+  // orders `mirrors` fastest first, failing ones last; when any of them
+  // has no recent score they are all probed with `probe_path` first
+  std::vector<std::string> rank(const std::vector<std::string>& mirrors, const std::string& probe_path);
+
+ private:
+  mirror_health();
+  void probe(const std::vector<std::string>& mirrors, const std::string& probe_path);
+  void load();
+  void save() const;
+
+  std::string path_;
+  nlohmann::json scores_;
+};
+
+}
+
+#endif
@@ -0,0 +1,224 @@
+#include "net_stats.hpp"
+
+#include <cstdio>
+#include <cstddef>
+#include <ctime>
+#include <map>
+#include <vector>
+#include <mutex>
+#include <sstream>
+#include <algorithm>
+#include <exception>
+
+#include "json.hpp"
+#include "toyo/fs.hpp"
+#include "toyo/path.hpp"
+
+#define NODEV_NET_STATS_MAX_SIZE (1024 * 1024)
+
+namespace nodev {
+
+// use() downloads node and npm at the same time
+static std::mutex history_mutex;
+
+void init_transfer_stats(transferStats* stats) {
+  stats->url = "";
+  stats->result = "";
+  stats->code = 0;
+  stats->http = "";
+  stats->bytes = 0;
+  stats->connections = 1;
+  stats->namelookup = 0;
+  stats->connect = 0;
+  stats->appconnect = 0;
+  stats->pretransfer = 0;
+  stats->starttransfer = 0;
+  stats->total = 0;
+  stats->avg_speed = 0;
+  stats->peak_speed = 0;
+}
+
+void collect_transfer_stats(CURL* curl, transferStats* stats) {
+  char* url = nullptr;
+  if (curl_easy_getinfo(curl, CURLINFO_EFFECTIVE_URL, &url) == CURLE_OK && url != nullptr) {
+    stats->url = url;
+  }
+  curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &(stats->code));
+  long version = 0;
+  curl_easy_getinfo(curl, CURLINFO_HTTP_VERSION, &version);
+  switch (version) {
+    case CURL_HTTP_VERSION_1_0: stats->http = "1.0"; break;
+    case CURL_HTTP_VERSION_1_1: stats->http = "1.1"; break;
+    case CURL_HTTP_VERSION_2_0: stats->http = "2"; break;
+    case CURL_HTTP_VERSION_3: stats->http = "3"; break;
+    default: stats->http = ""; break;
+  }
+  curl_easy_getinfo(curl, CURLINFO_NAMELOOKUP_TIME_T, &(stats->namelookup));
+  curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME_T, &(stats->connect));
+  curl_easy_getinfo(curl, CURLINFO_APPCONNECT_TIME_T, &(stats->appconnect));
+  curl_easy_getinfo(curl, CURLINFO_PRETRANSFER_TIME_T, &(stats->pretransfer));
+  curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME_T, &(stats->starttransfer));
+  curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME_T, &(stats->total));
+}
+
+net_stats::net_stats(const std::string& path): path_(path) {}
+
+std::string net_stats::mirror_of(const std::string& url) {
+  std::size_t scheme = url.find("://");
+  if (scheme == std::string::npos) return url;
+  std::size_t end = url.find('/', scheme + 3);
+  return end == std::string::npos ? url : url.substr(0, end);
+}
+
+bool net_stats::append(const transferStats& stats) const {
+  nlohmann::json record = nlohmann::json::object();
+  record["time"] = (long long)time(nullptr);
+  record["url"] = stats.url;
+  record["mirror"] = mirror_of(stats.url);
+  record["result"] = stats.result;
+  record["code"] = stats.code;
+  record["http"] = stats.http;
+  record["bytes"] = (long long)stats.bytes;
+  record["connections"] = stats.connections;
+  record["namelookup_us"] = (long long)stats.namelookup;
+  record["connect_us"] = (long long)stats.connect;
+  record["appconnect_us"] = (long long)stats.appconnect;
+  record["pretransfer_us"] = (long long)stats.pretransfer;
+  record["starttransfer_us"] = (long long)stats.starttransfer;
+  record["total_us"] = (long long)stats.total;
+  record["avg_speed"] = (long long)stats.avg_speed;
+  record["peak_speed"] = (long long)stats.peak_speed;
+
+  std::lock_guard<std::mutex> lock(history_mutex);
+  try {
+    toyo::fs::mkdirs(toyo::path::dirname(path_));
+    toyo::fs::append_file(path_, record.dump() + "\n");
+
+    if (toyo::fs::stat(path_).size > NODEV_NET_STATS_MAX_SIZE) {
+      std::string content = toyo::fs::read_file_to_string(path_);
+      std::size_t cut = content.find('\n', content.length() / 2);
+      content = cut == std::string::npos ? "" : content.substr(cut + 1);
+      toyo::fs::write_file(path_ + ".tmp", content);
+      toyo::fs::rename(path_ + ".tmp", path_);
+    }
+  } catch (const std::exception&) {
+    // the history is best effort
+    return false;
+  }
+  return true;
+}
+
+typedef struct mirrorSummary {
+  int transfers;
+  int failures;
+  long long bytes;
+  double seconds;
+  double peak_speed;
+  std::map<std::string, int> http;
+  std::vector<double> dns;
+  std::vector<double> tcp;
+  std::vector<double> tls;
+  std::vector<double> ttfb;
+} mirrorSummary;
+
+static double median(std::vector<double>& values) {
+  if (values.empty()) return -1;
+  std::sort(values.begin(), values.end());
+  std::size_t mid = values.size() / 2;
+  return values.size() % 2 == 1 ? values[mid] : (values[mid - 1] + values[mid]) / 2;
+}
+
+static long long get_int(const nlohmann::json& record, const char* key) {
+  auto it = record.find(key);
+  return it != record.end() && it->is_number() ? it->get<long long>() : 0;
+}
+
+static std::string format_ms(std::vector<double>& values) {
+  double value = median(values);
+  if (value < 0) return "-";
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%.1f ms", value / 1000);
+  return buf;
+}
+
+static std::string format_size(double bytes) {
+  const char* units[] = { "B", "KB", "MB", "GB" };
+  int unit = 0;
+  while (bytes >= 1024 && unit < 3) {
+    bytes /= 1024;
+    unit++;
+  }
+  char buf[32];
+  snprintf(buf, sizeof(buf), unit == 0 ? "%.0f %s" : "%.1f %s", bytes, units[unit]);
+  return buf;
+}
+
+void net_stats::print() const {
+  std::string content;
+  try {
+    if (toyo::fs::exists(path_)) content = toyo::fs::read_file_to_string(path_);
+  } catch (const std::exception&) {
+    content = "";
+  }
+
+  std::map<std::string, mirrorSummary> mirrors;
+  int count = 0;
+  std::istringstream in(content);
+  std::string line;
+  while (std::getline(in, line)) {
+    nlohmann::json record;
+    try {
+      record = nlohmann::json::parse(line);
+    } catch (const std::exception&) {
+      // a line cut by a crash
+      continue;
+    }
+    if (!record.is_object() || !record["mirror"].is_string()) continue;
+    count++;
+
+    mirrorSummary& s = mirrors[record["mirror"].get<std::string>()];
+    s.transfers++;
+    if (!record["result"].is_string() || record["result"].get<std::string>() != "ok") {
+      s.failures++;
+      continue;
+    }
+    long long total = get_int(record, "total_us");
+    long long bytes = get_int(record, "bytes");
+    s.bytes += bytes;
+    s.seconds += (double)total / 1000000;
+    s.peak_speed = std::max(s.peak_speed, (double)get_int(record, "peak_speed"));
+    if (record["http"].is_string() && !record["http"].get<std::string>().empty()) {
+      s.http["HTTP/" + record["http"].get<std::string>()]++;
+    }
+
+    long long namelookup = get_int(record, "namelookup_us");
+    long long connect = get_int(record, "connect_us");
+    long long appconnect = get_int(record, "appconnect_us");
+    long long pretransfer = get_int(record, "pretransfer_us");
+    long long starttransfer = get_int(record, "starttransfer_us");
+    // a reused connection has no setup to measure
+    if (connect > 0) {
+      s.dns.push_back((double)namelookup);
+      s.tcp.push_back((double)(connect - namelookup));
+      if (appconnect > 0) s.tls.push_back((double)(appconnect - connect));
+    }
+    if (starttransfer > 0) s.ttfb.push_back((double)(starttransfer - pretransfer));
+  }
+
+  printf("History: %s (%d transfers)\n", path_.c_str(), count);
+  for (auto it = mirrors.begin(); it != mirrors.end(); ++it) {
+    mirrorSummary& s = it->second;
+    std::string http = "";
+    for (auto h = s.http.begin(); h != s.http.end(); ++h) {
+      http += " " + h->first;
+    }
+    printf("\n%s\n", it->first.c_str());
+    printf("  transfers  %d, %d failed, %s%s\n", s.transfers, s.failures, format_size((double)s.bytes).c_str(), http.c_str());
+    printf("  median     dns %s, connect %s, tls %s, ttfb %s\n",
+      format_ms(s.dns).c_str(), format_ms(s.tcp).c_str(), format_ms(s.tls).c_str(), format_ms(s.ttfb).c_str());
+    printf("  throughput avg %s/s, peak %s/s\n",
+      format_size(s.seconds > 0 ? (double)s.bytes / s.seconds : 0).c_str(), format_size(s.peak_speed).c_str());
+  }
+}
+
+}
@@ -0,0 +1,58 @@
+#ifndef __NODEV_NET_STATS_HPP__
+#define __NODEV_NET_STATS_HPP__
+
+#include <string>
+#include "curl/curl.h"
+
+namespace nodev {
+
+// one transfer as curl saw it, the times are in microseconds since the
+// transfer started, as curl reports them
+typedef struct transferStats {
+  std::string url;        // effective URL, after redirects
+  std::string result;     // "ok" or the reason it failed
+  long code;
+  std::string http;       // "1.0", "1.1", "2" or "3"
+  curl_off_t bytes;
+  int connections;
+  curl_off_t namelookup;
+  curl_off_t connect;
+  curl_off_t appconnect;  // TLS done, 0 for plain HTTP
+  curl_off_t pretransfer;
+  curl_off_t starttransfer;
+  curl_off_t total;
+  // bytes per second over the whole transfer and over the best 200ms
+  double avg_speed;
+  double peak_speed;
+} transferStats;
+
+void init_transfer_stats(transferStats* stats);
+
+// fills the timings, the effective URL, the status and the HTTP version
+// from a finished easy handle
+void collect_transfer_stats(CURL* curl, transferStats* stats);
+
+/*
+ * History of transfers in a JSON lines file, one record appended per
+ * transfer. It is kept below NODEV_NET_STATS_MAX_SIZE by dropping the
+ * oldest half when it grows past it.
+ */
+class net_stats {
+ public:
+  net_stats(const std::string& path);
+
+  bool append(const transferStats& stats) const;
+  // per mirror summary of the whole history
+  void print() const;
+
+  // "https://nodejs.org" of "https://nodejs.org/dist/v18.0.0/..."
+  static std::string mirror_of(const std::string& url);
+
+ private:
+  net_stats();
+  std::string path_;
+};
+
+}
+
+#endif
@@ -20,6 +20,11 @@
 #include "progress.hpp"
 #include "unzip.hpp"
 #include "download.hpp"
+#include "tar.hpp"
+#include "mirror.hpp"
+#include "fetch.hpp"
+#include "dist_index.hpp"
+#include "net_stats.hpp"
 #include "toyo/fs.hpp"
 #include "toyo/path.hpp"
 #include "toyo/console.hpp"
@@ -27,72 +32,102 @@
 #include "toyo/process.hpp"
 #include "toyo/util.hpp"
 #include <vector>
+#include <memory>
+#include <algorithm>
 #include <cstdlib>
 #include <cstddef>
 #include <cstdio>
 #include <chrono>
 #include <thread>
+#include <atomic>
+#include <sstream>
 #include <fstream>
 
 #define NODEV_NODE_EXE ("node" NODEV_EXE_EXT)
 
 namespace nodev {
 
-static size_t json_cb (void* buffer, size_t size, size_t nmemb, void* userp) {
-  char* tmp = new char[size * nmemb + 1];
-  memset(tmp, 0, size * nmemb + 1);
-  strcpy(tmp, (char*)buffer);
-  *(static_cast<std::string*>(userp)) += tmp;
-  delete[] tmp;
-  return size * nmemb;
+std::string program::index_path() const {
+  return toyo::path::join(this->node_cache_dir(), "index.bin");
 }
 
-std::string program::get_npm_version(const std::string& version) {
-  std::string node_version = std::string("v") + version;
-  std::string res = "";
-  CURL* curl = curl_easy_init();
-  struct curl_slist* headers = nullptr;
-
-  headers = curl_slist_append(headers, "Accept: */*");
-  headers = curl_slist_append(headers, "User-Agent: Node.js Version Manager");
-
-  curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-
-  curl_easy_setopt(curl, CURLOPT_URL, "https://nodejs.org/dist/index.json");
+std::string program::net_stats_path() const {
+  return toyo::path::join(paths_->cache, "net-stats.jsonl");
+}
 
-  curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "GET");
-  curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 10);
-  curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1);
+downloadOptions program::download_options() const {
+  downloadOptions options = {};
+  options.connections = config_->connections;
+  options.history = this->net_stats_path();
+  options.retries = config_->retries;
+  options.low_speed_limit = config_->low_speed_limit;
+  options.low_speed_time = config_->low_speed_time;
+  return options;
+}
 
-  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, json_cb);
-  curl_easy_setopt(curl, CURLOPT_WRITEDATA, &res);
-  curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
-  curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L);
+void program::revalidate_index() const {
+  if (index_refresh_.joinable()) return;
+  std::string path = this->index_path();
+  std::string mirror = config_->node_mirror;
+  std::string history = this->net_stats_path();
+  std::shared_ptr<std::atomic<bool>> done = std::make_shared<std::atomic<bool>>(false);
+  index_refreshed_ = done;
+  index_refresh_ = std::thread([path, mirror, history, done]() {
+    dist_index index(path);
+    // the stale index already answered, so never hold the command for long
+    index.refresh(mirror, history, 15);
+    *done = true;
+  });
+}
 
-  CURLcode code = curl_easy_perform(curl);
+void program::wait_index(dist_index* index) const {
+  if (index_refresh_.joinable()) {
+    index_refresh_.join();
+    *index = dist_index(this->index_path());
+  }
+}
 
-  if (code != CURLE_OK) {
-    printf("%s\n", curl_easy_strerror(code));
-    curl_slist_free_all(headers);
-    curl_easy_cleanup(curl);
-    return "0.0.0";
+std::string program::resolve_version(const std::string& alias) const {
+  dist_index index(this->index_path());
+  std::string version = index.resolve(alias);
+  if (version != "") {
+    if (index.stale()) this->revalidate_index();
+    return version;
+  }
+  if (dist_index::is_version(alias)) {
+    // exact versions do not need the index
+    return alias[0] == 'v' || alias[0] == 'V' ? alias.substr(1) : alias;
   }
 
-  curl_slist_free_all(headers);
-  curl_easy_cleanup(curl);
+  // unknown to the cached index, maybe released since the last check
+  this->wait_index(&index);
+  if (!index.refresh(config_->node_mirror, this->net_stats_path())) {
+    toyo::console::error("Can not fetch " + config_->node_mirror + "/index.json");
+    return "";
+  }
+  version = index.resolve(alias);
+  if (version == "") {
+    toyo::console::error("Unknown Node.js version: " + alias);
+  }
+  return version;
+}
 
-  if (res != "") {
-    auto json = nlohmann::json::parse(res);
-    unsigned int size = json.size();
-    for (unsigned int i = 0; i < size; i++) {
-      auto v = json[i]["version"].get<std::string>();
-      if (v == node_version) {
-        return json[i]["npm"].get<std::string>();
+std::string program::get_npm_version(const std::string& version) const {
+  dist_index index(this->index_path());
+  distVersion dist;
+  if (index.find(version, &dist)) {
+    if (index.stale()) this->revalidate_index();
+  } else {
+    this->wait_index(&index);
+    if (!index.find(version, &dist)) {
+      if (!index.refresh(config_->node_mirror, this->net_stats_path())) {
+        toyo::console::error("Can not fetch " + config_->node_mirror + "/index.json");
+        return "0.0.0";
       }
+      if (!index.find(version, &dist)) return "0.0.0";
     }
   }
-
-  return "0.0.0";
+  return dist.npm.empty() ? "0.0.0" : dist.npm;
 }
 
 std::string program::get_node_version(const std::string& exe_path) {
@@ -211,6 +246,21 @@ std::string program::try_to_absolute(const std::string& p) {
 }
 
 program::~program() {
+  // give a running refresh a moment to finish, then leave it behind: the
+  // index is saved with a rename, so exiting halfway never tears the file
+  bool refreshing = false;
+  if (index_refresh_.joinable()) {
+    for (int i = 0; i < 50 && !*index_refreshed_; i++) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    refreshing = !*index_refreshed_;
+    if (refreshing) {
+      index_refresh_.detach();
+    } else {
+      index_refresh_.join();
+    }
+  }
+
   if (config_) {
     delete config_;
     config_ = nullptr;
@@ -220,9 +270,14 @@ program::~program() {
     delete paths_;
     paths_ = nullptr;
   }
+
+  // the detached refresh may still be using curl
+  if (!refreshing) curl_global_cleanup();
 }
 
 program::program() {
+  // transfers may run on more than one thread
+  curl_global_init(CURL_GLOBAL_ALL);
   dir = toyo::path::__dirname();
   paths_ = new toyo::path::env_paths(toyo::path::env_paths::create(NODEV_EXECUTABLE_NAME));
   std::string config_file;
@@ -267,6 +322,16 @@ std::string program::node_name(const std::string& version) const {
 std::string program::node_path(const std::string& node_name) const {
   return toyo::path::join(this->node_cache_dir(), node_name);
 }
+bool program::bundled_npm() const {
+#ifdef _WIN32
+  return false;
+#else
+  return config_->npm_source == "node";
+#endif
+}
+std::string program::bundled_npm_path(const std::string& node_name) const {
+  return this->node_path(node_name) + "-npm";
+}
 std::string program::global_node_modules_dir() const {
 #ifdef _WIN32
   return toyo::path::join(this->root_(), "node_modules");
@@ -314,166 +379,522 @@ void program::list() const {
   }
 }
 
-bool program::get(const std::string& version) const {
-  std::string node_name = this->node_name(version);
-  std::string node_path = this->node_path(node_name);
-  std::string node_cache_dir = this->node_cache_dir();
-  std::string sha256;
-  bool r;
-  auto download_callback = [](nodev::progressInfo* info, void* data) {
-    cli_progress* prog = (cli_progress*) data;
-    if (info->total != -1) {
-      prog->set_range(0, info->total);
-      prog->set_base(info->size);
-      prog->set_pos(info->sum);
-      prog->set_additional("");
-    } else {
-      if (info->end) {
-        prog->set_range(0, 100);
-        prog->set_base(0);
-        prog->set_pos(100);
-      } else {
-        prog->set_range(0, 100);
-        prog->set_base(0);
-        prog->set_pos(0);
+std::vector<std::string> program::mirror_urls(const std::string& mirror, const std::vector<std::string>& mirrors, const std::string& path) const {
+  std::vector<std::string> list(1, mirror);
+  for (std::size_t i = 0; i < mirrors.size(); i++) {
+    if (std::find(list.begin(), list.end(), mirrors[i]) == list.end()) {
+      list.push_back(mirrors[i]);
+    }
+  }
+  mirror_health health(toyo::path::join(paths_->cache, "mirrors.json"));
+  list = health.rank(list, path);
+  for (std::size_t i = 0; i < list.size(); i++) {
+    list[i] += path;
+  }
+  return list;
+}
+
+std::string program::shasum_path(const std::string& version) const {
+  return toyo::path::join(this->node_cache_dir(), "SHASUMS256-" + version + ".txt");
+}
+
+fetchRequest* program::shasum_request(const std::string& version) const {
+  std::string* path = new std::string(this->shasum_path(version));
+  std::vector<std::string> urls = this->mirror_urls(config_->node_mirror, config_->node_mirrors, "/v" + version + "/SHASUMS256.txt");
+  fetchRequest* request = create_fetch_request(urls[0], 0, [](fetchRequest* request, void* param) {
+    std::string* path = (std::string*) param;
+    if (fetch_ok(request)) {
+      try {
+        toyo::fs::mkdirs(toyo::path::dirname(*path));
+        toyo::fs::write_file(*path + ".tmp", request->body);
+        toyo::fs::rename(*path + ".tmp", *path);
+      } catch (const std::exception&) {
+        // node_sha256() downloads it again
       }
-      prog->set_additional(std::to_string(info->size + info->sum) + " Byte");
     }
-    prog->print();
-  };
-  bool e = toyo::fs::exists(node_path);
-#ifdef _WIN32
-  if (!e) {
-    cli_progress* progress = new cli_progress(std::string("Downloading ") + node_name, 0, 100, 0, 0);
-    std::string url = config_->node_mirror + "/v" + version + "/win-" + config_->node_arch + "/node.exe";
+    delete path;
+  }, path);
+  request->fallback_urls.assign(urls.begin() + 1, urls.end());
+  return request;
+}
+
+std::string program::node_sha256(const std::string& version, const std::string& fname, std::string* error) const {
+  std::string shasum = this->shasum_path(version);
+  if (!toyo::fs::exists(shasum)) {
+    cli_progress* progress = error == nullptr ? new cli_progress(std::string("Downloading SHASUMS256.txt"), 0, 100, 0, 0) : nullptr;
+    std::vector<std::string> urls = this->mirror_urls(config_->node_mirror, config_->node_mirrors, "/v" + version + "/SHASUMS256.txt");
     char msg[256];
+    downloadOptions options = this->download_options();
+    options.connections = 1;
+    options.fallback_urls.assign(urls.begin() + 1, urls.end());
+    bool r;
     try {
       r = nodev::download(
-        url,
-        node_path,
-        download_callback,
+        urls[0],
+        shasum,
+        progress == nullptr ? nullptr : (downloadCallback)[](nodev::progressInfo* info, void* data) {
+          cli_progress* prog = (cli_progress*) data;
+          prog->set_range(0, 100);
+          prog->set_base(0);
+          prog->set_pos(info->end ? 100 : 0);
+          prog->print();
+        },
         (void*)progress,
-        msg
+        msg,
+        &options
       );
     } catch (const std::exception& err) {
-      toyo::console::error(err.what());
+      if (error != nullptr) *error = err.what(); else toyo::console::error(err.what());
       delete progress;
-      return false;
+      return "";
     }
     delete progress;
 
     if (!r) {
-      toyo::console::error(msg);
-      return false;
+      if (error != nullptr) *error = msg; else toyo::console::error(msg);
+      return "";
     }
   }
 
-  std::string shasum = toyo::path::join(node_cache_dir, "SHASUMS256-" + version + ".txt");
-  if (!toyo::fs::exists(shasum)) {
-    cli_progress* progress = new cli_progress(std::string("Downloading SHASUMS256.txt"), 0, 100, 0, 0);
-    std::string url = config_->node_mirror + "/v" + version + "/SHASUMS256.txt";
-    char msg[256];
-    try {
-      r = nodev::download(
-        url,
-        shasum,
-        download_callback,
-        (void*)progress,
-        msg
-      );
-    } catch (const std::exception& err) {
-      toyo::console::error(err.what());
-      delete progress;
-      return false;
+  std::ifstream shatxtFile(toyo::charset::a2acp(shasum), std::ios::in);
+  std::string line = "";
+  std::string hash = "";
+  while (std::getline(shatxtFile, line)) {
+    auto pos = line.find("  ");
+    if (pos == std::string::npos) continue;
+    if (line.substr(pos + 2) == fname) {
+      hash = line.substr(0, pos);
+      break;
     }
+  }
+  shatxtFile.close();
 
-    if (!r) {
-      toyo::console::error(msg);
-      return false;
-    }
+  if (hash.empty()) {
+    std::string message = "No checksum of " + fname + " in " + shasum;
+    if (error != nullptr) *error = message; else toyo::console::error(message);
+  }
+  return hash;
+}
 
-    delete progress;
+// where an install reports to: a progress bar of its own, or one row of a
+// multi_progress shared by a batch
+typedef struct getReport {
+  cli_progress* bar;
+  multi_progress* display;
+  int row;
+} getReport;
+
+static void report_error(getReport* report, const std::string& message) {
+  if (report->display != nullptr) {
+    // the row holds a single line
+    std::string line = message.substr(0, message.find('\n'));
+    report->display->set_status(report->row, "failed: " + line);
+  } else {
+    toyo::console::error(message);
   }
+}
+
+static void report_progress(nodev::progressInfo* info, void* data) {
+  getReport* report = (getReport*) data;
+  long max = 100;
+  long base = 0;
+  long pos = 0;
+  std::string additional = "";
+  if (info->total != -1) {
+    max = info->total;
+    base = info->size;
+    pos = info->sum;
+  } else {
+    pos = info->end ? 100 : 0;
+    additional = std::to_string(info->size + info->sum) + " Byte";
+  }
+  if (report->display != nullptr) {
+    report->display->set(report->row, base, pos, max, additional);
+    report->display->print();
+    return;
+  }
+  cli_progress* prog = report->bar;
+  prog->set_range(0, max);
+  prog->set_base(base);
+  prog->set_pos(pos);
+  prog->set_additional(additional);
+  prog->print();
+}
 
+bool program::get(const std::string& version) const {
+  getReport report = { nullptr, nullptr, 0 };
+  return this->get_node(version, &report, config_->connections);
+}
+
+#ifndef _WIN32
+bool program::fetch_node_tarball(const std::string& version, const std::string& tarname, const std::string& sha256, bool xz,
+    getReport* report, int connections, std::string* error) const {
+  std::string node_name = this->node_name(version);
+  std::string node_path = this->node_path(node_name);
+  std::string tarpath = toyo::path::join(this->node_cache_dir(), tarname);
+  bool quiet = report->display != nullptr;
+  bool r;
+  if (!quiet) report->bar = new cli_progress(std::string("Downloading ") + tarname, 0, 100, 0, 0);
+  std::vector<std::string> urls = this->mirror_urls(config_->node_mirror, config_->node_mirrors, "/v" + version + "/" + tarname);
+  char msg[256] = { 0 };
+  // the archive is extracted while it is downloaded, only bin/node and the
+  // bundled npm are written, straight to the cache
+  std::unique_ptr<tar_extractor> extractor;
+  if (xz) {
+    extractor.reset(new txz_extractor());
+  } else {
+    extractor.reset(new tgz_extractor());
+  }
+  extractor->extract(node_name + "/bin/node", node_path);
+  // a tarball without npm still installs, use() then falls back to the
+  // npm tarball of npm.mirror
+  if (this->bundled_npm()) {
+    extractor->extract_tree(node_name + "/lib/node_modules/npm", this->bundled_npm_path(node_name), true);
+  }
+  downloadOptions options = this->download_options();
+  options.connections = connections;
+  options.sha256 = sha256;
+  options.fallback_urls.assign(urls.begin() + 1, urls.end());
+  options.writer = [](const char* data, std::size_t len, void* param) -> int {
+    tar_extractor* extractor = (tar_extractor*) param;
+    if (!extractor->write((const unsigned char*)data, len)) return -1;
+    return extractor->done() ? 1 : 0;
+  };
+  options.writer_param = extractor.get();
   try {
-    sha256 = toyo::util::sha256::calc_file(node_path);
-    toyo::console::log("SHA256: " + sha256);
+    r = nodev::download(
+      urls[0],
+      tarpath,
+      report_progress,
+      (void*)report,
+      msg,
+      &options
+    );
   } catch (const std::exception& err) {
-    toyo::console::error(err.what());
+    delete report->bar;
+    report->bar = nullptr;
+    *error = err.what();
     return false;
   }
 
-  std::ifstream shatxtFile(toyo::charset::a2acp(shasum), std::ios::in);
-  std::string line = "";
+  delete report->bar;
+  report->bar = nullptr;
 
-  bool checked = false;
-  std::string fname = "win-" + config_->node_arch + "/" + NODEV_NODE_EXE;
-  while (std::getline(shatxtFile, line)) {
-    auto pos = line.find("  ");
-    auto filename = line.substr(pos + 2);
-    if (filename == fname) {
-      auto hash = line.substr(0, pos);
-      if (hash == sha256) {
-        checked = true;
-        break;
-      }
-    }
+  if (!r) {
+    *error = extractor->error().empty() ? std::string(msg) : extractor->error();
+    return false;
   }
 
-  shatxtFile.close();
-
-  if (e && checked) {
-    printf("Version %s (%s) is already installed.\n", version.c_str(), config_->node_arch.c_str());
+  if (!extractor->finish()) {
+    *error = extractor->error();
+    return false;
   }
+  return true;
+}
+#endif
 
-  return checked;
+bool program::get_node(const std::string& version, getReport* report, int connections) const {
+  std::string node_name = this->node_name(version);
+  std::string node_path = this->node_path(node_name);
+  bool quiet = report->display != nullptr;
+  std::string error = "";
+  bool e = toyo::fs::exists(node_path);
+#ifdef _WIN32
+  std::string fname = "win-" + config_->node_arch + "/" + NODEV_NODE_EXE;
 #else
-  std::string tgzname = node_name + ".tar.gz";
-  std::string tgzpath = toyo::path::join(node_cache_dir, tgzname);
+  std::string tarname = node_name + ".tar.gz";
+  std::string fname = tarname;
+#endif
 
-  if (!e) {
-    cli_progress* progress = new cli_progress(std::string("Downloading ") + tgzname, 0, 100, 0, 0);
-    std::string url = config_->node_mirror + "/v" + version + "/node-v" + version + "-" + NODEV_PLATFORM + "-" + config_->node_arch + ".tar.gz";
-    char msg[256];
+  if (e) {
+#ifdef _WIN32
+    // node.exe is what SHASUMS256.txt lists, so a cached one can be checked
+    std::string sha256 = this->node_sha256(version, fname, quiet ? &error : nullptr);
+    if (sha256.empty()) {
+      if (quiet) report_error(report, error);
+      return false;
+    }
     try {
-      r = nodev::download(
-        url,
-        tgzpath,
-        download_callback,
-        (void*)progress,
-        msg
-      );
+      if (toyo::util::sha256::calc_file(node_path) != sha256) {
+        report_error(report, "SHA256 mismatch: " + node_path);
+        return false;
+      }
     } catch (const std::exception& err) {
-      toyo::console::error(err.what());
-      delete progress;
+      report_error(report, err.what());
       return false;
     }
+#endif
+    if (quiet) {
+      report->display->set_status(report->row, "already installed");
+    } else {
+      printf("Version %s (%s) is already installed.\n", version.c_str(), config_->node_arch.c_str());
+    }
+    return true;
+  }
 
-    delete progress;
+  // the digest is computed while the data arrives, nothing reaches its
+  // final path before it matches
+  std::string sha256 = this->node_sha256(version, fname, quiet ? &error : nullptr);
+  if (sha256.empty()) {
+    if (quiet) report_error(report, error);
+    return false;
+  }
 
-    if (!r) {
-      toyo::console::error(msg);
+#ifndef _WIN32
+  // the .tar.xz is about a third smaller, every release that has one lists
+  // it next to the .tar.gz
+  std::string txz_error;
+  std::string txz_sha256 = this->node_sha256(version, node_name + ".tar.xz", &txz_error);
+  std::string tgz_sha256 = sha256;
+  bool xz = !txz_sha256.empty();
+  if (xz) {
+    tarname = node_name + ".tar.xz";
+    sha256 = txz_sha256;
+  }
+#endif
+
+#ifdef _WIN32
+  if (!quiet) report->bar = new cli_progress(std::string("Downloading ") + node_name, 0, 100, 0, 0);
+  std::vector<std::string> urls = this->mirror_urls(config_->node_mirror, config_->node_mirrors, "/v" + version + "/win-" + config_->node_arch + "/node.exe");
+  char msg[256];
+  bool r;
+  downloadOptions options = this->download_options();
+  options.connections = connections;
+  options.sha256 = sha256;
+  options.fallback_urls.assign(urls.begin() + 1, urls.end());
+  try {
+    r = nodev::download(
+      urls[0],
+      node_path,
+      report_progress,
+      (void*)report,
+      msg,
+      &options
+    );
+  } catch (const std::exception& err) {
+    delete report->bar;
+    report->bar = nullptr;
+    report_error(report, err.what());
+    return false;
+  }
+  delete report->bar;
+  report->bar = nullptr;
+
+  if (!r) {
+    report_error(report, msg);
+    return false;
+  }
+#else
+  // the .tar.gz is there for every release, whatever goes wrong with the
+  // .tar.xz, the download or the decoder, it is tried once more
+  while (!this->fetch_node_tarball(version, tarname, sha256, xz, report, connections, &error)) {
+    if (!xz) {
+      report_error(report, error);
       return false;
     }
+    if (!quiet) toyo::console::warn(error + ", trying " + node_name + ".tar.gz");
+    // nothing of it is continued later
+    std::string tarpath = toyo::path::join(this->node_cache_dir(), tarname);
+    try {
+      toyo::fs::remove(tarpath + ".tmp");
+      toyo::fs::remove(tarpath + ".tmp.seg");
+      toyo::fs::remove(tarpath + ".tmp.resume");
+    } catch (const std::exception&) {}
+    xz = false;
+    tarname = node_name + ".tar.gz";
+    sha256 = tgz_sha256;
+  }
+#endif
 
-    nodev::untgz(tgzpath, toyo::path::join(toyo::path::dirname(tgzpath), "tmp"));
-    std::string nodeexe = toyo::path::join(toyo::path::dirname(tgzpath), "tmp", node_name, "bin/node");
-    toyo::fs::chmod(nodeexe, 0777);
-    toyo::fs::copy_file(nodeexe, node_path);
-    toyo::fs::remove(toyo::path::join(toyo::path::dirname(tgzpath), "tmp"));
-    toyo::fs::remove(tgzpath);
-    return true;
+  if (quiet) {
+    report->display->set_status(report->row, "installed, SHA256 " + sha256.substr(0, 16) + "...");
   } else {
-    printf("Version %s (%s) is already installed.\n", version.c_str(), config_->node_arch.c_str());
-    return true;
+    toyo::console::log("SHA256: " + sha256);
   }
-#endif
+  return true;
+}
+
+bool program::get(const std::vector<std::string>& versions) const {
+  if (versions.size() == 1) return this->get(versions[0]);
+  if (versions.empty()) return true;
+
+  int jobs = config_->jobs < (int)versions.size() ? config_->jobs : (int)versions.size();
+  if (jobs < 1) jobs = 1;
+  // `connections` is shared by the batch rather than given to each install
+  int connections = config_->connections / jobs;
+  if (connections < 1) connections = 1;
+
+  // the mirror scores are refreshed once before the workers read them, and
+  // every SHASUMS256.txt comes over one multi handle
+  this->mirror_urls(config_->node_mirror, config_->node_mirrors, "/v" + versions[0] + "/SHASUMS256.txt");
+  std::vector<fetchRequest*> requests;
+  for (std::size_t i = 0; i < versions.size(); i++) {
+    if (!toyo::fs::exists(this->node_path(this->node_name(versions[i]))) && !toyo::fs::exists(this->shasum_path(versions[i]))) {
+      requests.push_back(this->shasum_request(versions[i]));
+    }
+  }
+  if (!requests.empty()) {
+    fetch_all(requests, config_->connections, this->net_stats_path());
+    for (std::size_t i = 0; i < requests.size(); i++) delete requests[i];
+  }
+
+  multi_progress display;
+  std::vector<int> rows;
+  for (std::size_t i = 0; i < versions.size(); i++) {
+    rows.push_back(display.add(this->node_name(versions[i])));
+  }
+  display.print(true);
+
+  std::atomic<std::size_t> next(0);
+  std::atomic<int> failed(0);
+  std::vector<std::thread> workers;
+  for (int j = 0; j < jobs; j++) {
+    workers.push_back(std::thread([this, &versions, &rows, &display, &next, &failed, connections]() {
+      std::size_t i;
+      while ((i = next++) < versions.size()) {
+        getReport report = { nullptr, &display, rows[i] };
+        bool ok = false;
+        try {
+          ok = this->get_node(versions[i], &report, connections);
+        } catch (const std::exception& err) {
+          report_error(&report, err.what());
+        }
+        if (!ok) failed++;
+      }
+    }));
+  }
+  for (std::size_t j = 0; j < workers.size(); j++) {
+    workers[j].join();
+  }
+  return failed == 0;
+}
+
+bool program::read_manifest(const std::string& path, std::vector<std::string>* versions) {
+  std::string content;
+  try {
+    content = toyo::fs::read_file_to_string(path);
+  } catch (const std::exception& err) {
+    toyo::console::error(err.what());
+    return false;
+  }
+  // one version or alias per line, "#" starts a comment
+  std::istringstream in(content);
+  std::string line;
+  while (std::getline(in, line)) {
+    std::size_t hash = line.find('#');
+    if (hash != std::string::npos) line = line.substr(0, hash);
+    std::size_t begin = line.find_first_not_of(" \t\r");
+    if (begin == std::string::npos) continue;
+    std::size_t end = line.find_last_not_of(" \t\r");
+    versions->push_back(line.substr(begin, end - begin + 1));
+  }
+  return true;
+}
+
+std::string program::npm_tarball_path(const std::string& version) const {
+  return toyo::path::join(this->npm_cache_dir(), "npm-" + version + ".tgz");
+}
+
+std::string program::npm_manifest_path(const std::string& version) const {
+  return toyo::path::join(this->npm_cache_dir(), "npm-" + version + ".json");
+}
+
+// SHA-512 of the "sha512-<base64>" entry of dist.integrity in lowercase
+// hex, "" when the manifest has none
+static std::string npm_integrity(const std::string& manifest_path, std::string* error) {
+  nlohmann::json manifest;
+  try {
+    manifest = nlohmann::json::parse(toyo::fs::read_file_to_string(manifest_path));
+  } catch (const std::exception& err) {
+    *error = "Invalid npm manifest " + manifest_path + ": " + err.what();
+    return "";
+  }
+  if (!manifest.is_object() || !JSON_HAS(manifest, "dist") || !manifest["dist"].is_object() ||
+      !JSON_HAS(manifest["dist"], "integrity") || !manifest["dist"]["integrity"].is_string()) {
+    *error = "No dist.integrity in " + manifest_path;
+    return "";
+  }
+  std::istringstream integrity(manifest["dist"]["integrity"].get<std::string>());
+  std::string item;
+  while (integrity >> item) {
+    if (item.compare(0, 7, "sha512-") != 0) continue;
+    std::vector<unsigned char> digest = toyo::util::b64_to_buffer(item.substr(7));
+    if (digest.size() != 64) break;
+    std::string hex = "";
+    char byte[3];
+    for (std::size_t i = 0; i < digest.size(); i++) {
+      snprintf(byte, sizeof(byte), "%02x", digest[i]);
+      hex += byte;
+    }
+    return hex;
+  }
+  *error = "No sha512 integrity in " + manifest_path;
+  return "";
+}
+
+// the tarball must match the integrity of the manifest next to it
+static bool check_npm_tarball(const std::string& manifest_path, const std::string& tarball_path, std::string* error) {
+  std::string expected = npm_integrity(manifest_path, error);
+  if (expected.empty()) return false;
+  std::string actual;
+  try {
+    actual = toyo::util::sha512::calc_file(tarball_path);
+  } catch (const std::exception& err) {
+    *error = err.what();
+    return false;
+  }
+  if (actual != expected) {
+    *error = "SHA512 mismatch: " + tarball_path + "\n  expected " + expected + "\n  actual   " + actual;
+    return false;
+  }
+  return true;
+}
+
+// the version manifest (registry/npm/<version>) and then the tarball
+// (registry/npm/-/npm-<version>.tgz), hashed against the manifest while it
+// downloads into .tmp, so that a bad one never reaches its final path.
+// Runs without `this` so that use() can call it on a thread, the URLs are
+// ranked by the caller
+static bool download_npm(const std::vector<std::string>& manifest_urls, const std::vector<std::string>& tarball_urls,
+    const std::string& manifest_path, const std::string& tarball_path, downloadOptions options,
+    downloadCallback callback, void* param, std::string* error) {
+  char msg[256] = { 0 };
+  try {
+    if (!toyo::fs::exists(manifest_path)) {
+      options.connections = 1;
+      options.fallback_urls.assign(manifest_urls.begin() + 1, manifest_urls.end());
+      if (!nodev::download(manifest_urls[0], manifest_path, nullptr, nullptr, msg, &options)) {
+        *error = msg;
+        return false;
+      }
+    }
+    // nothing is downloaded for a manifest without a usable digest, and it
+    // is not kept for the next run either
+    options.sha512 = npm_integrity(manifest_path, error);
+    if (options.sha512.empty()) {
+      toyo::fs::remove(manifest_path);
+      return false;
+    }
+    options.connections = 1;
+    options.fallback_urls.assign(tarball_urls.begin() + 1, tarball_urls.end());
+    if (!nodev::download(tarball_urls[0], tarball_path, callback, param, msg, &options)) {
+      // a mismatch may as well come from a bad manifest, which is small
+      // enough to fetch again
+      toyo::fs::remove(manifest_path);
+      *error = msg;
+      return false;
+    }
+  } catch (const std::exception& err) {
+    *error = err.what();
+    return false;
+  }
+  return true;
 }
 
 bool program::get_npm(const std::string& version) const {
-  std::string npm_zip_name = version + ".zip";
-  std::string npm_zip_path = toyo::path::join(this->npm_cache_dir(), npm_zip_name);
-  bool r;
+  std::string tarball_path = this->npm_tarball_path(version);
+  if (toyo::fs::exists(tarball_path)) return true;
+
   auto download_callback = [](nodev::progressInfo* info, void* data) {
     cli_progress* prog = (cli_progress*) data;
     prog->set_range(0, info->total);
@@ -481,47 +902,104 @@ bool program::get_npm(const std::string& version) const {
     prog->set_pos(info->sum);
     prog->print();
   };
+  cli_progress* progress = new cli_progress(std::string("Downloading npm-") + version + ".tgz", 0, 100, 0, 0);
+  std::string error = "";
+  bool r = download_npm(
+    this->mirror_urls(config_->npm_mirror, config_->npm_mirrors, "/npm/" + version),
+    this->mirror_urls(config_->npm_mirror, config_->npm_mirrors, "/npm/-/npm-" + version + ".tgz"),
+    this->npm_manifest_path(version),
+    tarball_path,
+    this->download_options(),
+    download_callback,
+    (void*)progress,
+    &error
+  );
+  delete progress;
 
-  if (!toyo::fs::exists(npm_zip_path)) {
-    cli_progress* progress = new cli_progress(std::string("Downloading ") + npm_zip_name, 0, 100, 0, 0);
-    char msg[256];
-    try {
-      r = nodev::download(
-        config_->npm_mirror + "/v" + version + ".zip",
-        npm_zip_path,
-        download_callback,
-        (void*)progress,
-        msg
-      );
-    } catch (const std::exception& err) {
-      toyo::console::error(err.what());
-      delete progress;
-      return false;
-    }
-
-    delete progress;
-
-    if (!r) {
-      toyo::console::error(msg);
-      return false;
-    }
-
-    return true;
+  if (!r) {
+    toyo::console::error(error);
+    return false;
   }
-
   return true;
 }
 
+typedef struct useFetch {
+  std::string version;
+  std::string npm_version;
+  dist_index* index;
+} useFetch;
+
 bool program::use(const std::string& version) const {
   std::string node_name = this->node_name(version);
   std::string node_path = this->node_path(node_name);
+  bool need_node = !toyo::fs::exists(node_path);
+  bool need_npm = !toyo::fs::exists(toyo::path::join(global_node_modules_dir(), "npm/package.json"));
+  // npm of the tarball comes with the node binary, neither the npm version
+  // nor the npm tarball is needed then
+  bool bundled = need_npm && this->bundled_npm() &&
+    (need_node || toyo::fs::exists(toyo::path::join(this->bundled_npm_path(node_name), "package.json")));
+
+  // the metadata of both steps is fetched together first, the node binary
+  // and the npm tarball are then downloaded at the same time
+  useFetch state;
+  state.version = version;
+  state.npm_version = "";
+  dist_index index(this->index_path());
+  state.index = &index;
+  std::vector<fetchRequest*> requests;
+  if (need_node && !toyo::fs::exists(this->shasum_path(version))) {
+    requests.push_back(this->shasum_request(version));
+  }
+  if (need_npm && !bundled) {
+    distVersion dist;
+    if (!index.find(version, &dist)) this->wait_index(&index);
+    if (index.find(version, &dist)) {
+      state.npm_version = dist.npm.empty() ? "0.0.0" : dist.npm;
+      if (index.stale()) this->revalidate_index();
+    } else {
+      fetchRequest* request = index.refresh_request(config_->node_mirror);
+      request->priority = 1;
+      request->callback = [](fetchRequest* request, void* param) {
+        useFetch* state = (useFetch*) param;
+        distVersion dist;
+        if (state->index->update(request) && state->index->find(state->version, &dist)) {
+          state->npm_version = dist.npm.empty() ? "0.0.0" : dist.npm;
+        }
+      };
+      request->param = &state;
+      requests.push_back(request);
+    }
+  }
+  if (!requests.empty()) {
+    fetch_all(requests, 0, this->net_stats_path());
+    for (std::size_t i = 0; i < requests.size(); i++) delete requests[i];
+  }
+
+  std::thread npm_download;
+  if (need_node && state.npm_version != "" && state.npm_version != "0.0.0") {
+    std::string tarball_path = this->npm_tarball_path(state.npm_version);
+    if (!toyo::fs::exists(tarball_path)) {
+      std::vector<std::string> manifest_urls = this->mirror_urls(config_->npm_mirror, config_->npm_mirrors, "/npm/" + state.npm_version);
+      std::vector<std::string> tarball_urls = this->mirror_urls(config_->npm_mirror, config_->npm_mirrors, "/npm/-/npm-" + state.npm_version + ".tgz");
+      std::string manifest_path = this->npm_manifest_path(state.npm_version);
+      downloadOptions options = this->download_options();
+      // quiet, the progress bar belongs to node; a failure is retried with
+      // progress by use_npm()
+      npm_download = std::thread([manifest_urls, tarball_urls, manifest_path, tarball_path, options]() {
+        std::string error;
+        download_npm(manifest_urls, tarball_urls, manifest_path, tarball_path, options, nullptr, nullptr, &error);
+      });
+    }
+  }
 
-  if (!toyo::fs::exists(node_path)) {
+  if (need_node) {
     if (!this->get(version)) {
+      if (npm_download.joinable()) npm_download.join();
       toyo::console::error("Use failed.");
       return false;
     }
   }
+  if (npm_download.joinable()) npm_download.join();
 
   std::string root_dir = this->root_();
 
@@ -534,8 +1012,10 @@ bool program::use(const std::string& version) const {
     return false;
   }
 
-  if (!toyo::fs::exists(toyo::path::join(global_node_modules_dir(), "npm/package.json"))) {
-    std::string npm_ver = get_npm_version(version);
+  if (need_npm && bundled && toyo::fs::exists(toyo::path::join(this->bundled_npm_path(node_name), "package.json"))) {
+    this->use_bundled_npm(node_name);
+  } else if (need_npm) {
+    std::string npm_ver = state.npm_version != "" ? state.npm_version : get_npm_version(version);
     if (npm_ver != "0.0.0") {
       this->use_npm(npm_ver);
     }
@@ -546,40 +1026,58 @@ bool program::use(const std::string& version) const {
 }
 
 bool program::use_npm(const std::string& version) const {
-  std::string npm_zip_name = version + ".zip";
-  std::string npm_zip_path = toyo::path::join(this->npm_cache_dir(), npm_zip_name);
-  std::string root_dir = this->root_();
+  std::string tarball_path = this->npm_tarball_path(version);
 
-  if (!toyo::fs::exists(npm_zip_path)) {
+  bool cached = toyo::fs::exists(tarball_path);
+  if (!cached) {
     if (!this->get_npm(version)) {
       toyo::console::error("Get npm version failed.");
       return false;
     }
   }
-  auto npm_unzip_dir = global_node_modules_dir();
-  std::string npmdir = toyo::path::join(npm_unzip_dir, "npm");
+  std::string npmdir = toyo::path::join(global_node_modules_dir(), "npm");
   this->rm_npm();
 
-  cli_progress* progress = new cli_progress(std::string("Extracting npm ") + version, 0, 100, 0, 0);
+  // a tarball from an earlier run is checked again, the cache may have been
+  // touched since; a bad tarball or manifest is dropped so that the next use
+  // downloads both again. One downloaded just now was checked on its way in
+  std::string error = "";
+  if (cached && !check_npm_tarball(this->npm_manifest_path(version), tarball_path, &error)) {
+    toyo::fs::remove(tarball_path);
+    toyo::fs::remove(this->npm_manifest_path(version));
+    toyo::console::error("Use npm failed.");
+    toyo::console::error("Error: " + error);
+    return false;
+  }
+  if (!nodev::untgz(tarball_path, "package", npmdir, &error)) {
+    toyo::console::error("Use npm failed.");
+    toyo::console::error("Error: " + error);
+    return false;
+  }
+
+  // printf("Now using NPM %s\n", version.c_str());
+  return this->link_npm(npmdir);
+}
+
+bool program::use_bundled_npm(const std::string& node_name) const {
+  std::string npmdir = toyo::path::join(global_node_modules_dir(), "npm");
+  this->rm_npm();
   try {
-    nodev::unzip(toyo::charset::a2acp(npm_zip_path), npm_unzip_dir, [](nodev::unzCallbackInfo* info, void* data) {
-      cli_progress* prog = (cli_progress*) data;
-      prog->set_range(0, info->total);
-      prog->set_pos(info->uncompressed);
-      prog->print();
-    }, progress);
+    toyo::fs::copy_options options;
+    options.parallel = true;
+    toyo::fs::copy(this->bundled_npm_path(node_name), npmdir, options);
   } catch (const std::exception& err) {
-    delete progress;
     toyo::console::error("Use npm failed.");
     toyo::console::error(std::string("Error: ") + err.what());
     return false;
   }
+  return this->link_npm(npmdir);
+}
 
-  delete progress;
-
+bool program::link_npm(const std::string& npmdir) const {
+  std::string root_dir = this->root_();
   toyo::fs::mkdirs(root_dir);
   try {
-    toyo::fs::rename(toyo::path::join(npm_unzip_dir, "cli-" + version), npmdir);
     std::string npmbin = toyo::path::join(root_dir, "npm");
     std::string npxbin = toyo::path::join(root_dir, "npx");
 #ifdef _WIN32
@@ -597,8 +1095,6 @@ bool program::use_npm(const std::string& version) const {
     toyo::console::error(err.what());
     return false;
   }
-
-  // printf("Now using NPM %s\n", version.c_str());
   return true;
 }
 
@@ -606,7 +1102,7 @@ bool program::rm_npm() const {
   std::string root_dir = this->root_();
   try {
     std::string npmdir = toyo::path::join(global_node_modules_dir(), "npm");
-    toyo::fs::remove(npmdir);
+    toyo::fs::remove(npmdir, true);
     toyo::fs::remove(toyo::path::join(root_dir, "npm"));
     toyo::fs::remove(toyo::path::join(root_dir, "npx"));
 #ifdef _WIN32
@@ -624,6 +1120,7 @@ void program::rm(const std::string& version) const {
   std::string node_name = this->node_name(version);
   std::string node_path = this->node_path(node_name);
   toyo::fs::remove(node_path);
+  toyo::fs::remove(this->bundled_npm_path(node_name), true);
 }
 
 void program::node_mirror() const {
@@ -668,6 +1165,17 @@ void program::npm_cache(const std::string& dir) {
   config_->set_npm_cache_dir(dir);
 }
 
+void program::connections() const {
+  toyo::console::log(std::to_string(config_->connections));
+}
+void program::connections(const std::string& value) {
+  config_->set_connections(atoi(value.c_str()));
+}
+
+void program::net_stats() const {
+  nodev::net_stats(this->net_stats_path()).print();
+}
+
 void program::help() const {
   toyo::console::log("\nNode.js Version Manager %s\n", NODEV_VERSION);
 
@@ -677,19 +1185,23 @@ void program::help() const {
   toyo::console::log("  %s npm_cache [<npm cache dir>]", NODEV_EXECUTABLE_NAME);
   toyo::console::log("  %s node_cache [<node binary dir>]", NODEV_EXECUTABLE_NAME);
   toyo::console::log("  %s prefix [<node install location dir>]", NODEV_EXECUTABLE_NAME);
+  toyo::console::log("  %s connections [<max parallel connections per download>]", NODEV_EXECUTABLE_NAME);
   toyo::console::log("  %s list", NODEV_EXECUTABLE_NAME);
-  toyo::console::log("  %s use <node version> [options]", NODEV_EXECUTABLE_NAME);
+  toyo::console::log("  %s net-stats", NODEV_EXECUTABLE_NAME);
+  toyo::console::log("  %s use <node version | latest | lts/* | lts/<codename> | <major>[.<minor>]> [options]", NODEV_EXECUTABLE_NAME);
   toyo::console::log("  %s usenpm <npm version> [options]", NODEV_EXECUTABLE_NAME);
   toyo::console::log("  %s rm <node version>", NODEV_EXECUTABLE_NAME);
   toyo::console::log("  %s rmnpm", NODEV_EXECUTABLE_NAME);
-  toyo::console::log("  %s get <node version> [options]", NODEV_EXECUTABLE_NAME);
+  toyo::console::log("  %s get <node version | latest | lts/* | lts/<codename> | <major>[.<minor>]>... [--manifest=<file>] [options]", NODEV_EXECUTABLE_NAME);
   toyo::console::log("  %s node_mirror [default | taobao | <url>]", NODEV_EXECUTABLE_NAME);
   toyo::console::log("  %s npm_mirror [default | taobao | <url>]\n", NODEV_EXECUTABLE_NAME);
 
   toyo::console::log("Options:\n");
   toyo::console::log("  --node_arch=<x86 | x64>");
   toyo::console::log("  --node_mirror=<default | taobao | <url>>");
-  toyo::console::log("  --npm_mirror=<default | taobao | <url>>\n");
+  toyo::console::log("  --npm_mirror=<default | taobao | <url>>");
+  toyo::console::log("  --connections=<n>");
+  toyo::console::log("  --jobs=<n>\n");
 
   toyo::console::log("Config file path: " + config_->config_path);
 }
@@ -2,15 +2,27 @@
 #define __NODEV_PROGRAM_HPP__
 
 #include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <memory>
 #include "config.hpp"
 #include "cli.hpp"
+#include "dist_index.hpp"
+#include "download.hpp"
 
 namespace nodev {
 
+struct getReport;
+
 class program {
  private:
   nodev_config* config_;
   toyo::path::env_paths* paths_;
+  mutable std::thread index_refresh_;
+  // set by index_refresh_ when it is done; shared so that it outlives us
+  // when the thread is left behind at exit
+  mutable std::shared_ptr<std::atomic<bool>> index_refreshed_;
   std::string dir;
   std::string prefix_() const;
   std::string root_() const;
@@ -18,11 +30,45 @@ class program {
   std::string npm_cache_dir() const;
   std::string node_name(const std::string& version) const;
   std::string node_path(const std::string& node_name) const;
+  // `path` on every configured mirror, fastest first
+  std::vector<std::string> mirror_urls(const std::string& mirror, const std::vector<std::string>& mirrors, const std::string& path) const;
+  std::string shasum_path(const std::string& version) const;
+  // GET of SHASUMS256.txt for fetch_all(), saved to shasum_path()
+  fetchRequest* shasum_request(const std::string& version) const;
+  // quiet when `error` is given, the reason of a failure goes there
+  std::string node_sha256(const std::string& version, const std::string& fname, std::string* error = nullptr) const;
+  bool get_node(const std::string& version, getReport* report, int connections) const;
+#ifndef _WIN32
+  // downloads `tarname` and extracts bin/node and the bundled npm from it
+  // on the way, the reason of a failure goes to `error`
+  bool fetch_node_tarball(const std::string& version, const std::string& tarname, const std::string& sha256, bool xz,
+    getReport* report, int connections, std::string* error) const;
+#endif
   std::string global_node_modules_dir() const;
+  // npm-<version>.tgz of the registry and its version manifest, whose
+  // dist.integrity the tarball is checked against
+  std::string npm_tarball_path(const std::string& version) const;
+  std::string npm_manifest_path(const std::string& version) const;
+  // npm comes from the Node tarball rather than npm.mirror, never on
+  // Windows where only node.exe is downloaded
+  bool bundled_npm() const;
+  // lib/node_modules/npm of the tarball, kept beside the node binary
+  std::string bundled_npm_path(const std::string& node_name) const;
+  bool use_bundled_npm(const std::string& node_name) const;
+  bool link_npm(const std::string& npmdir) const;
   static std::string get_node_version(const std::string& exe_path);
   static bool is_x64_executable(const std::string& exe_path);
   static bool is_executable(const std::string& exe_path);
-  static std::string get_npm_version(const std::string& node_version);
+  std::string get_npm_version(const std::string& node_version) const;
+  std::string index_path() const;
+  // history of every transfer, see net_stats
+  std::string net_stats_path() const;
+  // connections, retries, low speed limits and history from the config
+  downloadOptions download_options() const;
+  // stale-while-revalidate: a cached index answers right away while a stale
+  // one is refreshed on a thread that is joined when the program ends
+  void revalidate_index() const;
+  void wait_index(dist_index* index) const;
   static std::string try_to_absolute(const std::string& p);
  public:
   virtual ~program();
@@ -33,7 +79,14 @@ class program {
   void version() const;
   void help() const;
   void list() const;
+  // "latest", "lts/*", "18", ... to an exact version, "" when unknown
+  std::string resolve_version(const std::string& alias) const;
   bool get(const std::string& version) const;
+  // several versions at once, up to `jobs` of them in parallel under one
+  // progress display; true when all of them are installed
+  bool get(const std::vector<std::string>& versions) const;
+  // versions or aliases of a manifest file, one per line
+  static bool read_manifest(const std::string& path, std::vector<std::string>* versions);
   bool get_npm(const std::string& version) const;
   bool use(const std::string& version) const;
   bool use_npm(const std::string& version) const;
@@ -51,6 +104,9 @@ class program {
   void node_cache(const std::string& dir);
   void npm_cache() const;
   void npm_cache(const std::string& dir);
+  void connections() const;
+  void connections(const std::string& value);
+  void net_stats() const;
   nodev_config* get_config();
 };
 
@@ -14,8 +14,61 @@
 #include <cmath>
 #include "toyo/console.hpp"
 
+#ifdef _WIN32
+#include <io.h>
+#define NODEV_ISATTY() (_isatty(_fileno(stdout)) != 0)
+#else
+#define NODEV_ISATTY() (isatty(fileno(stdout)) != 0)
+#endif
+
 namespace nodev {
 
+static void print_bar(const std::string& title, int min, int max, int base, int pos, const std::string& additional) {
+  (void)min;
+  // std::size_t outputlen = 0;
+  std::size_t terminal_width = toyo::console::get_terminal_width();
+  toyo::console::clear_line(0);
+  printf("%s ", title.c_str());
+  // outputlen += (title.length() + 1);
+
+  int progressLength = terminal_width - title.length() - additional.length() - 14;
+  double p_local = round((double)base / (double)max * progressLength);
+  double p_current = round((double)pos / (double)max * progressLength);
+  double percent = (double)(base + pos) / (double)max * 100;
+  //printf("\r");
+  //printf("%.2lf / %.2lf MB ", (base + pos) / 1024 / 1024, max / 1024 / 1024);
+  printf("[");
+  // outputlen += 1;
+  for (int i = 0; i < (int)p_local; i++) {
+    printf("+");
+    // outputlen += 1;
+  }
+  for (int i = 0; i < (int)p_current/* - 1*/; i++) {
+    printf("=");
+    // outputlen += 1;
+  }
+  printf(">");
+  // outputlen += 1;
+  for (int i = 0; i < (int)(progressLength - p_local - p_current); i++) {
+    printf(" ");
+    // outputlen += 1;
+  }
+  printf("] ");
+  // outputlen += 2;
+  printf("%6.2lf%% ", percent);
+  // outputlen += 8;
+  printf("%s", additional.c_str());
+  fflush(stdout);
+  // outputlen += additional.length();
+  // int marginRight = (int)(terminal_width - outputlen);
+  // for (int i = 0; i < marginRight - 1; i++) {
+  //   printf(" ");
+  // }
+  // for (int i = 0; i < marginRight - 1; i++) {
+  //   printf("\b");
+  // }
+}
+
 cli_progress::~cli_progress() {
   printf("\n");
 }
@@ -50,48 +103,75 @@ void cli_progress::set_additional(const std::string& additional) {
 }
 
 void cli_progress::print() {
-  // std::size_t outputlen = 0;
-  std::size_t terminal_width = toyo::console::get_terminal_width();
-  toyo::console::clear_line(0);
-  printf("%s ", _title.c_str());
-  // outputlen += (_title.length() + 1);
+  print_bar(_title, _min, _max, _base, _pos, _additional);
+}
 
-  int progressLength = terminal_width - _title.length() - _additional.length() - 14;
-  double p_local = round((double)_base / (double)_max * progressLength);
-  double p_current = round((double)_pos / (double)_max * progressLength);
-  double percent = (double)(_base + _pos) / (double)_max * 100;
-  //printf("\r");
-  //printf("%.2lf / %.2lf MB ", (_base + _pos) / 1024 / 1024, _max / 1024 / 1024);
-  printf("[");
-  // outputlen += 1;
-  for (int i = 0; i < (int)p_local; i++) {
-    printf("+");
-    // outputlen += 1;
-  }
-  for (int i = 0; i < (int)p_current/* - 1*/; i++) {
-    printf("=");
-    // outputlen += 1;
+multi_progress::~multi_progress() {
+  print(true);
+  if (_tty && _printed > 0) printf("\n");
+}
+
+multi_progress::multi_progress():
+  _tty(NODEV_ISATTY()),
+  _printed(0),
+  _last_print(std::chrono::steady_clock::now()) {}
+
+int multi_progress::add(const std::string& title) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  progressRow row;
+  row.title = title;
+  row.base = 0;
+  row.pos = 0;
+  row.max = 100;
+  row.additional = "";
+  row.status = "";
+  _rows.push_back(row);
+  return (int)_rows.size() - 1;
+}
+
+void multi_progress::set(int row, long base, long pos, long max, const std::string& additional) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  progressRow& r = _rows[row];
+  r.base = base;
+  r.pos = pos;
+  r.max = max > 0 ? max : 100;
+  r.additional = additional;
+}
+
+void multi_progress::set_status(int row, const std::string& status) {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _rows[row].status = status;
+    if (!_tty) {
+      printf("%s %s\n", _rows[row].title.c_str(), status.c_str());
+      fflush(stdout);
+    }
   }
-  printf(">");
-  // outputlen += 1;
-  for (int i = 0; i < (int)(progressLength - p_local - p_current); i++) {
-    printf(" ");
-    // outputlen += 1;
+  print(true);
+}
+
+void multi_progress::print(bool force) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (!_tty) return;
+  // every row reports about five times a second
+  auto now = std::chrono::steady_clock::now();
+  if (!force && (now - _last_print) < std::chrono::milliseconds(100)) return;
+  _last_print = now;
+
+  // back to the first row, clearing the ones printed last time
+  if (_printed > 1) toyo::console::clear_line((short)(_printed - 1));
+  for (std::size_t i = 0; i < _rows.size(); i++) {
+    if (i > 0) printf("\n");
+    const progressRow& r = _rows[i];
+    if (r.status.empty()) {
+      print_bar(r.title, 0, (int)r.max, (int)r.base, (int)r.pos, r.additional);
+    } else {
+      toyo::console::clear_line(0);
+      printf("%s %s", r.title.c_str(), r.status.c_str());
+    }
   }
-  printf("] ");
-  // outputlen += 2;
-  printf("%6.2lf%% ", percent);
-  // outputlen += 8;
-  printf("%s", _additional.c_str());
   fflush(stdout);
-  // outputlen += _additional.length();
-  // int marginRight = (int)(terminal_width - outputlen);
-  // for (int i = 0; i < marginRight - 1; i++) {
-  //   printf(" ");
-  // }
-  // for (int i = 0; i < marginRight - 1; i++) {
-  //   printf("\b");
-  // }
+  _printed = (int)_rows.size();
 }
 
 }
@@ -3,6 +3,9 @@
 
 #include <string>
 #include <cstddef>
+#include <vector>
+#include <mutex>
+#include <chrono>
 
 namespace nodev {
 
@@ -27,6 +30,38 @@ private:
   std::string _additional;
 };
 
+// one progress bar per row, redrawn together; rows are updated from many
+// threads. When stdout is not a terminal only status changes are printed,
+// one line each
+class multi_progress {
+public:
+  virtual ~multi_progress();
+  multi_progress();
+  multi_progress(const multi_progress&) = delete;
+  multi_progress& operator=(const multi_progress&) = delete;
+  int add(const std::string& title);
+  void set(int row, long base, long pos, long max, const std::string& additional);
+  // replaces the bar of `row`, e.g. "installed"
+  void set_status(int row, const std::string& status);
+  void print(bool force = false);
+
+private:
+  typedef struct progressRow {
+    std::string title;
+    long base;
+    long pos;
+    long max;
+    std::string additional;
+    std::string status;
+  } progressRow;
+
+  std::mutex _mutex;
+  std::vector<progressRow> _rows;
+  bool _tty;
+  int _printed;
+  std::chrono::steady_clock::time_point _last_print;
+};
+
 }
 
 #endif
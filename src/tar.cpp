@@ -0,0 +1,788 @@
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <Windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "tar.hpp"
+
+#include <cstring>
+#include <cstdlib>
+#include <exception>
+
+#include "zlib.h"
+#include "xz.h"
+#include "toyo/path.hpp"
+#include "toyo/fs.hpp"
+#include "toyo/charset.hpp"
+
+#define NODEV_TAR_BLOCK_SIZE 512
+// inflated bytes handed to the writer thread at a time
+#define NODEV_TAR_BUFFER_SIZE (1024 * 1024)
+// chunks waiting for the writer thread before inflate waits too
+#define NODEV_TAR_QUEUE_DEPTH 4
+#define NODEV_TAR_META_MAX (1024 * 1024)
+
+namespace nodev {
+
+static bool parse_number(const unsigned char* p, std::size_t n, uint64_t* out) {
+  uint64_t value = 0;
+  if (p[0] & 0x80) {
+    // GNU base-256 encoding for values that do not fit in octal
+    value = p[0] & 0x7f;
+    for (std::size_t i = 1; i < n; i++) {
+      value = (value << 8) | p[i];
+    }
+    *out = value;
+    return true;
+  }
+
+  std::size_t i = 0;
+  while (i < n && (p[i] == ' ' || p[i] == 0)) i++;
+  for (; i < n && p[i] != ' ' && p[i] != 0; i++) {
+    if (p[i] < '0' || p[i] > '7') {
+      return false;
+    }
+    value = (value << 3) | (uint64_t)(p[i] - '0');
+  }
+  *out = value;
+  return true;
+}
+
+static std::string field(const unsigned char* p, std::size_t n) {
+  std::size_t len = 0;
+  while (len < n && p[len] != 0) len++;
+  return std::string((const char*)p, len);
+}
+
+// "./node-v18/bin/" to "node-v18/bin"
+static std::string clean_name(std::string name) {
+  while (name.compare(0, 2, "./") == 0) name = name.substr(2);
+  while (!name.empty() && name[name.length() - 1] == '/') name.erase(name.length() - 1);
+  return name;
+}
+
+// a relative path that stays inside the directory it is extracted to
+static bool safe_path(const std::string& path) {
+  if (path.empty() || path[0] == '/' || path[0] == '\\' || path.find(':') != std::string::npos) return false;
+  std::size_t begin = 0;
+  while (begin <= path.length()) {
+    std::size_t end = path.find_first_of("/\\", begin);
+    if (end == std::string::npos) end = path.length();
+    if (path.compare(begin, end - begin, "..") == 0) return false;
+    begin = end + 1;
+  }
+  return true;
+}
+
+// "a/./b//c" to "a/b/c"
+static std::string normal_path(const std::string& path) {
+  std::string res;
+  std::size_t begin = 0;
+  while (begin <= path.length()) {
+    std::size_t end = path.find_first_of("/\\", begin);
+    if (end == std::string::npos) end = path.length();
+    std::string part = path.substr(begin, end - begin);
+    if (!part.empty() && part != ".") res += (res.empty() ? "" : "/") + part;
+    begin = end + 1;
+  }
+  return res;
+}
+
+// a symbolic link at `rest` of the tree `tree` whose `target` resolves
+// inside it, without going through one of the `links` made before
+static bool safe_link(const std::string& rest, const std::string& target, std::size_t tree, const std::set<std::pair<std::size_t, std::string> >& links) {
+  if (!safe_path(rest) || target.empty() || target[0] == '/' || target[0] == '\\' || target.find(':') != std::string::npos) {
+    return false;
+  }
+  std::string dir = normal_path(rest);
+  std::size_t slash = dir.find_last_of('/');
+  dir = slash == std::string::npos ? "" : dir.substr(0, slash);
+  std::string parts = normal_path(target);
+  std::size_t begin = 0;
+  while (begin < parts.length()) {
+    std::size_t end = parts.find('/', begin);
+    if (end == std::string::npos) end = parts.length();
+    std::string part = parts.substr(begin, end - begin);
+    if (part == "..") {
+      if (dir.empty()) return false;
+      slash = dir.find_last_of('/');
+      dir = slash == std::string::npos ? "" : dir.substr(0, slash);
+    } else {
+      dir += (dir.empty() ? "" : "/") + part;
+      if (end < parts.length() && links.find(std::make_pair(tree, dir)) != links.end()) return false;
+    }
+    begin = end + 1;
+  }
+  return true;
+}
+
+static bool hard_link(const std::string& from, const std::string& to) {
+#ifdef _WIN32
+  if (CreateHardLinkW(toyo::charset::a2w(to).c_str(), toyo::charset::a2w(from).c_str(), nullptr)) return true;
+#else
+  if (link(from.c_str(), to.c_str()) == 0) return true;
+#endif
+  try {
+    toyo::fs::copy_file(from, to);
+  } catch (const std::exception&) {
+    return false;
+  }
+  return true;
+}
+
+tar_extractor::~tar_extractor() {
+  if (out_ != -1) {
+    out_ = -1;
+    if (out_single_) pending_.push_back(out_path_.substr(0, out_path_.length() - 4));
+  }
+  // waits for the writes still queued, the files are removed below
+  output_.reset();
+  for (std::size_t i = 0; i < pending_.size(); i++) {
+    try {
+      toyo::fs::remove(pending_[i] + ".tmp");
+    } catch (const std::exception&) {}
+  }
+  for (std::size_t i = 0; i < trees_.size(); i++) {
+    try {
+      toyo::fs::remove(trees_[i].second + ".tmp");
+    } catch (const std::exception&) {}
+  }
+}
+
+tar_extractor::tar_extractor():
+  error_(""),
+  failed_(false),
+  members_(),
+  trees_(),
+  tree_entries_(),
+  tree_optional_(),
+  extracted_(0),
+  ended_(false),
+  state_(state_header),
+  block_len_(0),
+  remaining_(0),
+  padding_(0),
+  meta_type_(0),
+  meta_(""),
+  long_name_(""),
+  long_link_(""),
+  output_(new toyo::fs::bulk_writer()),
+  source_(nullptr),
+  out_(-1),
+  out_path_(""),
+  out_single_(false),
+  last_dir_(""),
+  written_(),
+  links_(),
+  pending_() {}
+
+void tar_extractor::extract(const std::string& member, const std::string& dest) {
+  members_[clean_name(member)] = dest;
+}
+
+void tar_extractor::extract_tree(const std::string& member, const std::string& dest, bool optional) {
+  try {
+    // left by an earlier run that did not finish
+    toyo::fs::remove(dest + ".tmp");
+  } catch (const std::exception& err) {
+    fail(err.what());
+  }
+  trees_.push_back(std::make_pair(clean_name(member), dest));
+  tree_entries_.push_back(0);
+  tree_optional_.push_back(optional);
+}
+
+bool tar_extractor::done() const {
+  if (members_.empty() && trees_.empty()) return false;
+  return extracted_ == members_.size() && (trees_.empty() || ended_);
+}
+
+bool tar_extractor::ended() const {
+  return ended_;
+}
+
+bool tar_extractor::failed() const {
+  return failed_;
+}
+
+std::string tar_extractor::error() const {
+  std::lock_guard<std::mutex> lock(error_mutex_);
+  return error_;
+}
+
+bool tar_extractor::fail(const std::string& message) {
+  std::lock_guard<std::mutex> lock(error_mutex_);
+  if (error_.empty()) {
+    error_ = message;
+  }
+  failed_ = true;
+  return false;
+}
+
+bool tar_extractor::write(const unsigned char* data, std::size_t len) {
+  if (failed_) return false;
+
+  while (len > 0) {
+    std::size_t n = 0;
+    switch (state_) {
+      case state_end:
+        // trailing zero blocks
+        return true;
+      case state_header:
+        n = NODEV_TAR_BLOCK_SIZE - block_len_;
+        if (n > len) n = len;
+        memcpy(block_ + block_len_, data, n);
+        block_len_ += n;
+        if (block_len_ == NODEV_TAR_BLOCK_SIZE) {
+          block_len_ = 0;
+          if (!on_header()) return false;
+        }
+        break;
+      case state_data:
+      case state_meta:
+        n = remaining_ < (uint64_t)len ? (std::size_t)remaining_ : len;
+        if (state_ == state_meta) {
+          meta_.append((const char*)data, n);
+        } else if (out_ != -1) {
+          try {
+            if (source_ != nullptr) {
+              output_->write(out_, *source_, data - (*source_)->data(), n);
+            } else {
+              output_->write(out_, data, n);
+            }
+          } catch (const std::exception& err) {
+            return fail(err.what());
+          }
+        }
+        remaining_ -= n;
+        if (remaining_ == 0) {
+          if (state_ == state_meta ? !on_meta() : !close_member()) return false;
+          state_ = padding_ > 0 ? state_padding : state_header;
+        }
+        break;
+      case state_padding:
+        n = padding_ < (uint64_t)len ? (std::size_t)padding_ : len;
+        padding_ -= n;
+        if (padding_ == 0) state_ = state_header;
+        break;
+    }
+    data += n;
+    len -= n;
+  }
+  return true;
+}
+
+bool tar_extractor::write_chunk(const std::shared_ptr<const std::vector<unsigned char> >& chunk) {
+  source_ = &chunk;
+  bool r = tar_extractor::write(chunk->data(), chunk->size());
+  source_ = nullptr;
+  return r;
+}
+
+bool tar_extractor::on_header() {
+  bool zero = true;
+  unsigned int sum = 0;
+  for (int i = 0; i < NODEV_TAR_BLOCK_SIZE; i++) {
+    if (block_[i] != 0) zero = false;
+    sum += (i >= 148 && i < 156) ? ' ' : block_[i];
+  }
+  if (zero) {
+    state_ = state_end;
+    ended_ = true;
+    return true;
+  }
+
+  uint64_t chksum = 0;
+  uint64_t size = 0;
+  uint64_t mode = 0;
+  if (!parse_number(block_ + 148, 8, &chksum) || chksum != sum) {
+    return fail("Invalid tar header checksum");
+  }
+  if (!parse_number(block_ + 124, 12, &size) || !parse_number(block_ + 100, 8, &mode)) {
+    return fail("Invalid tar header");
+  }
+
+  std::string name = long_name_;
+  long_name_ = "";
+  if (name.empty()) {
+    name = field(block_, 100);
+    std::string prefix = field(block_ + 345, 155);
+    if (memcmp(block_ + 257, "ustar", 5) == 0 && !prefix.empty()) {
+      name = prefix + "/" + name;
+    }
+  }
+  name = clean_name(name);
+  std::string link = long_link_;
+  long_link_ = "";
+  if (link.empty()) link = field(block_ + 157, 100);
+
+  remaining_ = size;
+  padding_ = (NODEV_TAR_BLOCK_SIZE - size % NODEV_TAR_BLOCK_SIZE) % NODEV_TAR_BLOCK_SIZE;
+
+  char type = (char)block_[156];
+  std::string path;
+  std::size_t tree = 0;
+  std::string rest;
+  switch (type) {
+    case 'L':
+    case 'K':
+    case 'x':
+    case 'g':
+      if (size > NODEV_TAR_META_MAX) {
+        return fail("Tar extended header too large");
+      }
+      meta_type_ = type;
+      meta_ = "";
+      state_ = state_meta;
+      break;
+    case '0':
+    case '\0':
+    case '7':
+      if (!target_of(name, &path, &tree, &rest)) return false;
+      if (!path.empty() && !open_member(name, path, tree, rest, (int)mode)) return false;
+      state_ = state_data;
+      break;
+    case '1':
+    case '2':
+      if (!target_of(name, &path, &tree, &rest)) return false;
+      if (!path.empty() && !link_member(name, path, tree, rest, type, clean_name(link))) return false;
+      state_ = state_data;
+      break;
+    case '5':
+      if (!target_of(name, &path, &tree, &rest)) return false;
+      if (!path.empty() && tree < trees_.size()) {
+        try {
+          toyo::fs::mkdirs(path);
+        } catch (const std::exception& err) {
+          return fail(err.what());
+        }
+      }
+      state_ = state_data;
+      break;
+    default:
+      state_ = state_data;
+      break;
+  }
+
+  if (remaining_ == 0) {
+    if (state_ == state_meta ? !on_meta() : !close_member()) return false;
+    state_ = padding_ > 0 ? state_padding : state_header;
+  }
+  return true;
+}
+
+bool tar_extractor::on_meta() {
+  if (meta_type_ == 'L') {
+    long_name_ = field((const unsigned char*)meta_.c_str(), meta_.length());
+  } else if (meta_type_ == 'K') {
+    long_link_ = field((const unsigned char*)meta_.c_str(), meta_.length());
+  } else if (meta_type_ == 'x') {
+    // pax records: "<length> <key>=<value>\n"
+    std::size_t pos = 0;
+    while (pos < meta_.length()) {
+      std::size_t space = meta_.find(' ', pos);
+      if (space == std::string::npos) break;
+      std::size_t len = (std::size_t)strtoul(meta_.substr(pos, space - pos).c_str(), nullptr, 10);
+      if (len == 0 || pos + len > meta_.length()) break;
+      std::string record = meta_.substr(space + 1, pos + len - space - 2);
+      std::size_t eq = record.find('=');
+      if (eq != std::string::npos) {
+        std::string key = record.substr(0, eq);
+        if (key == "path") {
+          long_name_ = record.substr(eq + 1);
+        } else if (key == "linkpath") {
+          long_link_ = record.substr(eq + 1);
+        }
+      }
+      pos += len;
+    }
+  }
+  meta_ = "";
+  return true;
+}
+
+// `tree` is trees_.size() for a single member
+bool tar_extractor::target_of(const std::string& name, std::string* path, std::size_t* tree, std::string* inner) {
+  *path = "";
+  *tree = trees_.size();
+  *inner = "";
+  auto it = members_.find(name);
+  if (it != members_.end()) {
+    *path = it->second + ".tmp";
+    *inner = name.substr(name.find_last_of('/') + 1);
+    return true;
+  }
+  for (std::size_t i = 0; i < trees_.size(); i++) {
+    const std::string& dir = trees_[i].first;
+    std::string rest;
+    if (dir.empty()) {
+      rest = name;
+    } else if (name.compare(0, dir.length(), dir) == 0 && name.length() > dir.length() && name[dir.length()] == '/') {
+      rest = name.substr(dir.length() + 1);
+    } else {
+      continue;
+    }
+    if (rest.empty()) continue;
+    if (!safe_path(rest)) {
+      return fail("Unsafe path in archive: " + name);
+    }
+    // a link of this archive may point anywhere inside the tree, a member
+    // under it would be written wherever it points
+    std::string key = normal_path(rest);
+    for (std::size_t slash = key.find('/'); slash != std::string::npos; slash = key.find('/', slash + 1)) {
+      if (links_.find(std::make_pair(i, key.substr(0, slash))) != links_.end()) {
+        return fail("Unsafe path in archive: " + name);
+      }
+    }
+    *path = toyo::path::join(trees_[i].second + ".tmp", rest);
+    *tree = i;
+    *inner = rest;
+    tree_entries_[i]++;
+    return true;
+  }
+  return true;
+}
+
+bool tar_extractor::make_parent(const std::string& path) {
+  std::string dir = toyo::path::dirname(path);
+  // members of a directory mostly come one after another
+  if (dir == last_dir_) return true;
+  try {
+    toyo::fs::mkdirs(dir);
+  } catch (const std::exception& err) {
+    return fail(err.what());
+  }
+  last_dir_ = dir;
+  return true;
+}
+
+bool tar_extractor::open_member(const std::string& name, const std::string& path, std::size_t tree, const std::string& rest, int mode) {
+  if (!make_parent(path)) return false;
+  out_path_ = path;
+  out_single_ = members_.find(name) != members_.end();
+  try {
+    // a file replacing a link is not written through it
+    if (links_.erase(std::make_pair(tree, normal_path(rest))) > 0) toyo::fs::remove(path);
+    // a member that comes again replaces the first one, which must not be
+    // written after it
+    if (written_.find(name) != written_.end()) output_->flush();
+    out_ = output_->open(out_path_, mode & 07777);
+  } catch (const std::exception& err) {
+    return fail(err.what());
+  }
+  written_[name] = out_path_;
+  return true;
+}
+
+bool tar_extractor::link_member(const std::string& name, const std::string& path, std::size_t tree, const std::string& rest, char type, const std::string& target) {
+  if (!make_parent(path)) return false;
+  bool single = members_.find(name) != members_.end();
+  try {
+    toyo::fs::remove(path);
+  } catch (const std::exception&) {}
+  links_.erase(std::make_pair(tree, normal_path(rest)));
+  if (type == '1') {
+    // the target is a member extracted before
+    auto it = written_.find(target);
+    if (it == written_.end()) {
+      if (!single) return true;
+      return fail("Hard link target not extracted: " + target);
+    }
+    // the target has to be complete, it may be copied
+    try {
+      output_->flush();
+    } catch (const std::exception& err) {
+      return fail(err.what());
+    }
+    if (!hard_link(it->second, path)) {
+      return fail("Can not link " + path + " to " + it->second);
+    }
+    written_[name] = path;
+  } else {
+#ifdef _WIN32
+    // needs a privilege most users do not have, and no Windows archive
+    // nodev reads has any
+    if (!single) return true;
+    return fail("Can not create symbolic link: " + path);
+#else
+    if (!safe_link(rest, target, tree, links_)) {
+      return fail("Unsafe link in archive: " + name + " -> " + target);
+    }
+    if (symlink(target.c_str(), path.c_str()) != 0) {
+      return fail("Can not create symbolic link: " + path);
+    }
+    links_.insert(std::make_pair(tree, normal_path(rest)));
+#endif
+  }
+  if (single) {
+    pending_.push_back(path.substr(0, path.length() - 4));
+    extracted_++;
+  }
+  return true;
+}
+
+bool tar_extractor::close_member() {
+  if (out_ == -1) {
+    return true;
+  }
+
+  int file = out_;
+  out_ = -1;
+  if (out_single_) pending_.push_back(out_path_.substr(0, out_path_.length() - 4));
+  try {
+    output_->close(file);
+  } catch (const std::exception& err) {
+    return fail(err.what());
+  }
+  if (out_single_) extracted_++;
+  return true;
+}
+
+bool tar_extractor::finish() {
+  if (failed_) return false;
+  try {
+    output_->flush();
+  } catch (const std::exception& err) {
+    return fail(err.what());
+  }
+  if (!members_.empty() && extracted_ != members_.size()) {
+    return fail(std::to_string(members_.size() - extracted_) + " member(s) not found in archive");
+  }
+  for (std::size_t i = 0; i < trees_.size(); i++) {
+    if (tree_entries_[i] == 0 && !tree_optional_[i]) {
+      return fail("Directory not found in archive: " + trees_[i].first);
+    }
+    if (!ended_) {
+      return fail("Unexpected end of tar stream");
+    }
+  }
+  while (!pending_.empty()) {
+    std::string dest = pending_.back();
+    try {
+#ifdef _WIN32
+      toyo::fs::remove(dest);
+#endif
+      toyo::fs::rename(dest + ".tmp", dest);
+    } catch (const std::exception& err) {
+      return fail(err.what());
+    }
+    pending_.pop_back();
+  }
+  while (!trees_.empty()) {
+    std::string dest = trees_.back().second;
+    if (tree_entries_.back() > 0) {
+      try {
+        toyo::fs::remove(dest);
+        toyo::fs::rename(dest + ".tmp", dest);
+      } catch (const std::exception& err) {
+        return fail(err.what());
+      }
+    }
+    trees_.pop_back();
+    tree_entries_.pop_back();
+    tree_optional_.pop_back();
+  }
+  return true;
+}
+
+piped_extractor::~piped_extractor() {
+  stop();
+}
+
+piped_extractor::piped_extractor():
+  tar_extractor(),
+  writer_(),
+  queue_(),
+  free_(),
+  busy_(false),
+  closed_(false) {}
+
+void piped_extractor::run() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (;;) {
+    ready_.wait(lock, [this]() -> bool { return !queue_.empty() || closed_; });
+    if (queue_.empty()) break;
+    std::shared_ptr<std::vector<unsigned char> > chunk = std::move(queue_.front());
+    queue_.pop_front();
+    busy_ = true;
+    lock.unlock();
+    // after a failure the rest is only drained
+    if (!failed()) write_chunk(chunk);
+    lock.lock();
+    busy_ = false;
+    free_.push_back(std::move(chunk));
+    space_.notify_all();
+  }
+}
+
+std::shared_ptr<std::vector<unsigned char> > piped_extractor::take() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  // the files hold on to a chunk until its data is written, nothing else
+  // takes a new reference
+  for (std::size_t i = 0; i < free_.size(); i++) {
+    if (free_[i].use_count() == 1) {
+      std::shared_ptr<std::vector<unsigned char> > chunk = std::move(free_[i]);
+      free_.erase(free_.begin() + i);
+      return chunk;
+    }
+  }
+  if (free_.size() > NODEV_TAR_QUEUE_DEPTH) free_.erase(free_.begin());
+  return std::make_shared<std::vector<unsigned char> >();
+}
+
+void piped_extractor::push(std::shared_ptr<std::vector<unsigned char> >& chunk) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (!writer_.joinable()) {
+    writer_ = std::thread(&piped_extractor::run, this);
+  }
+  space_.wait(lock, [this]() -> bool { return queue_.size() < NODEV_TAR_QUEUE_DEPTH; });
+  queue_.push_back(std::move(chunk));
+  ready_.notify_one();
+}
+
+void piped_extractor::drain() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  space_.wait(lock, [this]() -> bool { return queue_.empty() && !busy_; });
+}
+
+void piped_extractor::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true;
+    ready_.notify_one();
+  }
+  if (writer_.joinable()) writer_.join();
+}
+
+tgz_extractor::~tgz_extractor() {
+  stop();
+  inflateEnd(strm_);
+  delete strm_;
+}
+
+tgz_extractor::tgz_extractor():
+  piped_extractor(),
+  strm_(new z_stream()),
+  stream_end_(false) {
+  memset(strm_, 0, sizeof(z_stream));
+  if (inflateInit2(strm_, 15 + 16) != Z_OK) {
+    fail("inflateInit2 failed");
+  }
+}
+
+bool tgz_extractor::write(const unsigned char* data, std::size_t len) {
+  if (failed()) return false;
+
+  while (len > 0 && !done()) {
+    if (stream_end_) {
+      // whatever follows the tar stream is ignored, anything else is the
+      // next of concatenated gzip members
+      drain();
+      if (ended() || failed()) return !failed();
+      inflateReset(strm_);
+      stream_end_ = false;
+    }
+
+    std::shared_ptr<std::vector<unsigned char> > chunk = take();
+    chunk->resize(NODEV_TAR_BUFFER_SIZE);
+
+    uInt in = len > (1u << 30) ? (1u << 30) : (uInt)len;
+    strm_->next_in = (Bytef*)data;
+    strm_->avail_in = in;
+    strm_->next_out = chunk->data();
+    strm_->avail_out = NODEV_TAR_BUFFER_SIZE;
+    while (strm_->avail_in > 0 && strm_->avail_out > 0 && !stream_end_) {
+      int r = inflate(strm_, Z_NO_FLUSH);
+      if (r != Z_OK && r != Z_STREAM_END && r != Z_BUF_ERROR) {
+        return fail(std::string("Invalid gzip stream: ") + (strm_->msg ? strm_->msg : zError(r)));
+      }
+      if (r == Z_STREAM_END) stream_end_ = true;
+      if (r == Z_BUF_ERROR) break;
+    }
+    std::size_t have = NODEV_TAR_BUFFER_SIZE - strm_->avail_out;
+    std::size_t used = in - strm_->avail_in;
+    if (have > 0) {
+      chunk->resize(have);
+      push(chunk);
+    }
+    data += used;
+    len -= used;
+    if (failed()) return false;
+  }
+  return true;
+}
+
+bool tgz_extractor::finish() {
+  stop();
+  if (failed()) return false;
+  if (!done() && !stream_end_) {
+    return fail("Unexpected end of gzip stream");
+  }
+  return tar_extractor::finish();
+}
+
+txz_extractor::~txz_extractor() {
+  stop();
+  xz_dec_end(dec_);
+}
+
+txz_extractor::txz_extractor():
+  piped_extractor(),
+  dec_(xz_dec_init()),
+  chunk_() {
+  if (dec_ == nullptr) {
+    fail("xz_dec_init failed");
+  }
+}
+
+int txz_extractor::output(const unsigned char* data, std::size_t len, void* param) {
+  txz_extractor* self = (txz_extractor*) param;
+  while (len > 0) {
+    if (!self->chunk_) {
+      self->chunk_ = self->take();
+      self->chunk_->clear();
+      self->chunk_->reserve(NODEV_TAR_BUFFER_SIZE);
+    }
+    std::vector<unsigned char>& chunk = *self->chunk_;
+    std::size_t n = NODEV_TAR_BUFFER_SIZE - chunk.size();
+    if (n > len) n = len;
+    chunk.insert(chunk.end(), data, data + n);
+    data += n;
+    len -= n;
+    if (chunk.size() == NODEV_TAR_BUFFER_SIZE) {
+      self->push(self->chunk_);
+    }
+  }
+  // stops the decoder once nothing more is wanted
+  return self->failed() || self->done() ? 1 : 0;
+}
+
+bool txz_extractor::write(const unsigned char* data, std::size_t len) {
+  if (failed()) return false;
+  if (done()) return true;
+
+  int r = xz_dec_run(dec_, data, len, &txz_extractor::output, this);
+  if (chunk_ && !chunk_->empty()) {
+    push(chunk_);
+  }
+  if (failed()) return false;
+  if (r != XZ_OK && !(r == XZ_WRITE_ERROR && done())) {
+    return fail(std::string("Invalid xz stream: ") + xz_dec_message(r));
+  }
+  return true;
+}
+
+bool txz_extractor::finish() {
+  stop();
+  if (failed()) return false;
+  if (!done() && xz_dec_finish(dec_) != XZ_OK) {
+    return fail("Unexpected end of xz stream");
+  }
+  return tar_extractor::finish();
+}
+
+}
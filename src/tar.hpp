@@ -0,0 +1,185 @@
+#ifndef __NODEV_TAR_HPP__
+#define __NODEV_TAR_HPP__
+
+#include <string>
+#include <map>
+#include <set>
+#include <memory>
+#include <vector>
+#include <deque>
+#include <utility>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <cstdio>
+#include <cstddef>
+#include <cstdint>
+
+struct z_stream_s;
+struct xz_dec;
+
+namespace toyo {
+namespace fs {
+class bulk_writer;
+}
+}
+
+namespace nodev {
+
+/*
+ * Push parser of a tar stream. Only the members registered with extract()
+ * or extract_tree() are written: single members to `dest`.tmp and trees
+ * into `dest`.tmp. finish() moves them to their final path, an extractor
+ * destroyed before that leaves nothing behind.
+ *
+ * Sizes are 64-bit (octal or GNU base-256), long names come from GNU 'L' /
+ * 'K' records or pax headers, symbolic and hard links are recreated. A
+ * symbolic link must point inside its tree, and no member is written
+ * through a link of the same archive, so nothing lands outside `dest`.tmp
+ * whatever the archive holds; only call finish() once the archive has been
+ * verified.
+ * Member data goes through a toyo::fs::bulk_writer, so the opens, writes
+ * and closes of many small files overlap with parsing.
+ */
+class tar_extractor {
+ public:
+  virtual ~tar_extractor();
+  tar_extractor();
+  tar_extractor(const tar_extractor&) = delete;
+  tar_extractor& operator=(const tar_extractor&) = delete;
+
+  // the member named `member` to the file `dest`
+  void extract(const std::string& member, const std::string& dest);
+  // everything under the directory `member` ("" for the whole archive) to
+  // the directory `dest`, which finish() replaces; an `optional` tree that
+  // is not in the archive leaves `dest` alone
+  void extract_tree(const std::string& member, const std::string& dest, bool optional = false);
+  virtual bool write(const unsigned char* data, std::size_t len);
+  virtual bool finish();
+  // every registered member has been written, a tree is only complete at
+  // the end of the archive
+  bool done() const;
+  // the end-of-archive blocks have been read
+  bool ended() const;
+  bool failed() const;
+  std::string error() const;
+
+ protected:
+  bool fail(const std::string& message);
+  // write() of a whole chunk, member data in it is handed to the files
+  // without a copy
+  bool write_chunk(const std::shared_ptr<const std::vector<unsigned char> >& chunk);
+
+ private:
+  enum parse_state { state_header, state_data, state_meta, state_padding, state_end };
+
+  bool on_header();
+  bool on_meta();
+  // where the member `name` goes, "" when it is not wanted, and its path
+  // inside the tree, the file name for a single member
+  bool target_of(const std::string& name, std::string* path, std::size_t* tree, std::string* rest);
+  bool make_parent(const std::string& path);
+  bool open_member(const std::string& name, const std::string& path, std::size_t tree, const std::string& rest, int mode);
+  bool link_member(const std::string& name, const std::string& path, std::size_t tree, const std::string& rest, char type, const std::string& target);
+  bool close_member();
+
+  mutable std::mutex error_mutex_;
+  std::string error_;
+  std::atomic<bool> failed_;
+  std::map<std::string, std::string> members_;
+  // member directory and destination of every tree, and how many entries
+  // each one got
+  std::vector<std::pair<std::string, std::string> > trees_;
+  std::vector<std::size_t> tree_entries_;
+  std::vector<bool> tree_optional_;
+  std::atomic<std::size_t> extracted_;
+  std::atomic<bool> ended_;
+  parse_state state_;
+  unsigned char block_[512];
+  std::size_t block_len_;
+  uint64_t remaining_;
+  uint64_t padding_;
+  char meta_type_;
+  std::string meta_;
+  std::string long_name_;
+  std::string long_link_;
+  std::unique_ptr<toyo::fs::bulk_writer> output_;
+  // the chunk write_chunk() is parsing, if any
+  const std::shared_ptr<const std::vector<unsigned char> >* source_;
+  int out_;   // file of output_, -1 for none
+  std::string out_path_;
+  bool out_single_;
+  std::string last_dir_;
+  // archive name to the file written for it, the targets of hard links
+  std::map<std::string, std::string> written_;
+  // tree and path inside it of every symbolic link created so far
+  std::set<std::pair<std::size_t, std::string> > links_;
+  std::vector<std::string> pending_;
+};
+
+/*
+ * tar_extractor fed by a decompressor. The decompressor runs on the calling
+ * thread and hands large chunks to a writer thread that parses the tar
+ * stream and writes the files, so neither waits for the other.
+ */
+class piped_extractor : public tar_extractor {
+ public:
+  virtual ~piped_extractor();
+  piped_extractor();
+
+ protected:
+  // an empty chunk to fill, one the files no longer reference when there
+  // is such
+  std::shared_ptr<std::vector<unsigned char> > take();
+  void push(std::shared_ptr<std::vector<unsigned char> >& chunk);
+  // waits until the writer thread has parsed everything pushed so far
+  void drain();
+  void stop();
+
+ private:
+  void run();
+
+  std::thread writer_;
+  std::mutex mutex_;
+  std::condition_variable ready_;
+  std::condition_variable space_;
+  std::deque<std::shared_ptr<std::vector<unsigned char> > > queue_;
+  std::vector<std::shared_ptr<std::vector<unsigned char> > > free_;
+  bool busy_;
+  bool closed_;
+};
+
+// tar_extractor that takes a gzip compressed stream
+class tgz_extractor : public piped_extractor {
+ public:
+  virtual ~tgz_extractor();
+  tgz_extractor();
+
+  virtual bool write(const unsigned char* data, std::size_t len) override;
+  virtual bool finish() override;
+
+ private:
+  struct z_stream_s* strm_;
+  bool stream_end_;
+};
+
+// tar_extractor that takes an xz compressed stream
+class txz_extractor : public piped_extractor {
+ public:
+  virtual ~txz_extractor();
+  txz_extractor();
+
+  virtual bool write(const unsigned char* data, std::size_t len) override;
+  virtual bool finish() override;
+
+ private:
+  static int output(const unsigned char* data, std::size_t len, void* param);
+
+  struct xz_dec* dec_;
+  std::shared_ptr<std::vector<unsigned char> > chunk_;
+};
+
+}
+
+#endif
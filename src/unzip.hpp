@@ -4,19 +4,9 @@
 #include <string>
 
 namespace nodev {
-  typedef struct unzCallbackInfo {
-    std::string name;
-    unsigned long currentUncompressed;
-    unsigned long currentTotal;
-    unsigned long uncompressed;
-    unsigned long total;
-    unsigned long entry;
-  } unzCallbackInfo;
-
-  typedef void (*unzCallback)(unzCallbackInfo*, void*);
-
-  bool unzip(const std::string& zipFilePath, const std::string& outDir, unzCallback callback, void* param);
-  bool untgz(const std::string& zipFilePath, const std::string& outDir);
+  // the directory `member` of a .tar.gz ("" for all of it) to `outDir`,
+  // which is replaced once everything is extracted
+  bool untgz(const std::string& tgzFilePath, const std::string& member, const std::string& outDir, std::string* error = nullptr);
 }
 
 #endif